@@ -0,0 +1,261 @@
+// FrameGraph.cpp
+
+#include "FrameGraph.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <set>
+#include <stdexcept>
+
+#include "StateCache.hpp"
+
+using namespace GLWrap;
+
+
+const FrameGraph::Resource FrameGraph::backbuffer;
+
+
+FrameGraph::FrameGraph(RenderTargetPool &pool) : pool(pool), culled(0), copied(0) {
+    reset();
+}
+
+void FrameGraph::reset() {
+    passes.clear();
+    resources.clear();
+
+    ResourceInfo window;
+    window.name = "window";
+    window.mipmapsValid = false;
+    resources.push_back(window);
+}
+
+FrameGraph::Resource FrameGraph::create(const std::string &name, const RenderTargetDesc &desc) {
+    ResourceInfo r;
+    r.name = name;
+    r.desc = desc;
+    r.mipmapsValid = false;
+    resources.push_back(r);
+    return (Resource) resources.size() - 1;
+}
+
+int FrameGraph::addPass(const std::string &name, std::function<void()> execute) {
+    PassInfo p;
+    p.name = name;
+    p.execute = execute;
+    passes.push_back(p);
+    return (int) passes.size() - 1;
+}
+
+void FrameGraph::read(int pass, Resource resource, bool mipmaps) {
+    if (resource == backbuffer) {
+        throw std::runtime_error("Frame graph pass " + passes.at(pass).name + " reads the window");
+    }
+    passes.at(pass).reads.emplace_back(resource, mipmaps);
+}
+
+void FrameGraph::write(int pass, Resource resource) {
+    passes.at(pass).writes.push_back(resource);
+    resources.at(resource).writers.push_back(pass);
+}
+
+void FrameGraph::copy(int pass, Resource src, Resource dst, GLbitfield mask) {
+    if (src == backbuffer || dst == backbuffer) {
+        throw std::runtime_error("Frame graph pass " + passes.at(pass).name + " copies the window");
+    }
+    Copy c;
+    c.src = src;
+    c.dst = dst;
+    c.mask = mask;
+    passes.at(pass).copies.push_back(c);
+    read(pass, src);
+    write(pass, dst);
+}
+
+// Blit the buffers in mask of the level 0 of src to dst
+void FrameGraph::blit(Resource src, Resource dst, GLbitfield mask) const {
+    const Framebuffer &from = target(src);
+    const Framebuffer &to = target(dst);
+    const Eigen::Vector2i &fromSize = resources[src].desc.size;
+    const Eigen::Vector2i &toSize = resources[dst].desc.size;
+
+    // attach level 0 of both, then read from src
+    from.bind(0);
+    to.bind(0);
+    StateCache::bindFramebuffer(GL_READ_FRAMEBUFFER, from.id());
+    glBlitFramebuffer(0, 0, fromSize.x(), fromSize.y(), 0, 0, toSize.x(), toSize.y(), mask, GL_NEAREST);
+}
+
+// The passes writing the window and the writers added before them of what
+// they read, recursively
+std::vector<bool> FrameGraph::cull() const {
+    std::vector<bool> live(passes.size(), false);
+    std::vector<int> stack;
+    for (int p = 0; p < passes.size(); p++) {
+        const std::vector<Resource> &w = passes[p].writes;
+        if (std::find(w.begin(), w.end(), backbuffer) != w.end()) {
+            live[p] = true;
+            stack.push_back(p);
+        }
+    }
+    while (!stack.empty()) {
+        int p = stack.back();
+        stack.pop_back();
+        for (const std::pair<Resource, bool> &r : passes[p].reads) {
+            for (int w : resources[r.first].writers) {
+                if (w < p && !live[w]) {
+                    live[w] = true;
+                    stack.push_back(w);
+                }
+            }
+        }
+    }
+    return live;
+}
+
+// The live passes, each after the writers added before it of what it reads
+// and before the writers added after it; the writers of a resource keep
+// their order, and passes free to run take the first added
+std::vector<int> FrameGraph::order(const std::vector<bool> &live) const {
+    std::vector<std::vector<int>> next(passes.size());
+    std::vector<int> waiting(passes.size(), 0);
+    auto edge = [&](int from, int to) {
+        next[from].push_back(to);
+        waiting[to]++;
+    };
+
+    for (const ResourceInfo &r : resources) {
+        int previous = -1;
+        for (int w : r.writers) {
+            if (live[w]) {
+                if (previous >= 0 && previous != w) {
+                    edge(previous, w);
+                }
+                previous = w;
+            }
+        }
+    }
+    for (int p = 0; p < passes.size(); p++) {
+        if (!live[p]) {
+            continue;
+        }
+        for (const std::pair<Resource, bool> &r : passes[p].reads) {
+            for (int w : resources[r.first].writers) {
+                // a pass reads what was written before it was added, and
+                // the writers added after it must not overwrite that first
+                if (live[w] && w < p) {
+                    edge(w, p);
+                } else if (live[w] && w > p) {
+                    edge(p, w);
+                }
+            }
+        }
+    }
+
+    std::set<int> ready;
+    int numLive = 0;
+    for (int p = 0; p < passes.size(); p++) {
+        if (live[p]) {
+            numLive++;
+            if (waiting[p] == 0) {
+                ready.insert(p);
+            }
+        }
+    }
+    std::vector<int> sorted;
+    while (!ready.empty()) {
+        int p = *ready.begin();
+        ready.erase(ready.begin());
+        sorted.push_back(p);
+        for (int n : next[p]) {
+            if (--waiting[n] == 0) {
+                ready.insert(n);
+            }
+        }
+    }
+    if (sorted.size() != numLive) {
+        throw std::runtime_error("The passes of the frame graph depend on each other in a cycle");
+    }
+    return sorted;
+}
+
+void FrameGraph::execute() {
+    std::vector<bool> live = cull();
+    std::vector<int> sorted = order(live);
+    culled = (int) (passes.size() - sorted.size());
+    copied = 0;
+
+    // the first and the last pass using every target
+    std::vector<int> first(resources.size(), -1), last(resources.size(), -1);
+    auto use = [&](Resource r, int i) {
+        if (first[r] < 0) {
+            first[r] = i;
+        }
+        last[r] = i;
+    };
+    for (int i = 0; i < sorted.size(); i++) {
+        for (const std::pair<Resource, bool> &r : passes[sorted[i]].reads) {
+            use(r.first, i);
+        }
+        for (Resource r : passes[sorted[i]].writes) {
+            use(r, i);
+        }
+    }
+
+    ranNames.clear();
+    for (int i = 0; i < sorted.size(); i++) {
+        PassInfo &p = passes[sorted[i]];
+        for (Resource r = 1; r < resources.size(); r++) {
+            if (first[r] == i) {
+                resources[r].framebuffer = pool.acquire(resources[r].desc);
+                resources[r].mipmapsValid = false;
+            }
+        }
+        for (const std::pair<Resource, bool> &r : p.reads) {
+            ResourceInfo &info = resources[r.first];
+            if (r.second && !info.mipmapsValid) {
+                for (int c = 0; c < info.desc.color.size(); c++) {
+                    info.framebuffer->colorTexture(c).generateMipmap();
+                }
+                info.mipmapsValid = true;
+            }
+        }
+
+        // a copy is only made if a pass wrote its source before
+        for (const Copy &c : p.copies) {
+            const std::vector<int> &writers = resources[c.src].writers;
+            if (std::find_if(writers.begin(), writers.end(), [&](int w) { return w < sorted[i] && live[w]; })
+                != writers.end()) {
+                blit(c.src, c.dst, c.mask);
+                copied++;
+            }
+        }
+
+        p.execute();
+        ranNames.push_back(p.name);
+
+        for (Resource r : p.writes) {
+            resources[r].mipmapsValid = false;
+        }
+        for (Resource r = 1; r < resources.size(); r++) {
+            if (last[r] == i) {
+                pool.release(resources[r].framebuffer);
+            }
+        }
+    }
+}
+
+const Framebuffer &FrameGraph::target(Resource resource) const {
+    const std::shared_ptr<Framebuffer> &framebuffer = resources.at(resource).framebuffer;
+    if (!framebuffer) {
+        throw std::runtime_error("The frame graph target " + resources.at(resource).name + " is not acquired");
+    }
+    return *framebuffer;
+}
+
+void FrameGraph::printStats() const {
+    std::string names;
+    for (const std::string &n : ranNames) {
+        names += (names.empty() ? "" : ", ") + n;
+    }
+    printf("\t%d passes (%d culled), %d copies: %s\n", (int) ranNames.size(), culled, copied, names.c_str());
+}
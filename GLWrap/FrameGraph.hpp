@@ -0,0 +1,142 @@
+// FrameGraph.hpp
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <nanogui/opengl.h>
+
+#include "Framebuffer.hpp"
+#include "RenderTargetPool.hpp"
+#include "Util.hpp"
+
+namespace GLWrap {
+
+/*
+ * The passes of a frame and the render targets they read and write,
+ * declared up front and run together.
+ *
+ * A pass is a function drawing with OpenGL, with the resources it reads
+ * and writes.  Resources are the transient render targets of the frame,
+ * made from a RenderTargetPool, and the window (backbuffer).  When run,
+ * the graph:
+ *   - culls the passes whose outputs no pass needs: the passes kept are
+ *     those writing the window and, recursively, the writers added before
+ *     a kept pass of what it reads,
+ *   - orders the passes so that every pass reads what the passes added
+ *     before it wrote: it runs after those writers and before the writers
+ *     of the same resources added after it.  The writers of a resource run
+ *     in the order they were added, and otherwise passes keep the order
+ *     they were added in, so adding a pass does not reorder the others,
+ *   - acquires each target from the pool before its first pass and
+ *     releases it after its last one, so that targets whose passes do not
+ *     overlap share their textures,
+ *   - generates the mipmaps of a target before a pass that reads them, once
+ *     after every write,
+ *   - copies a target into another before a pass that draws over the copy
+ *     (see copy), unless the pass is culled or nothing wrote the source.
+ *
+ * The graph is declared again every frame, so passes may change with the
+ * configuration without any bookkeeping of what is allocated.
+ *
+ * Use per frame:
+ *     graph.reset();
+ *     FrameGraph::Resource image = graph.create("image", desc);
+ *     int draw = graph.addPass("draw", [&]() { ... graph.target(image).bind(); ... });
+ *     graph.write(draw, image);
+ *     int show = graph.addPass("show", [&]() { ... reads graph.target(image) ... });
+ *     graph.read(show, image);
+ *     graph.write(show, FrameGraph::backbuffer);
+ *     graph.execute();
+ */
+class GLWRAP_EXPORT FrameGraph {
+public:
+
+    typedef int Resource;
+
+    // The default framebuffer, the window.  Passes writing it are never culled.
+    static const Resource backbuffer = 0;
+
+    // A graph taking its targets from pool
+    FrameGraph(RenderTargetPool &pool);
+
+    // Copying is not allowed because the graph holds targets of the pool while it runs
+    FrameGraph(const FrameGraph &) = delete;
+    FrameGraph &operator=(const FrameGraph &) = delete;
+
+    // Drop the passes and resources, to declare the graph of a new frame
+    void reset();
+
+    // A transient render target, acquired from the pool while its passes run
+    Resource create(const std::string &name, const RenderTargetDesc &desc);
+
+    // Add a pass; what it reads and writes is declared with read() and write()
+    // on the returned pass.  execute is called when the graph runs.
+    int addPass(const std::string &name, std::function<void()> execute);
+
+    // The pass reads a resource; with mipmaps, the mipmaps of its color textures
+    // @throws std::runtime_error if the resource is the window.
+    void read(int pass, Resource resource, bool mipmaps = false);
+
+    // The pass writes a resource
+    void write(int pass, Resource resource);
+
+    // The pass draws over a copy of the buffers in mask (GL_COLOR_BUFFER_BIT,
+    // GL_DEPTH_BUFFER_BIT) of the level 0 of src in dst: it reads src and
+    // writes dst, and the graph blits src to dst before running it
+    // @throws std::runtime_error if src or dst is the window.
+    void copy(int pass, Resource src, Resource dst, GLbitfield mask);
+
+    // Cull, order and run the passes
+    // @throws std::runtime_error if the passes depend on each other in a cycle.
+    void execute();
+
+    // The framebuffer of a target, while the passes using it run
+    // @throws std::runtime_error if the target is not acquired.
+    const Framebuffer &target(Resource resource) const;
+
+    // The passes run by the last execute(), in order, the number culled and
+    // the number of copies made
+    void printStats() const;
+
+private:
+
+    struct ResourceInfo {
+        std::string name;
+        RenderTargetDesc desc;
+        std::shared_ptr<Framebuffer> framebuffer;
+        std::vector<int> writers;   // in the order the passes were added
+        bool mipmapsValid;
+    };
+
+    struct Copy {
+        Resource src, dst;
+        GLbitfield mask;
+    };
+
+    struct PassInfo {
+        std::string name;
+        std::function<void()> execute;
+        std::vector<std::pair<Resource, bool>> reads;   // with mipmaps or not
+        std::vector<Resource> writes;
+        std::vector<Copy> copies;   // made before execute, in order
+    };
+
+    RenderTargetPool &pool;
+    std::vector<ResourceInfo> resources;
+    std::vector<PassInfo> passes;
+
+    std::vector<std::string> ranNames;
+    int culled;
+    int copied;
+
+    std::vector<bool> cull() const;
+    std::vector<int> order(const std::vector<bool> &live) const;
+    void blit(Resource src, Resource dst, GLbitfield mask) const;
+};
+
+} // namespace
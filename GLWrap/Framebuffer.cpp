@@ -14,80 +14,107 @@ Framebuffer::Framebuffer(const nanogui::Vector2i& size, int numColorAttachments,
                                            bool useDepthAttachment) :
 mDepth(useDepthAttachment ?
        new Texture2D(size, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT) : nullptr) {
-  glGenFramebuffers(1, &mFramebufferId);
-
   for (int colorAttachment = 0; colorAttachment < numColorAttachments; colorAttachment++) {
     mColor.emplace_back(size);
   }
 
-  if (!complete()) throw std::runtime_error("Could not create framebuffer object!");
+  create();
 }
 
 Framebuffer::Framebuffer(std::vector<Texture2D> colorAttachments,
                              std::unique_ptr<Texture2D> depthAttachment) :
 mColor(std::move(colorAttachments)),
 mDepth(std::move(depthAttachment)) {
-  glGenFramebuffers(1, &mFramebufferId);
-
-  if (!complete()) throw std::runtime_error("Could not create framebuffer object!");
+  create();
 }
 
 Framebuffer::Framebuffer(const Eigen::Vector2i& size,
-                             const std::vector<std::pair<GLenum, GLenum>>& colorAttachmentFormats) {
-  glGenFramebuffers(1, &mFramebufferId);
-
+                             const std::vector<std::pair<GLenum, GLenum>>& colorAttachmentFormats,
+                             int levels) {
   mColor.reserve(colorAttachmentFormats.size());
   for (const std::pair<GLenum, GLenum>& formats : colorAttachmentFormats) {
-    mColor.emplace_back(size, formats.first, formats.second);
+    mColor.emplace_back(size, formats.first, formats.second, levels);
   }
 
-  if (!complete()) throw std::runtime_error("Could not create framebuffer object!");
+  create();
 }
 
 Framebuffer::Framebuffer(const Eigen::Vector2i& size,
                              const std::vector<std::pair<GLenum, GLenum>>& colorAttachmentFormats,
-                             const std::pair<GLenum, GLenum>& depthAttachmentFormat) {
-  glGenFramebuffers(1, &mFramebufferId);
-
+                             const std::pair<GLenum, GLenum>& depthAttachmentFormat,
+                             int levels) {
   mColor.reserve(colorAttachmentFormats.size());
   for (const std::pair<GLenum, GLenum>& formats : colorAttachmentFormats) {
-    mColor.emplace_back(size, formats.first, formats.second);
+    mColor.emplace_back(size, formats.first, formats.second, levels);
   }
   mDepth.reset(new Texture2D(size, depthAttachmentFormat.first,
-                             depthAttachmentFormat.second));
+                             depthAttachmentFormat.second, levels));
+
+  create();
+}
+
+void Framebuffer::create() {
+  if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+    glCreateFramebuffers(1, &mFramebufferId);
+#endif
+  } else {
+    glGenFramebuffers(1, &mFramebufferId);
+  }
+
+  // The attachments are set up once, binding only switches framebuffers
+  mLevel = -1;
+  attach(0);
 
   if (!complete()) throw std::runtime_error("Could not create framebuffer object!");
 }
 
+void Framebuffer::attach(int mipmapLevel) const {
+  if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+    for (int colorAttachment = 0; colorAttachment < mColor.size(); colorAttachment++) {
+      glNamedFramebufferTexture(mFramebufferId, GL_COLOR_ATTACHMENT0 + colorAttachment,
+                                mColor[colorAttachment].id(), mipmapLevel);
+    }
+    if (mDepth) {
+      glNamedFramebufferTexture(mFramebufferId, GL_DEPTH_ATTACHMENT, mDepth->id(), mipmapLevel);
+    }
+#endif
+  } else {
+    StateCache::bindFramebuffer(GL_FRAMEBUFFER, mFramebufferId);
+    for (int colorAttachment = 0; colorAttachment < mColor.size(); colorAttachment++) {
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + colorAttachment,
+                             GL_TEXTURE_2D, mColor[colorAttachment].id(), mipmapLevel);
+    }
+    if (mDepth) {
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepth->id(), mipmapLevel);
+    }
+  }
+  mLevel = mipmapLevel;
+}
+
 
 void Framebuffer::bind(int mipmapLevel) const {
-  glBindFramebuffer(GL_FRAMEBUFFER, mFramebufferId);
-  for (int colorAttachment = 0; colorAttachment < mColor.size(); colorAttachment++) {
-    const Texture2D& tex = mColor[colorAttachment];
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + colorAttachment,
-                           GL_TEXTURE_2D, tex.id(), mipmapLevel);
-  }
-  if (mDepth) {
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepth->id(), mipmapLevel);
+  if (mipmapLevel != mLevel) {
+    attach(mipmapLevel);
   }
+  StateCache::bindFramebuffer(GL_FRAMEBUFFER, mFramebufferId);
 }
 
 void Framebuffer::unbind() const {
-  for (int colorAttachment = 0; colorAttachment < mColor.size(); colorAttachment++) {
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + colorAttachment,
-                           GL_TEXTURE_2D, 0, 0);
-  }
-  if (mDepth) {
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
-  }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  StateCache::bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 bool Framebuffer::complete() const {
-  bind();
-  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-  bool result = status == GL_FRAMEBUFFER_COMPLETE;
-  unbind();
-  return result;
+  GLenum status = 0;
+  if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+    status = glCheckNamedFramebufferStatus(mFramebufferId, GL_FRAMEBUFFER);
+#endif
+  } else {
+    bind(mLevel);
+    status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    unbind();
+  }
+  return status == GL_FRAMEBUFFER_COMPLETE;
 }
-
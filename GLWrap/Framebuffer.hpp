@@ -9,6 +9,7 @@
 #pragma once
 
 #include "Texture2D.hpp"
+#include "StateCache.hpp"
 
 NAMESPACE_BEGIN(GLWrap)
 
@@ -34,8 +35,10 @@ public:
   /// @arg size The size of each of the textures in pixels.
   /// @arg colorAttachmentFormats Pairs of internalFormat and format parameters for each color
   ///   texture.
+  /// @arg levels The number of mipmap levels of each texture (see Texture2D).
   Framebuffer(const Eigen::Vector2i& size,
-              const std::vector<std::pair<GLenum, GLenum>>& colorAttachmentFormats);
+              const std::vector<std::pair<GLenum, GLenum>>& colorAttachmentFormats,
+              int levels = 1);
 
   /// Create a framebuffer with depth and color attachments, creating new textures using 
   /// the provided formats.
@@ -45,9 +48,11 @@ public:
   ///   texture.
   /// @arg depthAttachmentFormats A pair of internalFormat and format parameters for the
   ///   depth texture.
+  /// @arg levels The number of mipmap levels of each texture (see Texture2D).
   Framebuffer(const Eigen::Vector2i& size,
               const std::vector<std::pair<GLenum, GLenum>>& colorAttachmentFormats,
-              const std::pair<GLenum, GLenum>& depthAttachmentFormat);
+              const std::pair<GLenum, GLenum>& depthAttachmentFormat,
+              int levels = 1);
 
   /// Create a framebuffer that takes ownership of existing textures; this allows additional
   /// flexibility on the type and format of textures. Arguments should be transfered using 
@@ -74,13 +79,15 @@ public:
   /// Delete this framebuffer and its associated textures.
   ~Framebuffer() noexcept;
 
-  /// Bind the framebuffer object and attach all relevent textures.
+  /// Bind the framebuffer object.
   /// This must be called before modifying or drawing to the framebuffer.
+  /// The textures are attached once on creation; they are only attached again
+  /// when a different mipmap level is asked for.
   /// @arg mipmapLevel The level of the mipmap of the attachments to bind.
   ///   Note that any value besides 0 assumes that mipmap space has been allocated.
   void bind(int mipmapLevel = 0) const;
 
-  /// Unbind the framebuffer object and unbind all relevent textures.
+  /// Unbind the framebuffer object; the textures stay attached.
   void unbind() const;
 
   /// Returns true if the FBO is complete.
@@ -110,6 +117,15 @@ protected:
   std::vector<Texture2D> mColor;
   /// The depth texture (if any) associated with this FBO.
   std::unique_ptr<Texture2D> mDepth;
+  /// The mipmap level of the attached textures.
+  mutable int mLevel;
+
+  /// Create the framebuffer object and attach the textures at level 0.
+  /// @throws std::runtime_error if the FBO is not complete.
+  void create();
+
+  /// Attach the textures at the given mipmap level.
+  void attach(int mipmapLevel) const;
 };
 
 
@@ -119,21 +135,25 @@ inline
 Framebuffer::Framebuffer(Framebuffer&& other)
 : mFramebufferId(other.mFramebufferId),
   mColor(std::move(other.mColor)),
-  mDepth(std::move(other.mDepth)) {
+  mDepth(std::move(other.mDepth)),
+  mLevel(other.mLevel) {
     other.mFramebufferId = 0;
   }
 
 inline
 Framebuffer& Framebuffer::operator=(Framebuffer&& other) {
+  StateCache::deletedFramebuffer(mFramebufferId);
   glDeleteFramebuffers(1, &mFramebufferId);
   mFramebufferId = other.mFramebufferId;
   mColor = std::move(other.mColor);
   mDepth = std::move(other.mDepth);
+  mLevel = other.mLevel;
   return *this;
 }
 
 inline
 Framebuffer::~Framebuffer() noexcept {
+  StateCache::deletedFramebuffer(mFramebufferId);
   glDeleteFramebuffers(1, &mFramebufferId);
 }
 
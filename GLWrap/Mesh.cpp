@@ -1,41 +1,124 @@
 // Mesh.cpp
 
+#include <algorithm>
+#include <stdexcept>
 #include <utility>
 
 #include "Mesh.hpp"
+#include "StateCache.hpp"
 
 #include "Util.hpp"
 
 using namespace GLWrap;
 
 
-Mesh::Mesh() {
+// Delete a VAO, which unbinds it if it is bound
+static void deleteVertexArray(GLuint vao) {
+    StateCache::deletedVertexArray(vao);
+    glDeleteVertexArrays(1, &vao);
+}
+
+// Create a VAO; with direct state access it must be created, not just
+// named, to be edited without binding it
+static GLuint createVertexArray() {
+    GLuint vao;
+    if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+        glCreateVertexArrays(1, &vao);
+#endif
+    } else {
+        glGenVertexArrays(1, &vao);
+    }
+    return vao;
+}
+
+// Create a buffer holding a copy of the data, without binding it
+// (direct state access)
+static GLuint createNamedBuffer(const void *data, std::size_t bytes) {
+    GLuint buffer = 0;
+#ifdef GL_VERSION_4_5
+    glCreateBuffers(1, &buffer);
+    glNamedBufferData(buffer, bytes, data, GL_STATIC_DRAW);
+#endif
+    return buffer;
+}
+
+// Overwrite a range of a buffer, without binding it if possible
+static void updateBuffer(GLenum target, GLuint buffer, std::size_t offset, const void *data, std::size_t bytes) {
+    if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+        glNamedBufferSubData(buffer, offset, bytes, data);
+#endif
+    } else {
+        glBindBuffer(target, buffer);
+        glBufferSubData(target, offset, bytes, data);
+        glBindBuffer(target, 0);
+    }
+}
+
+// Point an attribute of a VAO at a buffer holding size components of the
+// given type per vertex, without binding them (direct state access).  As
+// with glVertexAttribPointer, the attribute reads through the buffer binding
+// point of the same index.
+static void setArrayAttribute(GLuint vao, int index, GLuint buffer, GLintptr offset, GLenum type, int size,
+    GLboolean normalized) {
+#ifdef GL_VERSION_4_5
+    if (type == GL_FLOAT) {
+        glVertexArrayAttribFormat(vao, index, size, GL_FLOAT, normalized, 0);
+    } else {
+        glVertexArrayAttribIFormat(vao, index, size, type, 0);
+    }
+    glVertexArrayAttribBinding(vao, index, index);
+    glVertexArrayVertexBuffer(vao, index, buffer, offset, size * 4);
+    glEnableVertexArrayAttrib(vao, index);
+#endif
+}
+
+
+Mesh::Mesh() :
+    indexBuffer(0), interleavedBuffer(0), positionVao(0), positionBuffer(0), positionSize(0), interleavedSize(0),
+    indexMode(GL_TRIANGLES), indexLength(0), indexType(GL_UNSIGNED_INT) {
     // Create a VAO in OpenGL
-    glGenVertexArrays(1, &vao);
-    // indexBuffer is zero
+    vao = createVertexArray();
+    // indexBuffer, interleavedBuffer and the position-only VAO and buffer are zero
     // vertexBuffers is empty
 }
 
 Mesh::~Mesh() {
     // Delete the VAO and any buffers owned by this mesh
-    if (vao) glDeleteVertexArrays(1, &vao);
+    if (vao) deleteVertexArray(vao);
     if (indexBuffer) glDeleteBuffers(1, &indexBuffer);
+    if (interleavedBuffer) glDeleteBuffers(1, &interleavedBuffer);
     glDeleteBuffers(vertexBuffers.size(), vertexBuffers.data());
+    if (positionVao) deleteVertexArray(positionVao);
+    if (positionBuffer) glDeleteBuffers(1, &positionBuffer);
 }
 
 
 
 // Move-constructing a mesh leaves the source mesh empty
 Mesh::Mesh(Mesh &&other) noexcept :
-    vertexBuffers(std::move(other.vertexBuffers)) {
+    vertexBuffers(std::move(other.vertexBuffers)),
+    vertexBufferSizes(std::move(other.vertexBufferSizes)) {
     vao = other.vao;
     other.vao = 0;
     indexBuffer = other.indexBuffer;
     other.indexBuffer = 0;
+    interleavedBuffer = other.interleavedBuffer;
+    other.interleavedBuffer = 0;
+    interleavedSize = other.interleavedSize;
+    other.interleavedSize = 0;
+    positionVao = other.positionVao;
+    other.positionVao = 0;
+    positionBuffer = other.positionBuffer;
+    other.positionBuffer = 0;
+    positionSize = other.positionSize;
+    other.positionSize = 0;
     indexMode = other.indexMode;
     other.indexMode = 0;
     indexLength = other.indexLength;
     other.indexLength = 0;
+    indexType = other.indexType;
 }
 
 // Move-assigning a mesh leaves the source mesh empty
@@ -43,111 +126,418 @@ Mesh::Mesh(Mesh &&other) noexcept :
 Mesh &Mesh::operator=(Mesh &&other) {
     if (&other == this) return *this;
 
-    if (vao) glDeleteVertexArrays(1, &vao);
+    if (vao) deleteVertexArray(vao);
     if (indexBuffer) glDeleteBuffers(1, &indexBuffer);
+    if (interleavedBuffer) glDeleteBuffers(1, &interleavedBuffer);
     glDeleteBuffers(vertexBuffers.size(), vertexBuffers.data());
+    if (positionVao) deleteVertexArray(positionVao);
+    if (positionBuffer) glDeleteBuffers(1, &positionBuffer);
 
     vao = other.vao;
     other.vao = 0;
     indexBuffer = other.indexBuffer;
     other.indexBuffer = 0;
+    interleavedBuffer = other.interleavedBuffer;
+    other.interleavedBuffer = 0;
+    interleavedSize = other.interleavedSize;
+    other.interleavedSize = 0;
+    positionVao = other.positionVao;
+    other.positionVao = 0;
+    positionBuffer = other.positionBuffer;
+    other.positionBuffer = 0;
+    positionSize = other.positionSize;
+    other.positionSize = 0;
     indexMode = other.indexMode;
     other.indexMode = 0;
     indexLength = other.indexLength;
     other.indexLength = 0;
+    indexType = other.indexType;
 
     vertexBuffers = std::move(other.vertexBuffers);
+    vertexBufferSizes = std::move(other.vertexBufferSizes);
 
     return *this;
 }
 
 
-template <class T, int N>
-void Mesh::_setAttribute(int index, Eigen::Matrix<T, N, Eigen::Dynamic> data) {
+void Mesh::_uploadAttribute(int index, GLenum type, int size, const void *data, int count) {
 
     // Make space for the new buffer in our list, deleting anything that used to be there
-    if (vertexBuffers.size() <= index)
+    if (vertexBuffers.size() <= index) {
         vertexBuffers.resize(index + 1);
+        vertexBufferSizes.resize(index + 1);
+    }
     if (vertexBuffers[index])
         glDeleteBuffers(1, &vertexBuffers[index]);
     GLuint &buf = vertexBuffers[index];
 
     // Create a vertex array buffer and copy the data into it
-    glGenBuffers(1, &buf);
-    glBindBuffer(GL_ARRAY_BUFFER, buf);
-    glBufferData(GL_ARRAY_BUFFER, N * sizeof(T) * data.cols(), 
-                 (const void *) data.data(), GL_STATIC_DRAW);
+    // (float and int components are both 4 bytes)
+    vertexBufferSizes[index] = size * 4 * count;
+    // Attach the buffer to our VAO at the desired index and enable it.
+    // Integer data is passed through as integers for GLSL ivecN inputs.
+    if (hasDirectStateAccess()) {
+        buf = createNamedBuffer(data, vertexBufferSizes[index]);
+        setArrayAttribute(vao, index, buf, 0, type, size, GL_TRUE);
+    } else {
+        glGenBuffers(1, &buf);
+        glBindBuffer(GL_ARRAY_BUFFER, buf);
+        glBufferData(GL_ARRAY_BUFFER, vertexBufferSizes[index], data, GL_STATIC_DRAW);
+
+        StateCache::bindVertexArray(vao);
+        if (type == GL_FLOAT) {
+            glVertexAttribPointer(index, size, GL_FLOAT, GL_TRUE, 0, 0);
+        } else {
+            glVertexAttribIPointer(index, size, GL_INT, 0, 0);
+        }
+        glEnableVertexAttribArray(index);
+        StateCache::bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    checkGLError("Mesh::_uploadAttribute end");
+}
+
+void Mesh::_updateAttribute(int index, std::size_t offset, const void *data, std::size_t bytes) {
+
+    if (index < 0 || index >= vertexBuffers.size() || !vertexBuffers[index])
+        throw std::out_of_range("Mesh::updateAttributeRange: no buffer at attribute " + std::to_string(index));
+    if (offset + bytes > vertexBufferSizes[index])
+        throw std::out_of_range("Mesh::updateAttributeRange: range past the end of attribute " + std::to_string(index));
+
+    // Overwrite the range in place, the buffer and the VAO setup are kept
+    updateBuffer(GL_ARRAY_BUFFER, vertexBuffers[index], offset, data, bytes);
+
+    checkGLError("Mesh::_updateAttribute end");
+}
+
+void Mesh::setAttribute(int index, const float *data, int size, int count) {
+    _uploadAttribute(index, GL_FLOAT, size, data, count);
+}
+
+void Mesh::setAttribute(int index, const int *data, int size, int count) {
+    _uploadAttribute(index, GL_INT, size, data, count);
+}
+
+void Mesh::updateAttributeRange(int index, int firstVertex, const float *data, int size, int count) {
+    _updateAttribute(index, firstVertex * size * sizeof(float), data, size * count * sizeof(float));
+}
+
+void Mesh::updateAttributeRange(int index, int firstVertex, const int *data, int size, int count) {
+    _updateAttribute(index, firstVertex * size * sizeof(int), data, size * count * sizeof(int));
+}
+
+
+void Mesh::_setVertices(const void *data, std::size_t bytes, Configure configure, ConfigureArray configureArray) {
+
+    if (interleavedBuffer)
+        glDeleteBuffers(1, &interleavedBuffer);
+    interleavedSize = bytes;
 
-    // Attach the buffer to our VAO at the desired index and enable it
-    glBindVertexArray(vao);
-    glVertexAttribPointer(index, N, std::is_same<T, float>::value ? GL_FLOAT : GL_INT, GL_TRUE, 0, 0);
-    glEnableVertexAttribArray(index);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Create a single vertex array buffer holding all the attributes,
+    // and let the vertex format attach every attribute to our VAO
+    if (hasDirectStateAccess()) {
+        interleavedBuffer = createNamedBuffer(data, bytes);
+        configureArray(vao, interleavedBuffer, 0);
+    } else {
+        glGenBuffers(1, &interleavedBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, interleavedBuffer);
+        glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
 
-    checkGLError("Mesh::_setAttribute end");
+        StateCache::bindVertexArray(vao);
+        configure(0);
+        StateCache::bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    checkGLError("Mesh::_setVertices end");
 }
 
-void Mesh::setAttribute(int index, Eigen::Matrix<float, 1, Eigen::Dynamic> data) {
-    _setAttribute(index, data);
+
+void Mesh::_setPositionVertices(const void *data, std::size_t bytes, Configure configure, ConfigureArray configureArray) {
+
+    if (positionBuffer)
+        glDeleteBuffers(1, &positionBuffer);
+    if (!positionVao)
+        positionVao = createVertexArray();
+    positionSize = bytes;
+
+    // The position-only VAO reads the same indices as the main one
+    if (hasDirectStateAccess()) {
+        positionBuffer = createNamedBuffer(data, bytes);
+        configureArray(positionVao, positionBuffer, 0);
+#ifdef GL_VERSION_4_5
+        glVertexArrayElementBuffer(positionVao, indexBuffer);
+#endif
+    } else {
+        glGenBuffers(1, &positionBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+        glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+
+        StateCache::bindVertexArray(positionVao);
+        configure(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        StateCache::bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    checkGLError("Mesh::_setPositionVertices end");
 }
 
-void Mesh::setAttribute(int index, Eigen::Matrix<float, 2, Eigen::Dynamic> data) {
-    _setAttribute(index, data);
+
+void Mesh::_updatePositionVertices(std::size_t offset, const void *data, std::size_t bytes) {
+
+    if (!positionBuffer)
+        throw std::out_of_range("Mesh::updatePositionVertices: no position-only vertices");
+    if (offset + bytes > positionSize)
+        throw std::out_of_range("Mesh::updatePositionVertices: range past the end of the vertices");
+
+    updateBuffer(GL_ARRAY_BUFFER, positionBuffer, offset, data, bytes);
+
+    checkGLError("Mesh::_updatePositionVertices end");
 }
 
-void Mesh::setAttribute(int index, Eigen::Matrix<float, 3, Eigen::Dynamic> data) {
-    _setAttribute(index, data);
+
+void Mesh::setStreamAttribute(int index, const StreamBuffer &buffer, GLintptr offset, GLenum type, int size) {
+
+    // The attribute no longer reads from a buffer of ours
+    if (index < vertexBuffers.size() && vertexBuffers[index]) {
+        glDeleteBuffers(1, &vertexBuffers[index]);
+        vertexBuffers[index] = 0;
+        vertexBufferSizes[index] = 0;
+    }
+
+    // Point the attribute at the range of the stream buffer
+    if (hasDirectStateAccess()) {
+        setArrayAttribute(vao, index, buffer.id(), offset, type, size, GL_FALSE);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.id());
+        StateCache::bindVertexArray(vao);
+        if (type == GL_FLOAT) {
+            glVertexAttribPointer(index, size, GL_FLOAT, GL_FALSE, 0, (const void *) offset);
+        } else {
+            glVertexAttribIPointer(index, size, type, 0, (const void *) offset);
+        }
+        glEnableVertexAttribArray(index);
+        StateCache::bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    checkGLError("Mesh::setStreamAttribute end");
 }
 
-void Mesh::setAttribute(int index, Eigen::Matrix<float, 4, Eigen::Dynamic> data) {
-    _setAttribute(index, data);
+
+void Mesh::setAttributeDivisor(int index, GLuint divisor) {
+    if (hasDirectStateAccess()) {
+        // the attribute reads through the binding point of the same index
+#ifdef GL_VERSION_4_5
+        glVertexArrayBindingDivisor(vao, index, divisor);
+#endif
+    } else {
+        StateCache::bindVertexArray(vao);
+        glVertexAttribDivisor(index, divisor);
+        StateCache::bindVertexArray(0);
+    }
+
+    checkGLError("Mesh::setAttributeDivisor end");
 }
 
-void Mesh::setAttribute(int index, Eigen::Matrix<int, 4, Eigen::Dynamic> data) {
-    _setAttribute(index, data);
+
+void Mesh::_setStreamVertices(const StreamBuffer &buffer, GLintptr offset, Configure configure, ConfigureArray configureArray) {
+
+    if (interleavedBuffer) {
+        glDeleteBuffers(1, &interleavedBuffer);
+        interleavedBuffer = 0;
+        interleavedSize = 0;
+    }
+
+    if (hasDirectStateAccess()) {
+        configureArray(vao, buffer.id(), offset);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.id());
+        StateCache::bindVertexArray(vao);
+        configure(offset);
+        StateCache::bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    checkGLError("Mesh::_setStreamVertices end");
 }
 
 
-void Mesh::setIndices(Eigen::VectorXi data, GLenum mode) {
+void Mesh::_updateVertices(std::size_t offset, const void *data, std::size_t bytes) {
+
+    if (!interleavedBuffer)
+        throw std::out_of_range("Mesh::updateVertices: no interleaved vertices");
+    if (offset + bytes > interleavedSize)
+        throw std::out_of_range("Mesh::updateVertices: range past the end of the vertices");
+
+    updateBuffer(GL_ARRAY_BUFFER, interleavedBuffer, offset, data, bytes);
+
+    checkGLError("Mesh::_updateVertices end");
+}
+
+
+void Mesh::setIndices(const IndexRef &data, GLenum mode) {
+    setIndices(data.data(), data.size(), mode);
+}
+
+void Mesh::setIndices(const int *data, int count, GLenum mode) {
 
     if (indexBuffer)
         glDeleteBuffers(1, &indexBuffer);
 
+    // Use 16-bit indices when they all fit, halving the size of the buffer
+    std::vector<GLushort> shortIndices;
+    const void *indices = data;
+    indexType = GL_UNSIGNED_INT;
+    if (count > 0 && *std::max_element(data, data + count) <= 0xFFFF) {
+        shortIndices.assign(data, data + count);
+        indices = shortIndices.data();
+        indexType = GL_UNSIGNED_SHORT;
+    }
+
     // Create an index buffer, attach it to the VAO, and copy the data into it
-    glGenBuffers(1, &indexBuffer);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.size() * sizeof(int),
-                 (const void *) data.data(), GL_STATIC_DRAW);
-    glBindVertexArray(0);
+    if (hasDirectStateAccess()) {
+        indexBuffer = createNamedBuffer(indices, count * indexSize());
+#ifdef GL_VERSION_4_5
+        glVertexArrayElementBuffer(vao, indexBuffer);
+        if (positionVao) {
+            glVertexArrayElementBuffer(positionVao, indexBuffer);
+        }
+#endif
+    } else {
+        glGenBuffers(1, &indexBuffer);
+        StateCache::bindVertexArray(vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * indexSize(), indices, GL_STATIC_DRAW);
+        if (positionVao) {
+            StateCache::bindVertexArray(positionVao);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        }
+        StateCache::bindVertexArray(0);
+    }
 
     // Remember the info that will be needed to draw this
     indexMode = mode;
-    indexLength = data.size();
+    indexLength = count;
 
     checkGLError("Mesh::setIndices");
 }
 
 
+void Mesh::updateIndices(int first, const IndexRef &data) {
+    updateIndices(first, data.data(), data.size());
+}
+
+void Mesh::updateIndices(int first, const int *data, int count) {
+
+    if (!indexBuffer)
+        throw std::out_of_range("Mesh::updateIndices: no indices");
+    if (first < 0 || first + count > indexLength)
+        throw std::out_of_range("Mesh::updateIndices: range past the end of the indices");
+
+    std::vector<GLushort> shortIndices;
+    const void *indices = data;
+    if (indexType == GL_UNSIGNED_SHORT) {
+        if (count > 0 && *std::max_element(data, data + count) > 0xFFFF)
+            throw std::out_of_range("Mesh::updateIndices: index does not fit the 16-bit index buffer");
+        shortIndices.assign(data, data + count);
+        indices = shortIndices.data();
+    }
+
+    // The element array binding is VAO state, so without direct state
+    // access go through the VAO
+    if (hasDirectStateAccess()) {
+        updateBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer, first * indexSize(), indices, count * indexSize());
+    } else {
+        StateCache::bindVertexArray(vao);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, first * indexSize(), count * indexSize(), indices);
+        StateCache::bindVertexArray(0);
+    }
+
+    checkGLError("Mesh::updateIndices");
+}
+
+
 void Mesh::drawElements() const {
 
     // Bind the VAO and draw
-    glBindVertexArray(vao);
-    glDrawElements(indexMode, indexLength, GL_UNSIGNED_INT, (void *) 0);
-    glBindVertexArray(0);
+    StateCache::bindVertexArray(vao);
+    glDrawElements(indexMode, indexLength, indexType, (void *) 0);
 
     checkGLError("Mesh::drawElements end");
 }
 
 
+void Mesh::drawElementsInstanced(int instanceCount) const {
+
+    // Bind the VAO and draw
+    StateCache::bindVertexArray(vao);
+    glDrawElementsInstanced(indexMode, indexLength, indexType, (void *) 0, instanceCount);
+
+    checkGLError("Mesh::drawElementsInstanced end");
+}
+
+
 void Mesh::drawArrays(GLenum mode, int first, int count) const {
 
     // Bind the VAO and draw
-    glBindVertexArray(vao);
+    StateCache::bindVertexArray(vao);
     glDrawArrays(mode, first, count);
-    glBindVertexArray(0);
 
     checkGLError("Mesh::drawArrays end");
 }
 
+
+
+void Mesh::bind() const {
+    StateCache::bindVertexArray(vao);
+}
+
+
+void Mesh::bindPositions() const {
+    if (!positionVao)
+        throw std::runtime_error("Mesh::bindPositions: no position-only vertices");
+    StateCache::bindVertexArray(positionVao);
+}
+
+
+void Mesh::unbind() {
+    StateCache::bindVertexArray(0);
+}
+
+
+void Mesh::drawElementsBaseVertex(int first, int count, int baseVertex) const {
+
+    // Draw from the bound VAO, the offset is in bytes into the index buffer
+    glDrawElementsBaseVertex(indexMode, count, indexType,
+                             (void *) (first * indexSize()), baseVertex);
+
+    checkGLError("Mesh::drawElementsBaseVertex end");
+}
+
+
+void Mesh::drawElementsInstancedBaseVertex(int first, int count, int baseVertex, int instanceCount) const {
+
+    // Draw from the bound VAO, the offset is in bytes into the index buffer
+    glDrawElementsInstancedBaseVertex(indexMode, count, indexType,
+                                      (void *) (first * indexSize()), instanceCount, baseVertex);
+
+    checkGLError("Mesh::drawElementsInstancedBaseVertex end");
+}
+
+
+void Mesh::multiDrawElementsIndirect(const StreamBuffer &commands, GLintptr offset, int drawCount) const {
+
+#ifdef GL_VERSION_4_3
+    // Draw from the bound VAO, every command reads its parameters from the indirect buffer
+    commands.bind();
+    glMultiDrawElementsIndirect(indexMode, indexType, (void *) offset, drawCount, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    checkGLError("Mesh::multiDrawElementsIndirect end");
+#else
+    throw std::runtime_error("Mesh::multiDrawElementsIndirect: built without OpenGL 4.3");
+#endif
+}
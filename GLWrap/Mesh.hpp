@@ -2,12 +2,29 @@
 
 #pragma once
 
+#include <type_traits>
+#include <vector>
+
+#include <Eigen/Core>
+
 #include <nanogui/opengl.h>
 
 #include "Util.hpp"
+#include "VertexFormat.hpp"
+#include "StreamBuffer.hpp"
 
 namespace GLWrap {
 
+// The parameters of one indexed draw read by glMultiDrawElementsIndirect,
+// laid out as OpenGL expects them in a GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint count;           // number of indices
+    GLuint instanceCount;   // number of instances
+    GLuint firstIndex;      // first index in the index buffer
+    GLint  baseVertex;      // added to each index before fetching vertices
+    GLuint baseInstance;    // first element read from the per-instance attributes
+};
+
 /*
  * A class to represent an Mesh stored in OpenGL.
  *
@@ -21,10 +38,20 @@ namespace GLWrap {
  *
  * The setup is deliberately limited in some ways:
  *  * 32-bit floats and 32-bit ints are the only supported datatypes
+ *    for attributes set one at a time
  *  * only scalar and vec[234] attribute types are supported
- *  * indexed meshes are always drawn in full
- *  * each attribute comes contiguously from a separate buffer
- *  * buffers are owned by meshes and will not be shared between them
+ *  * indexed meshes are always drawn in full, except through drawElementsBaseVertex
+ *    and the draw commands of multiDrawElementsIndirect
+ *  * indices are stored in 16 bits when they are all below 65536, in 32 bits otherwise
+ *  * each attribute comes contiguously from a separate buffer, unless the
+ *    mesh is given interleaved vertices in a VertexFormat (see setVertices)
+ *  * buffers are owned by meshes and will not be shared between them,
+ *    except stream buffers (see setStreamAttribute), which the caller owns
+ *  * a mesh may hold a second, position-only copy of its vertices with a
+ *    VAO of its own sharing the index buffer, for the passes that only
+ *    write depth (see setPositionVertices)
+ *  * with OpenGL 4.5 the VAOs and buffers are created and filled through
+ *    direct state access, without binding them (see hasDirectStateAccess)
  *
  * This class does not keep track of names for attributes.  Instead
  * each attribute array is bound to a fixed index; the expectation is
@@ -49,44 +76,251 @@ public:
     Mesh(Mesh &&other) noexcept;
     Mesh &operator=(Mesh &&other);
 
+    // A view of index data
+    typedef Eigen::Ref<const Eigen::VectorXi> IndexRef;
+
     // Provide values for the vertex attribute at a particular index:
     //  1. Create an OpenGL buffer owned by this mesh
     //  2. Upload the provided data to that buffer
     //  3. Configure the VAO with an enabled attribute array at the
     //     given index that reads from this buffer.
     // Any buffer previously bound at this index is deleted.
-    // The dimension of the vector type of the attribute is determined by
-    // the argument type.
-    void setAttribute(int index, Eigen::Matrix<float, 1, Eigen::Dynamic> data);
-    void setAttribute(int index, Eigen::Matrix<float, 2, Eigen::Dynamic> data);
-    void setAttribute(int index, Eigen::Matrix<float, 3, Eigen::Dynamic> data);
-    void setAttribute(int index, Eigen::Matrix<float, 4, Eigen::Dynamic> data);
-    void setAttribute(int index, Eigen::Matrix<int, 4, Eigen::Dynamic> data);
+    // The dimension of the vector type of the attribute is the number of
+    // rows of the argument, which holds one column per vertex.  The data is
+    // uploaded straight from the caller's storage; only expressions whose
+    // columns are not contiguous in memory are evaluated into a copy first.
+    template <class Derived>
+    void setAttribute(int index, const Eigen::MatrixBase<Derived> &data) {
+        typedef typename Derived::Scalar T;
+        const int N = Derived::RowsAtCompileTime;
+        _checkAttributeType<T, N>();
+        const AttributeRef<T, N> view(data);
+        if (N > 1 && view.outerStride() != N) {
+            const Eigen::Matrix<T, N, Eigen::Dynamic> packed = view;
+            _uploadAttribute(index, GLTypeOf<T>::value, N, packed.data(), packed.cols());
+        } else {
+            _uploadAttribute(index, GLTypeOf<T>::value, N, view.data(), view.cols());
+        }
+    }
+
+    // Same as above, from count vertices of size (1 to 4) components each
+    void setAttribute(int index, const float *data, int size, int count);
+    void setAttribute(int index, const int *data, int size, int count);
+
+    // Overwrite the values of the vertices starting at firstVertex in the
+    // buffer of an attribute set earlier, using glBufferSubData.  The buffer
+    // is kept, so only the changed range is transferred.
+    // @throws std::out_of_range if the range is not inside the buffer.
+    template <class Derived>
+    void updateAttributeRange(int index, int firstVertex, const Eigen::MatrixBase<Derived> &data) {
+        typedef typename Derived::Scalar T;
+        const int N = Derived::RowsAtCompileTime;
+        _checkAttributeType<T, N>();
+        const AttributeRef<T, N> view(data);
+        if (N > 1 && view.outerStride() != N) {
+            const Eigen::Matrix<T, N, Eigen::Dynamic> packed = view;
+            _updateAttribute(index, firstVertex * sizeof(T) * N, packed.data(), packed.size() * sizeof(T));
+        } else {
+            _updateAttribute(index, firstVertex * sizeof(T) * N, view.data(), view.size() * sizeof(T));
+        }
+    }
+
+    // Same as above, from count vertices of size components each
+    void updateAttributeRange(int index, int firstVertex, const float *data, int size, int count);
+    void updateAttributeRange(int index, int firstVertex, const int *data, int size, int count);
+
+    // Provide interleaved vertex data laid out according to the vertex format F:
+    //  1. Create a single OpenGL buffer owned by this mesh
+    //  2. Upload the packed vertices to that buffer
+    //  3. Configure the VAO with every attribute of the format, reading
+    //     from this buffer with the format's stride and offsets.
+    // Any interleaved buffer previously set is deleted.
+    // The data is expected to be built with F::resize and F::pack.
+    template <class F>
+    void setVertices(const std::vector<unsigned char> &data) {
+        _setVertices(data.data(), data.size(), &F::configure, &F::configureArray);
+    }
+
+    // Same as above, from count vertices of format F
+    template <class F>
+    void setVertices(const void *data, int count) {
+        _setVertices(data, count * F::stride, &F::configure, &F::configureArray);
+    }
+
+    // Overwrite the vertices starting at firstVertex in the interleaved buffer
+    // with vertices of format F, which must be the format it was set with.
+    // @throws std::out_of_range if the range is not inside the buffer.
+    template <class F>
+    void updateVertices(int firstVertex, const std::vector<unsigned char> &data) {
+        _updateVertices(firstVertex * F::stride, data.data(), data.size());
+    }
+
+    template <class F>
+    void updateVertices(int firstVertex, const void *data, int count) {
+        _updateVertices(firstVertex * F::stride, data, count * F::stride);
+    }
+
+    // Provide a tightly packed copy of the vertex positions alone, in a
+    // vertex format F holding only the position, for the passes that only
+    // write depth.  It is read through a second VAO, which shares the index
+    // buffer of the mesh and is bound with bindPositions() instead of bind().
+    // Any position-only buffer previously set is deleted.
+    template <class F>
+    void setPositionVertices(const std::vector<unsigned char> &data) {
+        _setPositionVertices(data.data(), data.size(), &F::configure, &F::configureArray);
+    }
+
+    // Overwrite the position-only vertices starting at firstVertex, which
+    // must be of the format they were set with.
+    // @throws std::out_of_range if the range is not inside the buffer.
+    template <class F>
+    void updatePositionVertices(int firstVertex, const std::vector<unsigned char> &data) {
+        _updatePositionVertices(firstVertex * F::stride, data.data(), data.size());
+    }
+
+    // Read the vertex attribute at a particular index from a stream buffer
+    // instead of a buffer owned by this mesh, starting at the given byte
+    // offset with size components of the given type (GL_FLOAT, or GL_INT for
+    // GLSL ivecN inputs) per vertex.  The stream buffer is not owned by the
+    // mesh; call this again after every write, with the offset returned by
+    // StreamBuffer::write or StreamBuffer::allocate.
+    // Any buffer previously owned at this index is deleted.
+    void setStreamAttribute(int index, const StreamBuffer &buffer, GLintptr offset, GLenum type, int size);
+
+    // Read interleaved vertices of format F from a stream buffer, starting at
+    // the given byte offset, in the same way as setStreamAttribute.
+    // Any interleaved buffer previously owned is deleted.
+    template <class F>
+    void setStreamVertices(const StreamBuffer &buffer, GLintptr offset) {
+        _setStreamVertices(buffer, offset, &F::configure, &F::configureArray);
+    }
+
+    // Make the vertex attribute at a particular index advance once per divisor
+    // instances instead of once per vertex, turning it into per-instance data
+    // for the instanced draws (0 restores per-vertex data).
+    void setAttributeDivisor(int index, GLuint divisor);
+
+    // Read per-instance attributes of format F from a stream buffer, starting
+    // at the given byte offset: instance i of the next instanced draw reads
+    // the i-th element of format F.  The mesh must be bound with bind() (or
+    // bindPositions()) first, so that several instanced draws can repoint their instance data without
+    // rebinding the VAO.
+    template <class F>
+    void setInstanceVertices(const StreamBuffer &buffer, GLintptr offset) const {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.id());
+        F::configure(offset);
+        F::setDivisor(1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
     // Provide indices that define primitives, 
     // and the drawing mode (GL_TRIANGLES, etc.) that will be used by drawElements.
-    void setIndices(Eigen::VectorXi data, GLenum mode);
+    // The index buffer uses GL_UNSIGNED_SHORT if every index fits in 16 bits
+    // (fewer than 65536 vertices are referenced), GL_UNSIGNED_INT otherwise.
+    void setIndices(const IndexRef &data, GLenum mode);
+    void setIndices(const int *data, int count, GLenum mode);
+
+    // Overwrite the indices starting at first in the index buffer
+    // @throws std::out_of_range if the range is not inside the buffer,
+    //   or if an index does not fit a 16-bit index buffer.
+    void updateIndices(int first, const IndexRef &data);
+    void updateIndices(int first, const int *data, int count);
 
-    // Draw the entire mesh using glDrawElements (using index buffer)
+    // Draw the entire mesh using glDrawElements (using index buffer).
+    // The draw calls leave the VAO bound (see StateCache), so drawing the
+    // same mesh again does not bind it again.
     void drawElements() const;
 
+    // Draw instanceCount instances of the entire mesh using glDrawElementsInstanced
+    void drawElementsInstanced(int instanceCount) const;
+
     // Draw the mesh using glDrawArrays (using just the attribute buffers)
     void drawArrays(GLuint mode, int first, int count) const;
 
+    // Bind the VAO of this mesh, so that several draws from it share one bind
+    void bind() const;
+
+    // Bind the position-only VAO instead (see setPositionVertices).  The
+    // draws that need a bound mesh then read the positions alone.
+    // @throws std::runtime_error if no position-only vertices were set.
+    void bindPositions() const;
+
+    // Unbind any bound VAO
+    static void unbind();
+
+    // Draw count indices starting at index first, adding baseVertex to each
+    // index before fetching vertices (glDrawElementsBaseVertex).
+    // This lets many meshes share the buffers of one Mesh.
+    // The mesh must be bound with bind() first.
+    void drawElementsBaseVertex(int first, int count, int baseVertex) const;
+
+    // Same as drawElementsBaseVertex, drawing instanceCount instances
+    // (glDrawElementsInstancedBaseVertex).  The mesh must be bound with bind() first.
+    void drawElementsInstancedBaseVertex(int first, int count, int baseVertex, int instanceCount) const;
+
+    // Issue drawCount draws in one call to glMultiDrawElementsIndirect, reading
+    // their DrawElementsIndirectCommand parameters from a stream buffer created
+    // for GL_DRAW_INDIRECT_BUFFER, starting at the given byte offset.
+    // This needs OpenGL 4.3 (see hasGLVersion); where it is missing, draw each
+    // command with drawElementsInstancedBaseVertex instead.
+    // The mesh must be bound with bind() first.
+    // @throws std::runtime_error if OpenGL 4.3 was not available at compile time.
+    void multiDrawElementsIndirect(const StreamBuffer &commands, GLintptr offset, int drawCount) const;
+
 private:
 
-    // Template to simplify writing the various setAttribute functions
-    template<class T, int N>
-    void _setAttribute(int index, Eigen::Matrix<T, N, Eigen::Dynamic> data);
+    // Views of attribute data that bind to matrices and blocks without copying
+    template <class T, int N>
+    using AttributeRef = Eigen::Ref<const Eigen::Matrix<T, N, Eigen::Dynamic>>;
+
+    // 32-bit floats and 32-bit ints, scalar and vec[234], are the supported attribute types
+    template <class T, int N>
+    static void _checkAttributeType() {
+        static_assert(std::is_same<T, float>::value || std::is_same<T, int>::value,
+                      "attributes are 32-bit floats or ints");
+        static_assert(N >= 1 && N <= 4, "attributes have 1 to 4 components, one column per vertex");
+    }
+
+    // Upload count vertices of size components of the given type to the buffer of an attribute
+    void _uploadAttribute(int index, GLenum type, int size, const void *data, int count);
+    void _updateAttribute(int index, std::size_t offset, const void *data, std::size_t bytes);
+
+    // Upload an interleaved vertex buffer and set up the VAO with the given function
+    // A vertex format sets up the bound VAO from the bound array buffer
+    // (configure), or a given VAO from a given buffer (configureArray)
+    typedef void (*Configure)(std::size_t);
+    typedef void (*ConfigureArray)(GLuint, GLuint, std::size_t);
+
+    void _setVertices(const void *data, std::size_t bytes, Configure configure, ConfigureArray configureArray);
+    void _setStreamVertices(const StreamBuffer &buffer, GLintptr offset, Configure configure, ConfigureArray configureArray);
+    void _updateVertices(std::size_t offset, const void *data, std::size_t bytes);
+
+    // Upload the position-only buffer and set up its VAO with the given function
+    void _setPositionVertices(const void *data, std::size_t bytes, Configure configure, ConfigureArray configureArray);
+    void _updatePositionVertices(std::size_t offset, const void *data, std::size_t bytes);
 
     // OpenGL identifiers for the owned resources
     GLuint vao;
     GLuint indexBuffer;
+    GLuint interleavedBuffer;
     std::vector<GLuint> vertexBuffers;
 
-    // Mode and length of index buffer
+    // The position-only VAO and buffer, zero until setPositionVertices
+    GLuint positionVao;
+    GLuint positionBuffer;
+    std::size_t positionSize;
+
+    // Sizes in bytes of the owned buffers, to check range updates
+    std::vector<std::size_t> vertexBufferSizes;
+    std::size_t interleavedSize;
+
+    // Mode, length and type (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT) of index buffer
     GLenum indexMode;
     GLuint indexLength;
+    GLenum indexType;
+
+    // Size in bytes of one index of the index buffer
+    std::size_t indexSize() const { return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
 };
 
 } // namespace
@@ -1,7 +1,10 @@
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
 
 #include "Program.hpp"
 #include "Shader.hpp"
+#include "StateCache.hpp"
 
 using namespace GLWrap;
 
@@ -11,7 +14,8 @@ Program::Program(std::string name)
     program = glCreateProgram();
 }
 
-Program::Program(std::string name, std::vector<std::pair<GLenum, std::string>> specs) 
+Program::Program(std::string name, std::vector<std::pair<GLenum, std::string>> specs,
+    const std::vector<std::string> &defines) 
 : name(name) {
     program = glCreateProgram();
 
@@ -19,7 +23,7 @@ Program::Program(std::string name, std::vector<std::pair<GLenum, std::string>> s
         GLenum shaderType = p.first;
         std::string filename = p.second;
         Shader s = Shader(shaderType, filename);
-        s.source(filename);
+        s.source(filename, defines);
         attach(s);
         ownedShaders.emplace_back(std::move(s));
     }
@@ -28,11 +32,13 @@ Program::Program(std::string name, std::vector<std::pair<GLenum, std::string>> s
 }
 
 Program::~Program() {
+    StateCache::deletedProgram(program);
     glDeleteProgram(program);
 }
 
 // Move-constructing a Program leaves the other Program empty
-Program::Program(Program &&other) {
+Program::Program(Program &&other) 
+: name(std::move(other.name)), uniforms(std::move(other.uniforms)) {
 
     program = other.program;
     other.program = 0;
@@ -41,10 +47,12 @@ Program::Program(Program &&other) {
 // Move-assigning a Program deletes any owned program and shaders
 // and leaves the other Program empty
 Program &Program::operator =(Program &&other) {
+    StateCache::deletedProgram(program);
     glDeleteProgram(program);
     program = other.program;
     other.program = 0;
     ownedShaders = std::move(other.ownedShaders);
+    uniforms = std::move(other.uniforms);
     return *this;
 }
 
@@ -57,6 +65,12 @@ void Program::detach(const Shader &s) {
 }
 
 void Program::link() {
+#ifdef GL_VERSION_4_1
+    // Keep the binary available to getBinary()
+    if (hasGLVersion(4, 1)) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+#endif
     glLinkProgram(program);
     int status;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
@@ -67,95 +81,204 @@ void Program::link() {
         std::cerr << infoLog << std::endl;
         std::exit(1);
     }    
+
+    readUniforms();
+}
+
+bool Program::loadBinary(GLenum format, const std::vector<char> &binary) {
+#ifdef GL_VERSION_4_1
+    if (!hasGLVersion(4, 1) || binary.empty()) return false;
+
+    glProgramBinary(program, format, binary.data(), binary.size());
+    int status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        // Discard the error of a rejected binary
+        glGetError();
+        return false;
+    }
+
+    readUniforms();
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Program::getBinary(GLenum &format, std::vector<char> &binary) const {
+#ifdef GL_VERSION_4_1
+    if (!hasGLVersion(4, 1)) return false;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return false;
+
+    binary.resize(length);
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    binary.resize(written);
+    return written > 0;
+#else
+    return false;
+#endif
+}
+
+// Read the locations of the active uniforms once
+void Program::readUniforms() {
+    uniforms.clear();
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> buffer(std::max(maxLength, 1));
+    for (GLint u = 0; u < count; u++) {
+        GLint size;
+        GLenum type;
+        GLsizei length;
+        glGetActiveUniform(program, u, buffer.size(), &length, &size, &type, buffer.data());
+        std::string uniformName(buffer.data(), length);
+
+        // uniforms in blocks have no location
+        int loc = glGetUniformLocation(program, uniformName.c_str());
+        if (loc == -1) continue;
+        addUniform(uniformName, loc);
+
+        // arrays are reported by their first element, name[0]
+        const std::string first = "[0]";
+        if (uniformName.size() > first.size() &&
+            uniformName.compare(uniformName.size() - first.size(), first.size(), first) == 0) {
+            std::string base = uniformName.substr(0, uniformName.size() - first.size());
+            addUniform(base, loc);
+            for (int e = 1; e < size; e++) {
+                std::string element = base + "[" + std::to_string(e) + "]";
+                addUniform(element, glGetUniformLocation(program, element.c_str()));
+            }
+        }
+    }
 }
 
-static int getUniformLocationWithWarning(GLuint program, const std::string &progName, const std::string &varName) {
-    int loc = glGetUniformLocation(program, varName.c_str());
-    if (loc == -1) {
-        std::cerr << "Warning: '" << varName 
-            << "' is not an active uniform in program '" << progName 
-            << "'." << std::endl;
+// Add a uniform to the table of locations
+void Program::addUniform(const std::string &uniformName, int location) {
+    std::uint64_t hash = hashUniformName(uniformName.c_str());
+    auto it = uniforms.find(hash);
+    if (it != uniforms.end() && it->second.name != uniformName) {
+        throw std::runtime_error("Program '" + name + "': uniforms '" + it->second.name
+            + "' and '" + uniformName + "' have the same hash");
     }
-    return loc;
+    uniforms[hash] = UniformInfo { location, uniformName };
 }
 
-void Program::uniform(const std::string &varName, int i) {
-    int loc = getUniformLocationWithWarning(program, name, varName);
+// Look up the location of a uniform, warning once if it is not active
+int Program::location(const UniformHandle &varName) {
+    auto it = uniforms.find(varName.hash);
+    if (it != uniforms.end()) {
+        return it->second.location;
+    }
+    std::cerr << "Warning: '" << varName.name
+        << "' is not an active uniform in program '" << name
+        << "'." << std::endl;
+    uniforms[varName.hash] = UniformInfo { -1, varName.name };
+    return -1;
+}
+
+// Make the program active for setting uniforms, unless it already is
+void Program::bind() {
+    StateCache::useProgram(program);
+}
+
+void Program::uniform(const UniformHandle &varName, int i) {
+    int loc = location(varName);
     if (loc != -1) {
-        glUseProgram(program);
+        bind();
         glUniform1i(loc, i);
     }
 }
 
-void Program::uniform(const std::string &varName, float f) {
-    int loc = getUniformLocationWithWarning(program, name, varName);
+void Program::uniform(const UniformHandle &varName, float f) {
+    int loc = location(varName);
     if (loc != -1) {
-        glUseProgram(program);
+        bind();
         glUniform1f(loc, f);
     }
 }
 
-void Program::uniform(const std::string &varName, const Eigen::Vector2f &v) {
-    int loc = getUniformLocationWithWarning(program, name, varName);
+void Program::uniform(const UniformHandle &varName, const Eigen::Vector2f &v) {
+    int loc = location(varName);
     if (loc != -1) {
-        glUseProgram(program);
+        bind();
         glUniform2fv(loc, 1, v.data());
     }
 }
 
-void Program::uniform(const std::string &varName, const Eigen::Vector3f &v) {
-    int loc = getUniformLocationWithWarning(program, name, varName);
+void Program::uniform(const UniformHandle &varName, const Eigen::Vector3f &v) {
+    int loc = location(varName);
     if (loc != -1) {
-        glUseProgram(program);
+        bind();
         glUniform3fv(loc, 1, v.data());
     }
 }
 
-void Program::uniform(const std::string &varName, const Eigen::Vector4f &v) {
-    int loc = getUniformLocationWithWarning(program, name, varName);
+void Program::uniform(const UniformHandle &varName, const Eigen::Vector4f &v) {
+    int loc = location(varName);
     if (loc != -1) {
-        glUseProgram(program);
+        bind();
         glUniform4fv(loc, 1, v.data());
     }
 }
 
-void Program::uniform(const std::string &varName, const Eigen::Matrix2f &m) {
-    int loc = getUniformLocationWithWarning(program, name, varName);
+void Program::uniform(const UniformHandle &varName, const Eigen::Matrix2f &m) {
+    int loc = location(varName);
     if (loc != -1) {
-        glUseProgram(program);
+        bind();
         glUniformMatrix2fv(loc, 1, false, m.data());
     }
 }
 
-void Program::uniform(const std::string &varName, const Eigen::Matrix3f &m) {
-    int loc = getUniformLocationWithWarning(program, name, varName);
+void Program::uniform(const UniformHandle &varName, const Eigen::Matrix3f &m) {
+    int loc = location(varName);
     if (loc != -1) {
-        glUseProgram(program);
+        bind();
         glUniformMatrix3fv(loc, 1, false, m.data());
     }
 }
 
-void Program::uniform(const std::string &varName, const Eigen::Matrix4f &m) {
-    int loc = getUniformLocationWithWarning(program, name, varName);
+void Program::uniform(const UniformHandle &varName, const Eigen::Matrix4f &m) {
+    int loc = location(varName);
     if (loc != -1) {
-        glUseProgram(program);
+        bind();
         glUniformMatrix4fv(loc, 1, false, m.data());
     }
 }
 
+void Program::uniform(const UniformHandle &varName, const Eigen::Matrix4f *m, int count) {
+    int loc = location(varName);
+    if (loc != -1 && count > 0) {
+        bind();
+        glUniformMatrix4fv(loc, count, false, m[0].data());
+    }
+}
+
 int Program::getAttribLocation(const std::string &name) {
     return glGetAttribLocation(program, name.c_str());
 }
 
-int Program::getUniformLocation(const std::string &name) {
-    return glGetUniformLocation(program, name.c_str());
+int Program::getUniformLocation(const UniformHandle &varName) {
+    auto it = uniforms.find(varName.hash);
+    return it == uniforms.end() ? -1 : it->second.location;
+}
+
+void Program::uniformBlock(const std::string &blockName, GLuint binding) {
+    GLuint index = glGetUniformBlockIndex(program, blockName.c_str());
+    if (index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, index, binding);
+    }
+    checkGLError("Program::uniformBlock end");
 }
 
 
 void Program::use() {
-    glUseProgram(program);
+    StateCache::useProgram(program);
 }
 
 void Program::unuse() {
-    glUseProgram(0);
+    StateCache::useProgram(0);
 }
@@ -2,6 +2,11 @@
 
 #pragma once
 
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 
@@ -13,11 +18,40 @@ namespace GLWrap {
 
 class Shader;
 
+// 64-bit FNV-1a hash of a uniform name, usable at compile time
+constexpr std::uint64_t hashUniformName(const char *s, std::uint64_t h = 14695981039346656037ull) {
+    return *s ? hashUniformName(s + 1, (h ^ (std::uint64_t) (unsigned char) *s) * 1099511628211ull) : h;
+}
+
+/*
+ * The name of a uniform variable, hashed once.  Programs find the location
+ * of a uniform by this hash, without comparing strings or asking the driver.
+ *
+ * A handle is made implicitly from a string where a uniform name is
+ * expected.  On hot paths, make it once from a literal at compile time:
+ *     static constexpr GLWrap::UniformHandle mV("mV");
+ *     prog.uniform(mV, viewMatrix);
+ * The name is kept only for warnings and must outlive the handle.
+ */
+class UniformHandle {
+public:
+    constexpr UniformHandle(const char *name) : name(name), hash(hashUniformName(name)) {}
+    UniformHandle(const std::string &name) : name(name.c_str()), hash(hashUniformName(name.c_str())) {}
+
+    const char *name;
+    std::uint64_t hash;
+};
+
 /*
  * A class to represent an OpenGL shader program.
  *
  * This class is a thin wrapper over the underlying API; it owns an
  * OpenGL program object whose lifetime matches this object.
+ *
+ * Linking reads the active uniforms of the program into a table from the
+ * hash of their names (see UniformHandle) to their locations, so setting a
+ * uniform is a table lookup and a glUniform call.  The elements of uniform
+ * arrays are in the table as name[i], and the array as its bare name.
  */
 class GLWRAP_EXPORT Program {
 public:
@@ -30,7 +64,10 @@ public:
     // Each pair gives the type and source code pathname of one shader in the program.
     // This is a convenience constructor equivalent to creating separate Shader instances,
     // attaching them to a program, and linking the program.
-    Program(std::string name, std::vector<std::pair<GLenum, std::string>>);
+    // The defines are passed to every shader (see Shader::source), to build a
+    // variant of the program.
+    Program(std::string name, std::vector<std::pair<GLenum, std::string>>,
+        const std::vector<std::string> &defines = {});
 
     // Deletes the OpenGL shader program
     ~Program();
@@ -51,30 +88,53 @@ public:
 
     // Link this program.  Call this after attaching all shaders needed.
     // If linking fails, prints a diagnostic message and exits.
+    // @throws std::runtime_error if two active uniforms have the same hash.
     void link();
 
+    // Restore this program from a binary returned by getBinary(), instead of
+    // attaching shaders and linking.  Returns false if the driver rejects the
+    // binary (e.g. after a driver update), and the program must be built
+    // from source.  Always false without OpenGL 4.1.
+    // @throws std::runtime_error if two active uniforms have the same hash.
+    bool loadBinary(GLenum format, const std::vector<char> &binary);
+
+    // Get the binary of this linked program, in a driver specific format.
+    // Returns false if the driver provides none or without OpenGL 4.1.
+    bool getBinary(GLenum &format, std::vector<char> &binary) const;
+
     // Set the value of the uniform variable in this program with the given name.
     // The OpenGL type passed to the uniform is determined by overloading among
     // this set of functions.  If the variable does not exist or is inactive,
-    // a warning is printed and nothing else happens.
-    void uniform(const std::string &name, int);
-    void uniform(const std::string &name, float);
-    void uniform(const std::string &name, const Eigen::Vector2f &);  // GLSL type vec2
-    void uniform(const std::string &name, const Eigen::Vector3f &);  // GLSL type vec3
-    void uniform(const std::string &name, const Eigen::Vector4f &);  // GLSL type vec4
-    void uniform(const std::string &name, const Eigen::Matrix2f &);  // GLSL type mat2
-    void uniform(const std::string &name, const Eigen::Matrix3f &);  // GLSL type mat3
-    void uniform(const std::string &name, const Eigen::Matrix4f &);  // GLSL type mat4
+    // a warning is printed the first time and nothing else happens.
+    // The program is made active first unless it already is (see use()).
+    void uniform(const UniformHandle &name, int);
+    void uniform(const UniformHandle &name, float);
+    void uniform(const UniformHandle &name, const Eigen::Vector2f &);  // GLSL type vec2
+    void uniform(const UniformHandle &name, const Eigen::Vector3f &);  // GLSL type vec3
+    void uniform(const UniformHandle &name, const Eigen::Vector4f &);  // GLSL type vec4
+    void uniform(const UniformHandle &name, const Eigen::Matrix2f &);  // GLSL type mat2
+    void uniform(const UniformHandle &name, const Eigen::Matrix3f &);  // GLSL type mat3
+    void uniform(const UniformHandle &name, const Eigen::Matrix4f &);  // GLSL type mat4
+
+    // Set count consecutive elements of a uniform array from its first one,
+    // in one call.  name is the array, or the element to start from.
+    void uniform(const UniformHandle &name, const Eigen::Matrix4f *, int count);  // GLSL type mat4[]
 
     // Find the location in the linked program of a uniform by name
     // -1 means there is no active uniform with that name
-    int getUniformLocation(const std::string &name);
+    int getUniformLocation(const UniformHandle &name);
+
+    // Connect the uniform block with the given name to a binding point of
+    // GL_UNIFORM_BUFFER.  Nothing happens if the program has no such active block.
+    void uniformBlock(const std::string &blockName, GLuint binding);
 
     // Find the location in the linked program of an attribute by name
     // -1 means there is no active attribute with that name
     int getAttribLocation(const std::string &name);
 
     // Make this program the active program.
+    // Programs made active by calling glUseProgram directly must be
+    // followed by StateCache::invalidate() before setting uniforms.
     void use();
 
     // Make no program active.
@@ -88,9 +148,21 @@ public:
 
 private:
 
+    // An active uniform, or a name reported as inactive (location -1)
+    struct UniformInfo {
+        int location;
+        std::string name;
+    };
+
     std::string name;
     GLuint program;
     std::vector<Shader> ownedShaders;
+    std::unordered_map<std::uint64_t, UniformInfo> uniforms;
+
+    void readUniforms();
+    void addUniform(const std::string &uniformName, int location);
+    int location(const UniformHandle &name);
+    void bind();
 };
 
 } // namespace
\ No newline at end of file
@@ -0,0 +1,125 @@
+// ProgramCache.cpp
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#endif
+
+#include "ProgramCache.hpp"
+
+using namespace GLWrap;
+
+
+// 64-bit FNV-1a hash of bytes, continuing from h
+static std::uint64_t hashBytes(const void *data, std::size_t bytes, std::uint64_t h = 14695981039346656037ull) {
+    const unsigned char *p = (const unsigned char *) data;
+    for (std::size_t i = 0; i < bytes; i++) {
+        h = (h ^ p[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+static std::uint64_t hashString(const std::string &s, std::uint64_t h) {
+    // hash the length too, so that consecutive strings cannot run into each other
+    std::uint64_t length = s.size();
+    return hashBytes(s.data(), s.size(), hashBytes(&length, sizeof(length), h));
+}
+
+// Contents of a file, empty if it cannot be read
+static std::string readFile(const std::string &filename) {
+    std::ifstream ifs(filename, std::ios::binary);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+
+ProgramCache::ProgramCache(const std::string &directory) :
+    directory(directory), driverHash(14695981039346656037ull), reused(0), loaded(0), built(0) {
+
+    const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (GLenum s : strings) {
+        const char *value = (const char *) glGetString(s);
+        driverHash = hashString(value ? value : "", driverHash);
+    }
+
+    if (!directory.empty()) {
+#if defined(_WIN32)
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+}
+
+std::shared_ptr<Program> ProgramCache::get(const std::string &name, const std::vector<std::pair<GLenum, std::string>> &specs,
+    const std::vector<std::string> &defines) {
+    std::uint64_t key = driverHash;
+    for (const auto &p : specs) {
+        key = hashBytes(&p.first, sizeof(p.first), key);
+        key = hashString(readFile(p.second), key);
+    }
+    for (const std::string &d : defines) {
+        key = hashString(d, key);
+    }
+
+    auto it = programs.find(key);
+    if (it != programs.end()) {
+        reused++;
+        return it->second;
+    }
+
+    GLenum format;
+    std::vector<char> binary;
+    if (readBinary(key, format, binary)) {
+        std::shared_ptr<Program> prog = std::make_shared<Program>(name);
+        if (prog->loadBinary(format, binary)) {
+            loaded++;
+            programs[key] = prog;
+            return prog;
+        }
+    }
+
+    std::shared_ptr<Program> prog = std::make_shared<Program>(name, specs, defines);
+    built++;
+    programs[key] = prog;
+    if (prog->getBinary(format, binary)) {
+        writeBinary(key, format, binary);
+    }
+    return prog;
+}
+
+std::string ProgramCache::binaryPath(std::uint64_t key) const {
+    char file[32];
+    std::snprintf(file, sizeof(file), "%016llx.bin", (unsigned long long) key);
+    return directory + "/" + file;
+}
+
+// A binary file holds the format of the binary followed by the binary
+bool ProgramCache::readBinary(std::uint64_t key, GLenum &format, std::vector<char> &binary) const {
+    if (directory.empty()) return false;
+
+    std::ifstream ifs(binaryPath(key), std::ios::binary);
+    std::uint32_t f;
+    if (!ifs.read((char *) &f, sizeof(f))) return false;
+    format = f;
+    binary.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    return !binary.empty();
+}
+
+void ProgramCache::writeBinary(std::uint64_t key, GLenum format, const std::vector<char> &binary) const {
+    if (directory.empty()) return;
+
+    std::ofstream ofs(binaryPath(key), std::ios::binary);
+    std::uint32_t f = format;
+    ofs.write((const char *) &f, sizeof(f));
+    ofs.write(binary.data(), binary.size());
+    if (!ofs) {
+        std::cerr << "Warning: could not write the program binary " << binaryPath(key) << std::endl;
+    }
+}
@@ -0,0 +1,74 @@
+// ProgramCache.hpp
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <nanogui/opengl.h>
+
+#include "Program.hpp"
+#include "Util.hpp"
+
+namespace GLWrap {
+
+/*
+ * A cache of linked shader programs, so that a program is built from
+ * source once and not again every time it is asked for.
+ *
+ * A program is identified by the hash of its shader types and sources, of
+ * the defines of its variant, and of the strings of the OpenGL driver
+ * (vendor, renderer and version).  Each variant is built the first time it
+ * is asked for.
+ * Programs built during this run are kept in memory and handed out again
+ * as they are.  With OpenGL 4.1, the binary of every program built from
+ * source is also written to the cache directory, and read back instead of
+ * compiling on the next run.  Editing a shader or updating the driver
+ * changes the hash; binaries the driver rejects are rebuilt from source.
+ *
+ * Use:
+ *     ProgramCache cache("programcache");
+ *     std::shared_ptr<Program> prog = cache.get("name", {
+ *         { GL_VERTEX_SHADER, "shader.vs" }, { GL_FRAGMENT_SHADER, "shader.fs" } });
+ */
+class GLWRAP_EXPORT ProgramCache {
+public:
+
+    // Create a cache storing binaries in the given directory, which is
+    // created if needed.  An empty directory keeps the programs in memory only.
+    ProgramCache(const std::string &directory);
+
+    // Copying is not allowed because the cache owns its programs
+    ProgramCache(const ProgramCache &) = delete;
+    ProgramCache &operator=(const ProgramCache &) = delete;
+
+    // The program made of the given shaders with the given defines, as in the
+    // Program constructor: from memory, from its binary on disk, or compiled
+    // and linked.
+    std::shared_ptr<Program> get(const std::string &name, const std::vector<std::pair<GLenum, std::string>> &specs,
+        const std::vector<std::string> &defines = {});
+
+    // Number of programs found in memory, loaded from disk and built from
+    // source since the last resetStats()
+    int numReused() const { return reused; }
+    int numLoaded() const { return loaded; }
+    int numBuilt() const { return built; }
+    void resetStats() { reused = loaded = built = 0; }
+
+private:
+
+    std::string directory;
+    std::uint64_t driverHash;
+    std::unordered_map<std::uint64_t, std::shared_ptr<Program>> programs;
+    int reused, loaded, built;
+
+    std::string binaryPath(std::uint64_t key) const;
+    bool readBinary(std::uint64_t key, GLenum &format, std::vector<char> &binary) const;
+    void writeBinary(std::uint64_t key, GLenum format, const std::vector<char> &binary) const;
+};
+
+} // namespace
@@ -0,0 +1,155 @@
+// RenderTargetPool.cpp
+
+#include "RenderTargetPool.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+using namespace GLWrap;
+
+
+// Estimated bytes per texel of an internal format
+static std::size_t texelBytes(GLenum internalFormat) {
+    switch (internalFormat) {
+    case GL_R8:
+        return 1;
+    case GL_RG8:
+    case GL_R16F:
+    case GL_DEPTH_COMPONENT16:
+        return 2;
+    case GL_RG16F:
+    case GL_R32F:
+    case GL_RGBA8:
+    case GL_SRGB8_ALPHA8:
+    case GL_R11F_G11F_B10F:
+    case GL_DEPTH_COMPONENT24:     // stored in 32 bits
+    case GL_DEPTH_COMPONENT32F:
+    case GL_DEPTH24_STENCIL8:
+        return 4;
+    case GL_RGBA16F:
+    case GL_RG32F:
+        return 8;
+    case GL_RGB32F:
+        return 12;
+    case GL_RGBA32F:
+        return 16;
+    default:
+        return 4;
+    }
+}
+
+
+RenderTargetDesc::RenderTargetDesc(const Eigen::Vector2i &size, int levels) :
+    size(size), depth(0, 0), levels(levels) {}
+
+RenderTargetDesc &RenderTargetDesc::addColor(GLenum internalFormat, GLenum format) {
+    color.emplace_back(internalFormat, format);
+    return *this;
+}
+
+RenderTargetDesc &RenderTargetDesc::setDepth(GLenum internalFormat, GLenum format) {
+    depth = std::make_pair(internalFormat, format);
+    return *this;
+}
+
+std::size_t RenderTargetDesc::bytes() const {
+    std::size_t texels = 0;
+    for (int l = 0; l < levels; l++) {
+        texels += (std::size_t) std::max(1, size.x() >> l) * std::max(1, size.y() >> l);
+    }
+    std::size_t perTexel = depth.first ? texelBytes(depth.first) : 0;
+    for (const std::pair<GLenum, GLenum> &c : color) {
+        perTexel += texelBytes(c.first);
+    }
+    return texels * perTexel;
+}
+
+bool RenderTargetDesc::servedBy(const RenderTargetDesc &other) const {
+    return size == other.size && color == other.color && depth == other.depth && levels <= other.levels;
+}
+
+
+RenderTargetPool::RenderTargetPool(int maxIdleFrames) :
+    maxIdleFrames(maxIdleFrames), peak(0), framePeak(0),
+    acquired(0), aliased(0), frameAcquired(0), frameAliased(0) {}
+
+void RenderTargetPool::beginFrame() {
+    framePeak = numBytes();
+    frameAcquired = frameAliased = 0;
+    for (Target &t : targets) {
+        t.usedThisFrame = false;
+    }
+}
+
+std::shared_ptr<Framebuffer> RenderTargetPool::acquire(const RenderTargetDesc &desc) {
+    frameAcquired++;
+
+    Target *best = nullptr;
+    for (Target &t : targets) {
+        if (!t.held && desc.servedBy(t.desc) && (!best || t.desc.bytes() < best->desc.bytes())) {
+            best = &t;
+        }
+    }
+
+    if (best) {
+        if (best->usedThisFrame) {
+            frameAliased++;
+        }
+    } else {
+        Target t;
+        t.desc = desc;
+        if (desc.depth.first) {
+            t.framebuffer = std::make_shared<Framebuffer>(desc.size, desc.color, desc.depth, desc.levels);
+        } else {
+            t.framebuffer = std::make_shared<Framebuffer>(desc.size, desc.color, desc.levels);
+        }
+        targets.push_back(t);
+        best = &targets.back();
+        framePeak = std::max(framePeak, numBytes());
+    }
+
+    best->held = true;
+    best->usedThisFrame = true;
+    best->idleFrames = 0;
+    return best->framebuffer;
+}
+
+void RenderTargetPool::release(std::shared_ptr<Framebuffer> &target) {
+    for (Target &t : targets) {
+        if (t.held && t.framebuffer == target) {
+            t.held = false;
+            target.reset();
+            return;
+        }
+    }
+    throw std::runtime_error("Released a render target that is not held from the pool");
+}
+
+void RenderTargetPool::endFrame() {
+    for (Target &t : targets) {
+        if (!t.usedThisFrame) {
+            t.idleFrames++;
+        }
+    }
+    targets.erase(std::remove_if(targets.begin(), targets.end(), [this](const Target &t) {
+        return !t.held && t.idleFrames >= maxIdleFrames;
+    }), targets.end());
+
+    peak = framePeak;
+    acquired = frameAcquired;
+    aliased = frameAliased;
+}
+
+std::size_t RenderTargetPool::numBytes() const {
+    std::size_t bytes = 0;
+    for (const Target &t : targets) {
+        bytes += t.desc.bytes();
+    }
+    return bytes;
+}
+
+void RenderTargetPool::printStats() const {
+    printf("\t%d render targets, %.1f MB; the last frame peaked at %.1f MB, %d of its %d targets aliased\n",
+        numTargets(), numBytes() / (1024.0 * 1024.0), peakBytes() / (1024.0 * 1024.0), numAliased(), numAcquired());
+}
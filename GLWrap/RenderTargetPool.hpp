@@ -0,0 +1,121 @@
+// RenderTargetPool.hpp
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <nanogui/opengl.h>
+
+#include "Framebuffer.hpp"
+#include "Util.hpp"
+
+namespace GLWrap {
+
+/*
+ * The textures of a render target: their size, the internal format and
+ * format of each color attachment and of the depth attachment, and the
+ * number of mipmap levels of each texture.
+ *
+ * Use:
+ *     RenderTargetDesc desc(size, levels);
+ *     desc.addColor(GL_RGBA32F, GL_RGBA).setDepth(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT);
+ */
+struct GLWRAP_EXPORT RenderTargetDesc {
+
+    Eigen::Vector2i size;
+    std::vector<std::pair<GLenum, GLenum>> color;
+    std::pair<GLenum, GLenum> depth;    // (0, 0) without a depth attachment
+    int levels;
+
+    RenderTargetDesc(const Eigen::Vector2i &size = Eigen::Vector2i(0, 0), int levels = 1);
+
+    RenderTargetDesc &addColor(GLenum internalFormat, GLenum format);
+    RenderTargetDesc &setDepth(GLenum internalFormat, GLenum format);
+
+    // Estimated bytes of the textures, mipmap levels included
+    std::size_t bytes() const;
+
+    // True if a target made for other can stand in for this one: the same
+    // size and formats, and at least as many mipmap levels
+    bool servedBy(const RenderTargetDesc &other) const;
+};
+
+/*
+ * A pool of framebuffers handed out to the passes of a frame, so that the
+ * passes share render targets instead of each owning its own for the
+ * lifetime of the application.
+ *
+ * A pass acquires a target by description when it first writes it and the
+ * last pass reading it releases it.  A released target is handed out again
+ * to any later acquisition it can serve, in the same frame (the two uses
+ * alias the same textures, as their lifetimes do not overlap) or in the
+ * next ones.  Targets that no pass acquired for maxIdleFrames frames are
+ * deleted, so the targets of a mode that is turned off do not keep their
+ * memory.
+ *
+ * The pool tracks the memory of its textures, the peak of each frame and
+ * how many acquisitions were served by a target already used in the frame.
+ *
+ * Use per frame:
+ *     pool.beginFrame();
+ *     std::shared_ptr<Framebuffer> target = pool.acquire(desc);
+ *     ... passes writing and reading target ...
+ *     pool.release(target);
+ *     pool.endFrame();
+ */
+class GLWRAP_EXPORT RenderTargetPool {
+public:
+
+    RenderTargetPool(int maxIdleFrames = 1);
+
+    // Copying is not allowed because the pool owns its framebuffers
+    RenderTargetPool(const RenderTargetPool &) = delete;
+    RenderTargetPool &operator=(const RenderTargetPool &) = delete;
+
+    void beginFrame();
+
+    // A free target that serves desc, the smallest one if several do, or a
+    // new one.  Its contents are undefined.
+    std::shared_ptr<Framebuffer> acquire(const RenderTargetDesc &desc);
+
+    // Give an acquired target back to the pool and reset target
+    // @throws std::runtime_error if target is not held from this pool.
+    void release(std::shared_ptr<Framebuffer> &target);
+
+    // Delete the free targets that were not acquired for maxIdleFrames frames
+    void endFrame();
+
+    // Number of targets and estimated bytes of their textures
+    int numTargets() const { return (int) targets.size(); }
+    std::size_t numBytes() const;
+
+    // During the last frame: the most bytes allocated at once, the number
+    // of acquisitions and how many of them aliased an earlier target of the frame
+    std::size_t peakBytes() const { return peak; }
+    int numAcquired() const { return acquired; }
+    int numAliased() const { return aliased; }
+
+    void printStats() const;
+
+private:
+
+    struct Target {
+        RenderTargetDesc desc;
+        std::shared_ptr<Framebuffer> framebuffer;
+        bool held;
+        bool usedThisFrame;
+        int idleFrames;
+    };
+
+    std::vector<Target> targets;
+    int maxIdleFrames;
+    std::size_t peak;
+    std::size_t framePeak;
+    int acquired, aliased;
+    int frameAcquired, frameAliased;
+};
+
+} // namespace
@@ -0,0 +1,23 @@
+//
+//  Sampler.cpp
+//
+
+#include "Sampler.hpp"
+
+using namespace GLWrap;
+
+Sampler::Sampler(GLint minFilter, GLint magFilter, GLint wrap) {
+  glGenSamplers(1, &mSamplerId);
+  glSamplerParameteri(mSamplerId, GL_TEXTURE_MIN_FILTER, minFilter);
+  glSamplerParameteri(mSamplerId, GL_TEXTURE_MAG_FILTER, magFilter);
+  glSamplerParameteri(mSamplerId, GL_TEXTURE_WRAP_S, wrap);
+  glSamplerParameteri(mSamplerId, GL_TEXTURE_WRAP_T, wrap);
+  glSamplerParameteri(mSamplerId, GL_TEXTURE_WRAP_R, wrap);
+
+  checkGLError("Sampler::Sampler");
+}
+
+Sampler::~Sampler() noexcept {
+  StateCache::deletedSampler(mSamplerId);
+  glDeleteSamplers(1, &mSamplerId);
+}
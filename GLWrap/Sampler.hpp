@@ -0,0 +1,56 @@
+//
+//  Sampler.hpp
+//
+
+#pragma once
+
+#include "Util.hpp"
+#include "StateCache.hpp"
+
+NAMESPACE_BEGIN(GLWrap)
+
+/// A wrapper for an OpenGL sampler object: the filtering and wrapping used to
+/// read any texture bound to the same texture unit, in place of the parameters
+/// of the texture.  The parameters are set once on construction and never
+/// change, so a pass binds the sampler it needs instead of setting the
+/// parameters of its input textures every frame.
+/// This class uses the RAII pattern; resources are initialized on construction
+/// and deleted on destruction.
+class GLWRAP_EXPORT Sampler {
+public:
+
+  /// Creates a sampler.
+  /// @arg minFilter The minification filter, e.g. GL_LINEAR_MIPMAP_LINEAR.
+  /// @arg magFilter The magnification filter, GL_NEAREST or GL_LINEAR.
+  /// @arg wrap The wrap mode of all three coordinates, e.g. GL_CLAMP_TO_EDGE.
+  Sampler(GLint minFilter = GL_NEAREST, GLint magFilter = GL_NEAREST, GLint wrap = GL_CLAMP_TO_EDGE);
+
+  /// This class tracks GPU resources and should not be copied.
+  Sampler(const Sampler&) = delete;
+
+  /// This class tracks GPU resources and should not be copied.
+  Sampler& operator=(const Sampler&) = delete;
+
+  /// Deletes the sampler.
+  ~Sampler() noexcept;
+
+  /// Return the sampler ID of this instance.
+  GLuint id() const { return mSamplerId; }
+
+  /// Binds this sampler to the specified texture unit.
+  /// @arg textureUnit The index of the texture unit. For instance, `0` would bind to `GL_TEXTURE0`.
+  void bindToTextureUnit(int textureUnit) const {
+    StateCache::bindSampler(textureUnit, mSamplerId);
+  }
+
+  /// Reads the texture of the specified texture unit with its own parameters again.
+  static void unbind(int textureUnit) {
+    StateCache::bindSampler(textureUnit, 0);
+  }
+
+protected:
+  /// The sampler ID.
+  GLuint mSamplerId;
+};
+
+NAMESPACE_END(GLWrap)
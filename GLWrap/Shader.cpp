@@ -1,4 +1,5 @@
 // Shader.cpp
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -34,7 +35,7 @@ Shader &Shader::operator =(Shader &&other) {
 
 // Load source code and compile
 // on a compile error, prints a report and exits
-void Shader::source(const std::string &filename) {
+void Shader::source(const std::string &filename, const std::vector<std::string> &defines) {
 
     // Read contents of source file into a string
     std::ifstream ifs(filename);
@@ -47,6 +48,21 @@ void Shader::source(const std::string &filename) {
     ss << ifs.rdbuf();
     std::string shaderText = ss.str();
 
+    // Define the variant after the #version line, which must come first,
+    // and keep the line numbers of the file in the diagnostics
+    if (!defines.empty()) {
+        std::size_t version = shaderText.find("#version");
+        std::size_t start = version == std::string::npos ? 0 : shaderText.find('\n', version);
+        start = start == std::string::npos ? shaderText.size() : start + 1;
+        int line = 1 + std::count(shaderText.begin(), shaderText.begin() + start, '\n');
+        std::string header;
+        for (const std::string &d : defines) {
+            header += "#define " + d + "\n";
+        }
+        header += "#line " + std::to_string(line) + "\n";
+        shaderText.insert(start, header);
+    }
+
     // Provide contents of string to GLSL compiler
     const char *source_p = shaderText.c_str();
     glShaderSource(shader, 1, &source_p, nullptr);
@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include <nanogui/opengl.h>
 
 #include "Util.hpp"
@@ -36,8 +39,10 @@ public:
     Shader &operator =(Shader &&);
 
     // Load source code from a file and compile.
+    // Each of the defines ("NAME" or "NAME value") is added as a #define
+    // after the #version line, to compile a variant of the shader.
     // Exits with an error dump if there is a compile error
-    void source(const std::string &);
+    void source(const std::string &, const std::vector<std::string> &defines = {});
 
     // The OpenGL shader id is available for making calls 
     // that are not supported by this class.
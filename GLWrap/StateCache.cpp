@@ -0,0 +1,186 @@
+// StateCache.cpp
+
+#include "StateCache.hpp"
+
+using namespace GLWrap;
+
+
+const GLuint StateCache::unknown;
+GLuint StateCache::program = StateCache::unknown;
+GLuint StateCache::vertexArray = StateCache::unknown;
+GLuint StateCache::drawFramebuffer = StateCache::unknown;
+GLuint StateCache::readFramebuffer = StateCache::unknown;
+int StateCache::activeUnit = -1;
+std::map<std::pair<int, GLenum>, GLuint> StateCache::textures;
+std::map<int, GLuint> StateCache::samplers;
+std::map<GLenum, bool> StateCache::capabilities;
+GLenum StateCache::blendMode = StateCache::unknown;
+std::pair<GLenum, GLenum> StateCache::blendFactors(StateCache::unknown, StateCache::unknown);
+GLenum StateCache::depthFunction = StateCache::unknown;
+GLuint StateCache::depthWrite = StateCache::unknown;
+GLint StateCache::view[4] = { 0, 0, 0, 0 };
+bool StateCache::viewKnown = false;
+int StateCache::issued = 0;
+int StateCache::skipped = 0;
+
+
+void StateCache::invalidate() {
+    program = vertexArray = drawFramebuffer = readFramebuffer = unknown;
+    activeUnit = -1;
+    textures.clear();
+    samplers.clear();
+    capabilities.clear();
+    blendMode = unknown;
+    blendFactors = std::make_pair(unknown, unknown);
+    depthFunction = unknown;
+    depthWrite = unknown;
+    viewKnown = false;
+}
+
+bool StateCache::change(bool differs) {
+    if (differs) {
+        issued++;
+    } else {
+        skipped++;
+    }
+    return differs;
+}
+
+
+void StateCache::useProgram(GLuint p) {
+    if (change(program != p)) {
+        glUseProgram(p);
+        program = p;
+    }
+}
+
+void StateCache::bindVertexArray(GLuint vao) {
+    if (change(vertexArray != vao)) {
+        glBindVertexArray(vao);
+        vertexArray = vao;
+    }
+}
+
+void StateCache::bindFramebuffer(GLenum target, GLuint framebuffer) {
+    if (target == GL_FRAMEBUFFER) {
+        if (change(drawFramebuffer != framebuffer || readFramebuffer != framebuffer)) {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            drawFramebuffer = readFramebuffer = framebuffer;
+        }
+    } else {
+        GLuint &bound = target == GL_DRAW_FRAMEBUFFER ? drawFramebuffer : readFramebuffer;
+        if (change(bound != framebuffer)) {
+            glBindFramebuffer(target, framebuffer);
+            bound = framebuffer;
+        }
+    }
+}
+
+void StateCache::activeTexture(int unit) {
+    if (change(activeUnit != unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+}
+
+void StateCache::bindTexture(int unit, GLenum target, GLuint texture) {
+    auto it = textures.find(std::make_pair(unit, target));
+    if (change(it == textures.end() || it->second != texture)) {
+        activeTexture(unit);
+        glBindTexture(target, texture);
+        textures[std::make_pair(unit, target)] = texture;
+    }
+}
+
+void StateCache::bindTexture(GLenum target, GLuint texture) {
+    if (activeUnit < 0) {
+        // the active unit is not known, make it known
+        activeTexture(0);
+    }
+    bindTexture(activeUnit, target, texture);
+}
+
+void StateCache::bindSampler(int unit, GLuint sampler) {
+    auto it = samplers.find(unit);
+    if (change(it == samplers.end() || it->second != sampler)) {
+        glBindSampler(unit, sampler);
+        samplers[unit] = sampler;
+    }
+}
+
+void StateCache::setEnabled(GLenum capability, bool enabled) {
+    auto it = capabilities.find(capability);
+    if (change(it == capabilities.end() || it->second != enabled)) {
+        if (enabled) {
+            glEnable(capability);
+        } else {
+            glDisable(capability);
+        }
+        capabilities[capability] = enabled;
+    }
+}
+
+void StateCache::blendEquation(GLenum mode) {
+    if (change(blendMode != mode)) {
+        glBlendEquation(mode);
+        blendMode = mode;
+    }
+}
+
+void StateCache::blendFunc(GLenum sfactor, GLenum dfactor) {
+    if (change(blendFactors != std::make_pair(sfactor, dfactor))) {
+        glBlendFunc(sfactor, dfactor);
+        blendFactors = std::make_pair(sfactor, dfactor);
+    }
+}
+
+void StateCache::depthFunc(GLenum func) {
+    if (change(depthFunction != func)) {
+        glDepthFunc(func);
+        depthFunction = func;
+    }
+}
+
+void StateCache::depthMask(bool write) {
+    if (change(depthWrite != (GLuint) write)) {
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        depthWrite = write;
+    }
+}
+
+void StateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (change(!viewKnown || view[0] != x || view[1] != y || view[2] != width || view[3] != height)) {
+        glViewport(x, y, width, height);
+        view[0] = x;
+        view[1] = y;
+        view[2] = width;
+        view[3] = height;
+        viewKnown = true;
+    }
+}
+
+
+void StateCache::deletedProgram(GLuint p) {
+    if (program == p) program = unknown;
+}
+
+void StateCache::deletedVertexArray(GLuint vao) {
+    if (vertexArray == vao) vertexArray = 0;
+}
+
+void StateCache::deletedFramebuffer(GLuint framebuffer) {
+    if (drawFramebuffer == framebuffer) drawFramebuffer = 0;
+    if (readFramebuffer == framebuffer) readFramebuffer = 0;
+}
+
+void StateCache::deletedTexture(GLuint texture) {
+    for (auto &t : textures) {
+        if (t.second == texture) t.second = 0;
+    }
+}
+
+void StateCache::deletedSampler(GLuint sampler) {
+    for (auto &s : samplers) {
+        if (s.second == sampler) s.second = 0;
+    }
+}
@@ -0,0 +1,109 @@
+// StateCache.hpp
+
+#pragma once
+
+#include <map>
+#include <utility>
+
+#include <nanogui/opengl.h>
+
+#include "Util.hpp"
+
+namespace GLWrap {
+
+/*
+ * A shadow copy of the OpenGL state set by the renderer, to skip the calls
+ * that would set a state to the value it already has.
+ *
+ * It tracks the bound program, vertex array and framebuffers, the texture
+ * and sampler bound to each texture unit, the enabled capabilities (blend,
+ * depth test, ...), the blend and depth functions and the viewport.  The
+ * GLWrap classes bind their objects through it, and the passes of the
+ * renderer set their state through it.
+ *
+ * The state belongs to the current OpenGL context; the application has
+ * one, so the cache is a set of static functions.  Code that changes the
+ * tracked state behind its back (e.g. the GUI, drawn between two frames)
+ * must be followed by invalidate(), after which every state is set again
+ * once.
+ *
+ * The cache counts the calls it issues and the calls it skips, per frame
+ * when resetCounters() is called at the start of every frame.
+ */
+class GLWRAP_EXPORT StateCache {
+public:
+
+    // Forget the tracked state; the next change of every state is issued
+    static void invalidate();
+
+    // Bind a program (glUseProgram), 0 for none
+    static void useProgram(GLuint program);
+
+    // Bind a vertex array object, 0 for none
+    static void bindVertexArray(GLuint vao);
+
+    // Bind a framebuffer to GL_FRAMEBUFFER (both the draw and the read
+    // framebuffers), GL_DRAW_FRAMEBUFFER or GL_READ_FRAMEBUFFER
+    static void bindFramebuffer(GLenum target, GLuint framebuffer);
+
+    // Bind a texture to a target (GL_TEXTURE_2D, ...) of a texture unit,
+    // or of the active unit
+    static void bindTexture(int unit, GLenum target, GLuint texture);
+    static void bindTexture(GLenum target, GLuint texture);
+
+    // Bind a sampler object to a texture unit, 0 to use the parameters of the texture
+    static void bindSampler(int unit, GLuint sampler);
+
+    // Enable or disable a capability (GL_BLEND, GL_DEPTH_TEST, ...)
+    static void setEnabled(GLenum capability, bool enabled);
+
+    static void blendEquation(GLenum mode);
+    static void blendFunc(GLenum sfactor, GLenum dfactor);
+    static void depthFunc(GLenum func);
+    static void depthMask(bool write);
+    static void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    // The objects were deleted: forget them where they are bound.  Deleting
+    // a bound vertex array, framebuffer, texture or sampler unbinds it; a
+    // deleted program stays in use until another one is, so it is unknown.
+    static void deletedProgram(GLuint program);
+    static void deletedVertexArray(GLuint vao);
+    static void deletedFramebuffer(GLuint framebuffer);
+    static void deletedTexture(GLuint texture);
+    static void deletedSampler(GLuint sampler);
+
+    // Number of state changes issued to OpenGL and skipped as redundant
+    // since the last resetCounters()
+    static int numIssued() { return issued; }
+    static int numSkipped() { return skipped; }
+    static void resetCounters() { issued = skipped = 0; }
+
+private:
+
+    // The value of a state that is not known
+    static const GLuint unknown = 0xFFFFFFFFu;
+
+    static GLuint program;
+    static GLuint vertexArray;
+    static GLuint drawFramebuffer;
+    static GLuint readFramebuffer;
+    static int activeUnit;
+    static std::map<std::pair<int, GLenum>, GLuint> textures;
+    static std::map<int, GLuint> samplers;
+    static std::map<GLenum, bool> capabilities;
+    static GLenum blendMode;
+    static std::pair<GLenum, GLenum> blendFactors;
+    static GLenum depthFunction;
+    static GLuint depthWrite;
+    static GLint view[4];
+    static bool viewKnown;
+
+    static int issued;
+    static int skipped;
+
+    // Count a change, true if it must be issued
+    static bool change(bool differs);
+    static void activeTexture(int unit);
+};
+
+} // namespace
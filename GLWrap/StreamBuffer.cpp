@@ -0,0 +1,144 @@
+// StreamBuffer.cpp
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "StreamBuffer.hpp"
+
+using namespace GLWrap;
+
+
+StreamBuffer::StreamBuffer(GLenum target, std::size_t frameSize, int numFrames) :
+    target(target), buffer(0), numSegments(numFrames), segment(numFrames - 1),
+    cursor(0), flushed(0), mapped(nullptr), fences(numFrames, (GLsync) 0) {
+
+    // Keep every allocation usable as a uniform block range
+    GLint uboAlignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uboAlignment);
+    alignment = std::max<std::size_t>(16, uboAlignment);
+    segmentSize = (frameSize + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+
+#ifdef GL_MAP_PERSISTENT_BIT
+    if (hasGLVersion(4, 4)) {
+        // One immutable store holding all the segments, mapped once for good
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, segmentSize * numSegments, nullptr, flags);
+        mapped = (unsigned char *) glMapBufferRange(target, 0, segmentSize * numSegments, flags);
+    }
+#endif
+
+    if (!mapped) {
+        // A single segment, orphaned every frame
+        numSegments = 1;
+        segment = 0;
+        glBufferData(target, segmentSize, nullptr, GL_STREAM_DRAW);
+        staging.resize(segmentSize);
+    }
+
+    glBindBuffer(target, 0);
+
+    checkGLError("StreamBuffer::StreamBuffer end");
+}
+
+StreamBuffer::~StreamBuffer() {
+    for (GLsync fence : fences) {
+        if (fence) glDeleteSync(fence);
+    }
+    if (mapped) {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+    }
+    if (buffer) glDeleteBuffers(1, &buffer);
+}
+
+
+void StreamBuffer::beginFrame() {
+
+    if (mapped) {
+        // Move on to the next segment and wait until the GPU has finished
+        // the draws of the frame that last wrote into it
+        segment = (segment + 1) % numSegments;
+        GLsync &fence = fences[segment];
+        if (fence) {
+            GLenum status = glClientWaitSync(fence, 0, 0);
+            while (status == GL_TIMEOUT_EXPIRED) {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            }
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    } else {
+        // Give the driver a fresh store, the draws of the previous frame keep the old one
+        glBindBuffer(target, buffer);
+        glBufferData(target, segmentSize, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(target, 0);
+    }
+
+    cursor = 0;
+    flushed = 0;
+
+    checkGLError("StreamBuffer::beginFrame end");
+}
+
+
+void *StreamBuffer::allocate(std::size_t bytes, GLintptr &offset) {
+
+    std::size_t start = (cursor + alignment - 1) / alignment * alignment;
+    if (start + bytes > segmentSize) {
+        throw std::runtime_error("StreamBuffer: " + std::to_string(bytes)
+            + " bytes do not fit in the frame segment of " + std::to_string(segmentSize) + " bytes");
+    }
+    cursor = start + bytes;
+
+    offset = segment * segmentSize + start;
+    return mapped ? mapped + offset : staging.data() + start;
+}
+
+
+GLintptr StreamBuffer::write(const void *data, std::size_t bytes) {
+    GLintptr offset;
+    std::memcpy(allocate(bytes, offset), data, bytes);
+    return offset;
+}
+
+
+bool StreamBuffer::fits(std::size_t bytes) const {
+    std::size_t start = (cursor + alignment - 1) / alignment * alignment;
+    return start + bytes <= segmentSize;
+}
+
+
+void StreamBuffer::flush() {
+
+    // The persistent mapping is coherent, writes are visible without flushing
+    if (mapped || cursor == flushed) return;
+
+    glBindBuffer(target, buffer);
+    glBufferSubData(target, flushed, cursor - flushed, staging.data() + flushed);
+    glBindBuffer(target, 0);
+    flushed = cursor;
+
+    checkGLError("StreamBuffer::flush end");
+}
+
+
+void StreamBuffer::endFrame() {
+    if (mapped && cursor > 0) {
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+
+void StreamBuffer::bind() const {
+    glBindBuffer(target, buffer);
+}
+
+
+void StreamBuffer::bindRange(GLuint index, GLintptr offset, std::size_t bytes) const {
+    glBindBufferRange(target, index, buffer, offset, bytes);
+}
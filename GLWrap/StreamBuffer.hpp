@@ -0,0 +1,118 @@
+// StreamBuffer.hpp
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <nanogui/opengl.h>
+
+#include "Util.hpp"
+
+namespace GLWrap {
+
+/*
+ * A class to represent an OpenGL buffer that is rewritten every frame.
+ *
+ * The buffer is a ring of numFrames segments of frameSize bytes each.
+ * Every frame writes into the next segment while the GPU may still be
+ * reading the segments of the previous frames, so writing never waits for
+ * the draws of the frame before.  A fence is placed after the draws of each
+ * frame, and a segment is only reused once the GPU has passed its fence.
+ *
+ * When the context supports OpenGL 4.4 (or ARB_buffer_storage), the buffer
+ * is created with immutable storage and stays persistently mapped: writes
+ * go straight into GPU visible memory.  Otherwise (e.g. macOS, which stops
+ * at OpenGL 4.1) the writes of a frame are staged in CPU memory and uploaded
+ * with glBufferSubData into a buffer that is orphaned at the start of every
+ * frame, which lets the driver hand out fresh storage instead of stalling.
+ *
+ * Use per frame:
+ *     buffer.beginFrame();
+ *     GLintptr offset = buffer.write(data, bytes);  // or allocate()
+ *     buffer.flush();                               // before the draws reading it
+ *     ... draws reading from the buffer at offset ...
+ *     buffer.endFrame();
+ *
+ * Offsets are relative to the start of the OpenGL buffer, so they can be
+ * passed directly to glVertexAttribPointer (see Mesh::setStreamAttribute),
+ * glBindBufferRange or the indirect draw calls.
+ */
+class GLWRAP_EXPORT StreamBuffer {
+public:
+
+    // Create a stream buffer for the given target (GL_ARRAY_BUFFER,
+    // GL_UNIFORM_BUFFER, ...) with room for frameSize bytes per frame
+    // and numFrames frames in flight.
+    StreamBuffer(GLenum target, std::size_t frameSize, int numFrames = 3);
+
+    // Deleting a stream buffer releases the buffer and any pending fences
+    ~StreamBuffer();
+
+    // Copying is not allowed because a StreamBuffer owns GPU resources
+    StreamBuffer(const StreamBuffer &) = delete;
+    StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+    // Move to the next segment of the ring, waiting for the GPU to be done
+    // with it if needed (persistent mode), or orphan the buffer (fallback mode).
+    void beginFrame();
+
+    // Reserve bytes in the segment of the current frame and return where to
+    // write them.  offset receives the position of the reserved range in
+    // the OpenGL buffer.  Allocations are aligned so that they can be bound
+    // as uniform blocks.
+    // @throws std::runtime_error if the frame segment is full.
+    void *allocate(std::size_t bytes, GLintptr &offset);
+
+    // Copy data into the segment of the current frame and return its offset
+    GLintptr write(const void *data, std::size_t bytes);
+
+    // True if bytes more can be allocated in the segment of the current frame
+    bool fits(std::size_t bytes) const;
+
+    // Make the writes of the current frame visible to OpenGL.
+    // Must be called before issuing the draws that read them.
+    void flush();
+
+    // Place a fence after the draws of the current frame
+    void endFrame();
+
+    // Bind the buffer to its target
+    void bind() const;
+
+    // Bind bytes of the buffer from offset (e.g. a uniform block returned by
+    // write()) to the indexed binding point of its target
+    void bindRange(GLuint index, GLintptr offset, std::size_t bytes) const;
+
+    // OpenGL identifier of the buffer
+    GLuint id() const { return buffer; }
+
+    // True if the buffer is persistently mapped, false in the orphaning fallback
+    bool persistent() const { return mapped != nullptr; }
+
+    // Number of bytes available to each frame
+    std::size_t frameSize() const { return segmentSize; }
+
+private:
+
+    GLenum target;
+    GLuint buffer;
+
+    std::size_t segmentSize;
+    int numSegments;
+    std::size_t alignment;
+
+    // The segment of the current frame and the write position within it
+    int segment;
+    std::size_t cursor;
+    std::size_t flushed;
+
+    // Persistent mode: the mapped buffer and one fence per segment
+    unsigned char *mapped;
+    std::vector<GLsync> fences;
+
+    // Fallback mode: the writes of the current frame, uploaded by flush()
+    std::vector<unsigned char> staging;
+};
+
+} // namespace
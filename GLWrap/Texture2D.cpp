@@ -8,6 +8,8 @@
 
 #include "Texture2D.hpp"
 
+#include <algorithm>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -24,8 +26,6 @@ Texture2D::Texture2D(const std::string& fileName, bool srgb, bool flipVertically
   );
   if (!textureData)
     throw std::invalid_argument("Could not load texture data from file " + fileName);
-  glGenTextures(1, &mTextureId);
-  glBindTexture(GL_TEXTURE_2D, mTextureId);
   GLint internalFormat;
   GLint format;
   switch (n) {
@@ -39,13 +39,38 @@ Texture2D::Texture2D(const std::string& fileName, bool srgb, bool flipVertically
   glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
   glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
   glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
-  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, GL_UNSIGNED_BYTE, textureData.get());
+  if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+    glCreateTextures(GL_TEXTURE_2D, 1, &mTextureId);
+    glTextureStorage2D(mTextureId, 1, internalFormat, w, h);
+    glTextureSubImage2D(mTextureId, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, textureData.get());
+#endif
+  } else {
+    glGenTextures(1, &mTextureId);
+    StateCache::bindTexture(GL_TEXTURE_2D, mTextureId);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, GL_UNSIGNED_BYTE, textureData.get());
+  }
   setParameters();
 }
 
-Texture2D::Texture2D(const nanogui::Vector2i& size, GLint internalFormat, GLint format) {
-  glGenTextures(1, &mTextureId);
-  glBindTexture(GL_TEXTURE_2D, mTextureId);
-  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, size.x(), size.y(), 0, format, GL_UNSIGNED_BYTE, nullptr);
+Texture2D::Texture2D(const nanogui::Vector2i& size, GLint internalFormat, GLint format, int levels) {
+  if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+    glCreateTextures(GL_TEXTURE_2D, 1, &mTextureId);
+    glTextureStorage2D(mTextureId, levels, internalFormat, size.x(), size.y());
+#endif
+  } else {
+    glGenTextures(1, &mTextureId);
+    StateCache::bindTexture(GL_TEXTURE_2D, mTextureId);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, size.x(), size.y(), 0, format, GL_UNSIGNED_BYTE, nullptr);
+  }
   setParameters();
 }
+
+int Texture2D::mipmapLevels(const nanogui::Vector2i& size) {
+  int levels = 1;
+  for (int s = std::max(size.x(), size.y()); s > 1; s /= 2) {
+    levels++;
+  }
+  return levels;
+}
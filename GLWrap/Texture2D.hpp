@@ -9,6 +9,7 @@
 #pragma once
 
 #include "Util.hpp"
+#include "StateCache.hpp"
 #include <memory>
 
 NAMESPACE_BEGIN(GLWrap)
@@ -31,7 +32,14 @@ public:
   ///   https://www.khronos.org/opengl/wiki/Image_Format
   /// @arg format The format of the texture. See
   ///   https://www.khronos.org/opengl/wiki/Image_Format
-  Texture2D(const Eigen::Vector2i& size, GLint internalFormat = GL_RGBA8, GLint format = GL_RGBA);
+  /// @arg levels The number of mipmap levels (see mipmapLevels). With direct state
+  ///   access the storage of all levels is allocated at once and cannot change;
+  ///   otherwise level 0 is allocated and generateMipmap allocates the others.
+  Texture2D(const Eigen::Vector2i& size, GLint internalFormat = GL_RGBA8, GLint format = GL_RGBA,
+            int levels = 1);
+
+  /// Return the number of levels of a full mipmap of a texture of the given size.
+  static int mipmapLevels(const Eigen::Vector2i& size);
 
   /// Wraps an existing OpenGL texture and takes ownership of it.
   Texture2D(GLint textureId) : mTextureId(textureId) { }
@@ -52,6 +60,7 @@ public:
   /// Moves tracked GPU resources into this instance. The other instance is left in an invalid state
   /// but may be safely destroyed.
   Texture2D& operator=(Texture2D&& other) {
+    StateCache::deletedTexture(mTextureId);
     glDeleteTextures(1, &mTextureId);
     other.mTextureId = mTextureId;
     mTextureId = 0;
@@ -60,6 +69,7 @@ public:
 
   /// Deletes this texture.
   ~Texture2D() noexcept {
+    StateCache::deletedTexture(mTextureId);
     glDeleteTextures(1, &mTextureId);
   }
 
@@ -72,38 +82,55 @@ public:
                      GLint textureWrapT = GL_CLAMP_TO_EDGE,
                      GLint textureMagFilter = GL_NEAREST,
                      GLint textureMinFilter = GL_LINEAR) const {
-    if (mTextureId == 0) return;
-    glBindTexture(GL_TEXTURE_2D, mTextureId);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, textureWrapS);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, textureWrapT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, textureMagFilter);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, textureMinFilter);
+    parameter(GL_TEXTURE_WRAP_S, textureWrapS);
+    parameter(GL_TEXTURE_WRAP_T, textureWrapT);
+    parameter(GL_TEXTURE_MAG_FILTER, textureMagFilter);
+    parameter(GL_TEXTURE_MIN_FILTER, textureMinFilter);
   }
 
+  /// Sets one parameter of this texture, without binding it if direct state
+  /// access is available.
   void parameter(GLenum pname, GLint value) const {
     if (mTextureId == 0) return;
-    glBindTexture(GL_TEXTURE_2D, mTextureId);
-    glTexParameteri(GL_TEXTURE_2D, pname, value);
+    if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+      glTextureParameteri(mTextureId, pname, value);
+#endif
+    } else {
+      StateCache::bindTexture(GL_TEXTURE_2D, mTextureId);
+      glTexParameteri(GL_TEXTURE_2D, pname, value);
+    }
   }
 
   void parameter(GLenum pname, GLfloat value) const {
     if (mTextureId == 0) return;
-    glBindTexture(GL_TEXTURE_2D, mTextureId);
-    glTexParameterf(GL_TEXTURE_2D, pname, value);
+    if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+      glTextureParameterf(mTextureId, pname, value);
+#endif
+    } else {
+      StateCache::bindTexture(GL_TEXTURE_2D, mTextureId);
+      glTexParameterf(GL_TEXTURE_2D, pname, value);
+    }
   }
 
   /// Binds this texture to the speicified texture unit.
   /// @warning The specified texture unit must be in the range [0, GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS).
   /// @arg textureUnit The index of the texture unit. For instance, `0` would bind to `GL_TEXTURE0`.
   void bindToTextureUnit(int textureUnit) const {
-    glActiveTexture(GL_TEXTURE0 + textureUnit);
-    glBindTexture(GL_TEXTURE_2D, id());
+    StateCache::bindTexture(textureUnit, GL_TEXTURE_2D, id());
   }
 
   /// Creates a mipmap for the texture.
   void generateMipmap() const {
-    glBindTexture(GL_TEXTURE_2D, id());
-    glGenerateMipmap(GL_TEXTURE_2D);
+    if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+      glGenerateTextureMipmap(id());
+#endif
+    } else {
+      StateCache::bindTexture(GL_TEXTURE_2D, id());
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
   }
 
 protected:
@@ -0,0 +1,66 @@
+//
+//  TextureBuffer.cpp
+//
+
+#include "TextureBuffer.hpp"
+
+#include <stdexcept>
+
+using namespace GLWrap;
+
+TextureBuffer::TextureBuffer(GLenum internalFormat) :
+  mInternalFormat(internalFormat), mSize(0) {
+  if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+    glCreateBuffers(1, &mBufferId);
+    glCreateTextures(GL_TEXTURE_BUFFER, 1, &mTextureId);
+#endif
+  } else {
+    glGenBuffers(1, &mBufferId);
+    glGenTextures(1, &mTextureId);
+  }
+}
+
+TextureBuffer::~TextureBuffer() noexcept {
+  StateCache::deletedTexture(mTextureId);
+  glDeleteTextures(1, &mTextureId);
+  glDeleteBuffers(1, &mBufferId);
+}
+
+void TextureBuffer::setData(const void* data, std::size_t bytes, GLenum usage) {
+  mSize = bytes;
+
+  // (Re)attach the buffer, the texture sees the new store
+  if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+    glNamedBufferData(mBufferId, bytes, data, usage);
+    glTextureBuffer(mTextureId, mInternalFormat, mBufferId);
+#endif
+  } else {
+    glBindBuffer(GL_TEXTURE_BUFFER, mBufferId);
+    glBufferData(GL_TEXTURE_BUFFER, bytes, data, usage);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    StateCache::bindTexture(GL_TEXTURE_BUFFER, mTextureId);
+    glTexBuffer(GL_TEXTURE_BUFFER, mInternalFormat, mBufferId);
+    StateCache::bindTexture(GL_TEXTURE_BUFFER, 0);
+  }
+
+  checkGLError("TextureBuffer::setData");
+}
+
+void TextureBuffer::updateData(std::size_t offset, const void* data, std::size_t bytes) {
+  if (offset + bytes > mSize)
+    throw std::out_of_range("TextureBuffer::updateData: range past the end of the buffer");
+  if (hasDirectStateAccess()) {
+#ifdef GL_VERSION_4_5
+    glNamedBufferSubData(mBufferId, offset, bytes, data);
+#endif
+  } else {
+    glBindBuffer(GL_TEXTURE_BUFFER, mBufferId);
+    glBufferSubData(GL_TEXTURE_BUFFER, offset, bytes, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+
+  checkGLError("TextureBuffer::updateData");
+}
@@ -0,0 +1,65 @@
+//
+//  TextureBuffer.hpp
+//
+
+#pragma once
+
+#include "Util.hpp"
+#include "StateCache.hpp"
+#include <cstddef>
+
+NAMESPACE_BEGIN(GLWrap)
+
+/// A wrapper for an OpenGL buffer texture: a buffer object whose contents
+/// are read by shaders as a one-dimensional texture with `texelFetch` on a
+/// `samplerBuffer` (or `isamplerBuffer`/`usamplerBuffer` for integer formats).
+/// It holds tables that are too large or too variable for plain uniforms.
+/// This class uses the RAII pattern; resources are initialized on construction
+/// and deleted on destruction.
+class GLWRAP_EXPORT TextureBuffer {
+public:
+
+  /// Creates an empty buffer texture.
+  /// @arg internalFormat The format of one texel, e.g. GL_RGBA32F for vec4 texels.
+  TextureBuffer(GLenum internalFormat = GL_RGBA32F);
+
+  /// This class tracks GPU resources and should not be copied.
+  TextureBuffer(const TextureBuffer&) = delete;
+
+  /// This class tracks GPU resources and should not be copied.
+  TextureBuffer& operator=(const TextureBuffer&) = delete;
+
+  /// Deletes the texture and its buffer.
+  ~TextureBuffer() noexcept;
+
+  /// Replaces the contents of the buffer with the given data.
+  /// @arg usage The usage hint of the buffer, e.g. GL_STATIC_DRAW or GL_STREAM_DRAW.
+  void setData(const void* data, std::size_t bytes, GLenum usage = GL_STATIC_DRAW);
+
+  /// Overwrites part of the contents of the buffer.
+  /// @throws std::out_of_range if the range is not inside the buffer.
+  void updateData(std::size_t offset, const void* data, std::size_t bytes);
+
+  /// Return the texture ID of this instance.
+  GLuint id() const { return mTextureId; }
+
+  /// Return the ID of the buffer holding the texels.
+  GLuint bufferId() const { return mBufferId; }
+
+  /// Size of the buffer in bytes.
+  std::size_t size() const { return mSize; }
+
+  /// Binds this texture to the speicified texture unit.
+  /// @arg textureUnit The index of the texture unit. For instance, `0` would bind to `GL_TEXTURE0`.
+  void bindToTextureUnit(int textureUnit) const {
+    StateCache::bindTexture(textureUnit, GL_TEXTURE_BUFFER, mTextureId);
+  }
+
+protected:
+  GLenum mInternalFormat;
+  GLuint mTextureId;
+  GLuint mBufferId;
+  std::size_t mSize;
+};
+
+NAMESPACE_END(GLWrap)
@@ -66,4 +66,28 @@ GLWRAP_EXPORT inline GLenum checkGLError(std::string loc = "", bool throwOnError
   return error;
 }
 
+/// Check the version of the current OpenGL context.
+/// Features beyond OpenGL 3.3 must also be guarded at compile time
+/// (e.g. `#ifdef GL_VERSION_4_3`), since some platforms do not declare them.
+/// @return true if the context version is at least major.minor.
+GLWRAP_EXPORT inline bool hasGLVersion(int major, int minor) {
+  GLint ctxMajor = 0, ctxMinor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &ctxMajor);
+  glGetIntegerv(GL_MINOR_VERSION, &ctxMinor);
+  return ctxMajor > major || (ctxMajor == major && ctxMinor >= minor);
+}
+
+/// Check whether the direct state access functions of OpenGL 4.5 can be used,
+/// which create and edit objects by name instead of binding them first.
+/// The GLWrap classes take this path when it is available.  The version is
+/// looked up once, since the application has a single context.
+GLWRAP_EXPORT inline bool hasDirectStateAccess() {
+#ifdef GL_VERSION_4_5
+  static const bool available = hasGLVersion(4, 5);
+  return available;
+#else
+  return false;
+#endif
+}
+
 NAMESPACE_END(GLWrap)
@@ -0,0 +1,260 @@
+// VertexFormat.hpp
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include <nanogui/opengl.h>
+
+#include "Util.hpp"
+
+namespace GLWrap {
+
+/*
+ * Compile-time descriptions of interleaved vertex layouts.
+ *
+ * A vertex format is a list of attributes, each of which names the
+ * attribute index it is bound to, its component type and its number of
+ * components.  The attributes are packed one after the other in the
+ * order they are listed, and a vertex is the concatenation of all of
+ * them, so the stride and the offset of every attribute are known at
+ * compile time:
+ *
+ *     typedef VertexFormat<
+ *         Attribute<0, float, 3>,                 // position
+ *         Attribute<1, float, 3>,                 // normal
+ *         Attribute<2, int, 4, AttribInteger>     // bone ids
+ *     > MyVertex;
+ *
+ * Mesh::setVertices<MyVertex>(data) then uploads a single buffer and
+ * sets up the VAO with the right strides and offsets.
+ */
+
+// How the shader sees the components of an attribute
+enum AttribMode {
+    AttribFloat,        // converted to float as is (GLSL float/vecN)
+    AttribNormalized,   // fixed point normalized to [0,1] or [-1,1] (GLSL float/vecN)
+    AttribInteger       // kept as integers (GLSL int/ivecN/uint/uvecN)
+};
+
+// The OpenGL type enum that matches a C++ component type
+template <class T> struct GLTypeOf;
+template <> struct GLTypeOf<float>          { static constexpr GLenum value = GL_FLOAT; };
+template <> struct GLTypeOf<int>            { static constexpr GLenum value = GL_INT; };
+template <> struct GLTypeOf<unsigned int>   { static constexpr GLenum value = GL_UNSIGNED_INT; };
+template <> struct GLTypeOf<short>          { static constexpr GLenum value = GL_SHORT; };
+template <> struct GLTypeOf<unsigned short> { static constexpr GLenum value = GL_UNSIGNED_SHORT; };
+template <> struct GLTypeOf<signed char>    { static constexpr GLenum value = GL_BYTE; };
+template <> struct GLTypeOf<unsigned char>  { static constexpr GLenum value = GL_UNSIGNED_BYTE; };
+
+// One attribute of a vertex format
+template <int Location, class T, int N, AttribMode Mode = AttribFloat>
+struct Attribute {
+    static_assert(N >= 1 && N <= 4, "attributes have 1 to 4 components");
+    static_assert((sizeof(T) * N) % 4 == 0, "attributes must keep vertex data 4-byte aligned");
+
+    typedef T Component;
+    static constexpr int location = Location;
+    static constexpr int components = N;
+    static constexpr AttribMode mode = Mode;
+    static constexpr std::size_t size = sizeof(T) * N;
+
+    // Point the attribute at the given offset within vertices of the given stride,
+    // in the currently bound array buffer, and enable it on the bound VAO.
+    static void configure(GLsizei stride, std::size_t offset) {
+        if (Mode == AttribInteger) {
+            glVertexAttribIPointer(Location, N, GLTypeOf<T>::value, stride, (const void *) offset);
+        } else {
+            glVertexAttribPointer(Location, N, GLTypeOf<T>::value,
+                                  Mode == AttribNormalized ? GL_TRUE : GL_FALSE,
+                                  stride, (const void *) offset);
+        }
+        glEnableVertexAttribArray(Location);
+    }
+
+    // Same as configure, on the given VAO and buffer without binding them
+    // (direct state access, see hasDirectStateAccess).  As with
+    // glVertexAttribPointer, the attribute reads through the buffer binding
+    // point of the same index.
+    static void configureArray(GLuint vao, GLuint buffer, GLsizei stride, std::size_t offset) {
+#ifdef GL_VERSION_4_5
+        if (Mode == AttribInteger) {
+            glVertexArrayAttribIFormat(vao, Location, N, GLTypeOf<T>::value, 0);
+        } else {
+            glVertexArrayAttribFormat(vao, Location, N, GLTypeOf<T>::value,
+                                      Mode == AttribNormalized ? GL_TRUE : GL_FALSE, 0);
+        }
+        glVertexArrayAttribBinding(vao, Location, Location);
+        glVertexArrayVertexBuffer(vao, Location, buffer, offset, stride);
+        glEnableVertexArrayAttrib(vao, Location);
+#endif
+    }
+
+    // Advance the attribute once per divisor instances instead of once per vertex
+    // (0 goes back to once per vertex), on the bound VAO.
+    static void setDivisor(GLuint divisor) {
+        glVertexAttribDivisor(Location, divisor);
+    }
+};
+
+// The I-th attribute of a list, and its byte offset within a vertex
+template <int I, class... Attributes> struct AttributeAt;
+
+template <class First, class... Rest>
+struct AttributeAt<0, First, Rest...> {
+    typedef First type;
+    static constexpr std::size_t offset = 0;
+};
+
+template <int I, class First, class... Rest>
+struct AttributeAt<I, First, Rest...> {
+    typedef typename AttributeAt<I - 1, Rest...>::type type;
+    static constexpr std::size_t offset = First::size + AttributeAt<I - 1, Rest...>::offset;
+};
+
+// Sum of the sizes of a list of attributes
+template <class... Attributes> struct AttributeSize;
+
+template <>
+struct AttributeSize<> {
+    static constexpr std::size_t value = 0;
+};
+
+template <class First, class... Rest>
+struct AttributeSize<First, Rest...> {
+    static constexpr std::size_t value = First::size + AttributeSize<Rest...>::value;
+};
+
+// Configures a list of attributes starting at the given offset
+template <class... Attributes> struct AttributeConfig;
+
+template <>
+struct AttributeConfig<> {
+    static void configure(GLsizei, std::size_t) {}
+    static void configureArray(GLuint, GLuint, GLsizei, std::size_t) {}
+    static void setDivisor(GLuint) {}
+};
+
+template <class First, class... Rest>
+struct AttributeConfig<First, Rest...> {
+    static void configure(GLsizei stride, std::size_t offset) {
+        First::configure(stride, offset);
+        AttributeConfig<Rest...>::configure(stride, offset + First::size);
+    }
+    static void configureArray(GLuint vao, GLuint buffer, GLsizei stride, std::size_t offset) {
+        First::configureArray(vao, buffer, stride, offset);
+        AttributeConfig<Rest...>::configureArray(vao, buffer, stride, offset + First::size);
+    }
+    static void setDivisor(GLuint divisor) {
+        First::setDivisor(divisor);
+        AttributeConfig<Rest...>::setDivisor(divisor);
+    }
+};
+
+// An interleaved vertex format made of the given attributes
+template <class... Attributes>
+struct VertexFormat {
+
+    // Size of one vertex in bytes
+    static constexpr std::size_t stride = AttributeSize<Attributes...>::value;
+
+    // Number of attributes in a vertex
+    static constexpr int numAttributes = sizeof...(Attributes);
+
+    // Type and byte offset of the I-th attribute
+    template <int I>
+    using AttributeType = typename AttributeAt<I, Attributes...>::type;
+
+    template <int I>
+    static constexpr std::size_t offset() { return AttributeAt<I, Attributes...>::offset; }
+
+    // Set up all attributes on the bound VAO, reading from the bound array buffer
+    // with the first vertex at the given byte offset.
+    static void configure(std::size_t baseOffset = 0) {
+        AttributeConfig<Attributes...>::configure((GLsizei) stride, baseOffset);
+    }
+
+    // Same as configure, on the given VAO reading from the given buffer,
+    // without binding them (direct state access).
+    static void configureArray(GLuint vao, GLuint buffer, std::size_t baseOffset = 0) {
+        AttributeConfig<Attributes...>::configureArray(vao, buffer, (GLsizei) stride, baseOffset);
+    }
+
+    // Set the instance divisor of all attributes on the bound VAO.
+    // A format used for per-instance data is configured with divisor 1.
+    static void setDivisor(GLuint divisor) {
+        AttributeConfig<Attributes...>::setDivisor(divisor);
+    }
+
+    // Resize the data to hold the given number of vertices.
+    static void resize(std::vector<unsigned char> &data, std::size_t numVertices) {
+        data.assign(numVertices * stride, 0);
+    }
+
+    // Write the I-th attribute of every vertex from the columns of a matrix,
+    // one column per vertex.  The data must already be sized for the vertices.
+    template <int I, class Derived>
+    static void pack(std::vector<unsigned char> &data, const Eigen::MatrixBase<Derived> &values) {
+        typedef AttributeType<I> A;
+        typedef typename A::Component T;
+        static_assert(Derived::RowsAtCompileTime == A::components,
+                      "matrix rows must match the attribute components");
+        const std::size_t off = offset<I>();
+        for (int v = 0; v < values.cols(); v++) {
+            T column[A::components];
+            for (int c = 0; c < A::components; c++) {
+                column[c] = (T) values(c, v);
+            }
+            std::memcpy(&data[v * stride + off], column, A::size);
+        }
+    }
+};
+
+/*
+ * Quantization of attribute values into compact component types.
+ *
+ * Normalized integer attributes (AttribNormalized) are read by the shader
+ * as floats in [0,1] for unsigned types and [-1,1] for signed types,
+ * following the OpenGL conversion rules, so values are encoded here by
+ * scaling to the full range of the integer type and rounding.
+ */
+
+// Encode a value in [0,1] as an unsigned normalized integer
+template <class T>
+inline T quantizeUnorm(float v) {
+    const float maxValue = (float) std::numeric_limits<T>::max();
+    return (T) std::floor(std::min(std::max(v, 0.0f), 1.0f) * maxValue + 0.5f);
+}
+
+// Encode a value in [-1,1] as a signed normalized integer
+template <class T>
+inline T quantizeSnorm(float v) {
+    const float maxValue = (float) std::numeric_limits<T>::max();
+    return (T) std::floor(std::min(std::max(v, -1.0f), 1.0f) * maxValue + 0.5f);
+}
+
+// Map a unit vector to two coordinates in [-1,1] with the octahedral encoding:
+// the vector is projected on the octahedron |x|+|y|+|z| = 1 and the lower
+// half is folded over the upper one.  The shader decodes it with
+//     n = vec3(e, 1 - |e.x| - |e.y|);  if (n.z < 0) n.xy = (1 - |n.yx|) * sign(n.xy);
+inline Eigen::Vector2f octEncode(const Eigen::Vector3f &n) {
+    float l1 = std::abs(n.x()) + std::abs(n.y()) + std::abs(n.z());
+    if (l1 == 0.0f) {
+        return Eigen::Vector2f(0.0f, 0.0f);
+    }
+    Eigen::Vector2f e(n.x() / l1, n.y() / l1);
+    if (n.z() < 0.0f) {
+        e = Eigen::Vector2f((1.0f - std::abs(e.y())) * (e.x() >= 0.0f ? 1.0f : -1.0f),
+                            (1.0f - std::abs(e.x())) * (e.y() >= 0.0f ? 1.0f : -1.0f));
+    }
+    return e;
+}
+
+} // namespace
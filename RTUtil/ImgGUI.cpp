@@ -15,6 +15,7 @@
 #include "GLWrap/Program.hpp"
 #include "GLWrap/Texture2D.hpp"
 #include "GLWrap/Mesh.hpp"
+#include "GLWrap/StateCache.hpp"
 
 namespace RTUtil {
 
@@ -104,6 +105,9 @@ bool ImgGUI::keyboardEvent(int key, int scancode, int action, int modifiers) {
 
 void ImgGUI::drawContents() {
 
+  // The GUI draws between frames behind the back of the state cache
+  GLWrap::StateCache::invalidate();
+
   // Clear (hardly necessary but makes it easier to recognize viewport issues)
   glClearColor(0.0, 0.2, 1.0, 1.0);
   glClear(GL_COLOR_BUFFER_BIT);
@@ -112,8 +116,8 @@ void ImgGUI::drawContents() {
   computeImage();
 
   // Copy image data to OpenGL
-  glBindTexture(GL_TEXTURE_2D, imgTex->id());
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, windowWidth, windowHeight, 0, GL_RGB, GL_FLOAT, img_data.data()); 
+  GLWrap::StateCache::bindTexture(GL_TEXTURE_2D, imgTex->id());
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, windowWidth, windowHeight, GL_RGB, GL_FLOAT, img_data.data()); 
 
   // Set up shader to convert to sRGB and write to default framebuffer
   srgbShader->use();
@@ -124,7 +128,7 @@ void ImgGUI::drawContents() {
   // Set viewport
   Eigen::Vector2i framebufferSize;
   glfwGetFramebufferSize(glfwWindow(), &framebufferSize.x(), &framebufferSize.y());
-  glViewport(0, 0, framebufferSize.x(), framebufferSize.y());
+  GLWrap::StateCache::viewport(0, 0, framebufferSize.x(), framebufferSize.y());
 
   // Draw the full screen quad
   fsqMesh->drawArrays(GL_TRIANGLE_FAN, 0, 4);
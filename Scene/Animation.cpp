@@ -319,7 +319,7 @@ aiVector3D Animation::getInterpolatedScaling(aiNodeAnim* nodeAnim)
 void Animation::loadBones(Node* node) {
     if (node->mNumMeshes > 0) {
         for (int m = 0; m < node->mNumMeshes; m++) {
-            loadBones(node->mMeshes[m]);
+            loadBones(node->mMeshData[m]->mMesh);
         }
     }
 
@@ -353,9 +353,10 @@ void Animation::loadBones(Node* node) {
 }
 
 void Animation::loadVertexBones(Node* node) {
-    if (node->mNumMeshes > 0) {
-        for (int m = 0; m < node->mNumMeshes; m++) {
-            node->loadVertexBones(m, node->mMeshes[m], mBoneNameIds);
+    // the bones of a mesh shared by several nodes are loaded once
+    for (int m = 0; m < node->mNumMeshes; m++) {
+        if (node->ownsMesh(m)) {
+            node->loadVertexBones(m, node->mMeshData[m]->mMesh, mBoneNameIds);
         }
     }
     for (int i = 0; i < node->mNumChildren; i++) {
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Eigen/Core>
+
+/*
+ * The view frustum of a camera as six planes in world space, for culling
+ * bounding spheres.  The planes are taken from the rows of the
+ * view-projection matrix and point into the frustum.
+ */
+class Frustum {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Frustum(const Eigen::Matrix4f& viewProjection) {
+        for (int i = 0; i < 3; i++) {
+            mPlanes[2 * i] = viewProjection.row(3) + viewProjection.row(i);
+            mPlanes[2 * i + 1] = viewProjection.row(3) - viewProjection.row(i);
+        }
+        for (int p = 0; p < 6; p++) {
+            mPlanes[p] /= mPlanes[p].head<3>().norm();
+        }
+    }
+
+    // False if the sphere is entirely outside the frustum
+    bool intersects(const Eigen::Vector3f& center, float radius) const {
+        for (int p = 0; p < 6; p++) {
+            if (mPlanes[p].head<3>().dot(center) + mPlanes[p](3) < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    Eigen::Vector4f mPlanes[6];
+};
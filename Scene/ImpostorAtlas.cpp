@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "ImpostorAtlas.hpp"
+
+//# define DEBUG 1
+
+// Largest side of the atlas, in pixels
+static const int maxAtlasSize = 4096;
+
+/*
+ * Unit direction at the center of cell (i, j) of the octahedral map of the
+ * views, the inverse of GLWrap::octEncode.  Matches viewDirection in impostor.vs.
+ */
+static Eigen::Vector3f viewDirection(int i, int j) {
+    const int n = ImpostorAtlas::numViews;
+    Eigen::Vector2f e((i + 0.5f) / n * 2.0f - 1.0f, (j + 0.5f) / n * 2.0f - 1.0f);
+    Eigen::Vector3f d(e.x(), e.y(), 1.0f - std::abs(e.x()) - std::abs(e.y()));
+    if (d.z() < 0.0f) {
+        d.x() = (1.0f - std::abs(e.y())) * (e.x() >= 0.0f ? 1.0f : -1.0f);
+        d.y() = (1.0f - std::abs(e.x())) * (e.y() >= 0.0f ? 1.0f : -1.0f);
+    }
+    return d.normalized();
+}
+
+/*
+ * Right and up axes of a camera looking along -d.  Matches viewBasis in impostor.vs.
+ */
+static void viewBasis(const Eigen::Vector3f& d, Eigen::Vector3f& right, Eigen::Vector3f& up) {
+    Eigen::Vector3f reference = std::abs(d.y()) < 0.999f ? Eigen::Vector3f(0.0f, 1.0f, 0.0f) : Eigen::Vector3f(0.0f, 0.0f, 1.0f);
+    right = reference.cross(d).normalized();
+    up = d.cross(right);
+}
+
+ImpostorAtlas::ImpostorAtlas(int count, int maxInstances) : mBaking(false) {
+    const int blockSize = numViews * tileSize;
+    const int maxPerRow = maxAtlasSize / blockSize;
+    mCapacity = std::min(std::max(count, 1), maxPerRow * maxPerRow);
+    mPerRow = std::min(mCapacity, maxPerRow);
+    mSize = Eigen::Vector2i(mPerRow * blockSize, (mCapacity + mPerRow - 1) / mPerRow * blockSize);
+
+    // the layout of the G-buffer, read texel by texel: a texel of the
+    // background must not bleed into the edges of the mesh
+    mAtlas.reset(new GLWrap::Framebuffer(mSize, 4));
+    for (int c = 0; c < 4; c++) {
+        mAtlas->colorTexture(c).setParameters(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST);
+    }
+    mAtlas->depthTexture().setParameters(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST);
+
+    // one quad, stretched over the bounding sphere of each object in the shader
+    Eigen::Matrix<float, 2, Eigen::Dynamic> corners(2, 4);
+    corners << -1.0f,  1.0f, 1.0f, -1.0f,
+               -1.0f, -1.0f, 1.0f,  1.0f;
+    std::vector<unsigned char> vertices;
+    ImpostorVertex::resize(vertices, 4);
+    ImpostorVertex::pack<0>(vertices, corners);
+    Eigen::VectorXi indices(6);
+    indices << 0, 1, 2, 0, 2, 3;
+    mQuad.reset(new GLWrap::Mesh());
+    mQuad->setVertices<ImpostorVertex>(vertices);
+    mQuad->setIndices(indices, GL_TRIANGLES);
+
+    mInstances.reset(new GLWrap::StreamBuffer(GL_ARRAY_BUFFER,
+        std::max(1, maxInstances) * ImpostorData::stride));
+
+    #ifdef DEBUG
+        printf("ImpostorAtlas: %dx%d pixels for %d impostors\n", mSize.x(), mSize.y(), mCapacity);
+    #endif
+}
+
+void ImpostorAtlas::beginFrame() {
+    mInstances->beginFrame();
+}
+
+void ImpostorAtlas::endFrame() {
+    mInstances->endFrame();
+}
+
+int ImpostorAtlas::add(int mesh, int material, const Eigen::AlignedBox3f& bounds) {
+    if (size() == mCapacity) {
+        return -1;
+    }
+    Eigen::Vector4f sphere;
+    sphere << bounds.center(), std::max(0.5f * bounds.diagonal().norm(), 1e-6f);
+    mSpheres.push_back(sphere);
+    mImpostors[std::make_pair(mesh, material)] = size() - 1;
+    return size() - 1;
+}
+
+int ImpostorAtlas::find(int mesh, int material) const {
+    std::map<std::pair<int, int>, int>::const_iterator it = mImpostors.find(std::make_pair(mesh, material));
+    return it == mImpostors.end() ? -1 : it->second;
+}
+
+/*
+ * The camera of a view sits on the bounding sphere in the direction of the
+ * view and sees the whole sphere: its orthographic projection maps the
+ * sphere to the tile and its depth, from the near side of the sphere to
+ * the far side, to [0,1].
+ */
+void ImpostorAtlas::bakeView(int k, int v, Eigen::Matrix4f& view, Eigen::Matrix4f& projection) {
+    if (!mBaking) {
+        mAtlas->bind(0);
+        GLenum attachments[4] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3};
+        glDrawBuffers(4, attachments);
+        GLWrap::StateCache::viewport(0, 0, mSize.x(), mSize.y());
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        mBaking = true;
+    }
+
+    int i = v % numViews;
+    int j = v / numViews;
+    Eigen::Vector3f center = mSpheres[k].head<3>();
+    float radius = mSpheres[k](3);
+    Eigen::Vector3f d = viewDirection(i, j);
+    Eigen::Vector3f right, up;
+    viewBasis(d, right, up);
+    Eigen::Vector3f eye = center + radius * d;
+
+    view = Eigen::Matrix4f::Identity();
+    view.row(0) << right.transpose(), -right.dot(eye);
+    view.row(1) << up.transpose(), -up.dot(eye);
+    view.row(2) << d.transpose(), -d.dot(eye);
+
+    projection = Eigen::Matrix4f::Zero();
+    projection(0, 0) = 1.0f / radius;
+    projection(1, 1) = 1.0f / radius;
+    projection(2, 2) = -1.0f / radius;
+    projection(2, 3) = -1.0f;
+    projection(3, 3) = 1.0f;
+
+    GLWrap::StateCache::viewport(((k % mPerRow) * numViews + i) * tileSize, ((k / mPerRow) * numViews + j) * tileSize, tileSize, tileSize);
+}
+
+void ImpostorAtlas::endBake() {
+    if (mBaking) {
+        mAtlas->unbind();
+        mBaking = false;
+    }
+    GLWrap::checkGLError("ImpostorAtlas::endBake end");
+}
+
+void ImpostorAtlas::instance(int k, const Eigen::Matrix4f& model) {
+    ImpostorRecord record;
+    Eigen::Map<Eigen::Matrix4f>(record.model) = model;
+    Eigen::Map<Eigen::Vector4f>(record.sphere) = mSpheres[k];
+    record.impostor = k;
+    Eigen::Map<Eigen::Matrix3f>(record.normal) = model.topLeftCorner<3, 3>().inverse().transpose();
+    mRecords.push_back(record);
+}
+
+/*
+ * Stream the records of the impostors given since the last draw and draw
+ * them all with one instanced draw of the quad.
+ */
+void ImpostorAtlas::draw(GLWrap::Program& prog, int firstUnit) {
+    if (mRecords.empty()) {
+        return;
+    }
+
+    // the old buffer is released once the GPU is done with it
+    std::size_t bytes = mRecords.size() * ImpostorData::stride;
+    if (!mInstances->fits(bytes)) {
+        mInstances.reset(new GLWrap::StreamBuffer(GL_ARRAY_BUFFER, std::max(2 * mInstances->frameSize(), 2 * bytes)));
+    }
+    GLintptr offset = mInstances->write(mRecords.data(), bytes);
+    mInstances->flush();
+
+    static const char* names[4] = { "atlasNormal", "atlasDiffuse_r", "atlasAlpha", "atlasConvert" };
+    for (int c = 0; c < 4; c++) {
+        mAtlas->colorTexture(c).bindToTextureUnit(firstUnit + c);
+        GLWrap::Sampler::unbind(firstUnit + c);
+        prog.uniform(names[c], firstUnit + c);
+    }
+    mAtlas->depthTexture().bindToTextureUnit(firstUnit + 4);
+    GLWrap::Sampler::unbind(firstUnit + 4);
+    prog.uniform("atlasDepth", firstUnit + 4);
+    prog.uniform("numViews", numViews);
+    prog.uniform("tileSize", tileSize);
+    prog.uniform("impostorsPerRow", mPerRow);
+    prog.uniform("tileScale", Eigen::Vector2f(tileSize / (float) mSize.x(), tileSize / (float) mSize.y()));
+
+    mQuad->bind();
+    mQuad->setInstanceVertices<ImpostorData>(*mInstances, offset);
+    mQuad->drawElementsInstancedBaseVertex(0, 6, 0, mRecords.size());
+    GLWrap::Mesh::unbind();
+
+    mRecords.clear();
+}
+
+void ImpostorAtlas::printStats() const {
+    // four RGBA8 color textures and a 24-bit depth texture, padded to 32 bits
+    std::size_t bytes = (std::size_t) mSize.x() * mSize.y() * (4 * 4 + 4);
+    printf("\t%d impostors of %d views, %dx%d atlas, %.1f KB\n",
+        size(), numViews * numViews, mSize.x(), mSize.y(), bytes / 1024.0);
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <GLWrap/Framebuffer.hpp>
+#include <GLWrap/Mesh.hpp>
+#include <GLWrap/Program.hpp>
+#include <GLWrap/Sampler.hpp>
+#include <GLWrap/StateCache.hpp>
+#include <GLWrap/StreamBuffer.hpp>
+
+#include <Eigen/Geometry>
+
+#include "VertexFormats.hpp"
+
+/*
+ * Billboard impostors of the meshes of the scene, drawn instead of the
+ * meshes of the objects far enough from the camera.
+ *
+ * Each impostor is a mesh rendered once with a material, offline, from
+ * numViews x numViews directions around its bounding sphere with an
+ * orthographic camera.  The directions are the centers of the cells of an
+ * octahedral map of the sphere of directions (the encoding of the
+ * compressed normals, see GLWrap::octEncode), so the view of any direction
+ * is found by encoding it.  The views are rendered by the geometry pass
+ * program into the tiles of an atlas with the layout of the G-buffer:
+ * normals in model space, diffuse reflectance, microfacet parameters, and
+ * a depth texture, linear in the orthographic views.
+ *
+ * An object drawn as an impostor is a quad facing the camera, through the
+ * center of its bounding sphere and as wide as it.  Its fragments read the
+ * tile of the view nearest to the direction of the camera, and write the
+ * G-buffer: the normal turned to world space, the material as baked, and
+ * the depth of the surface point seen in the tile, so that the lighting
+ * passes and the shadow map lookups find the surface where the mesh is.
+ *
+ * Use:
+ *     ImpostorAtlas atlas(count, maxInstances);
+ *     for every impostor: int k = atlas.add(mesh, material, bounds);
+ *         for every view v: atlas.bakeView(k, v, view, projection); draw the mesh ...
+ *     atlas.endBake();
+ * and per frame, in the geometry pass:
+ *     atlas.instance(k, model); ...
+ *     atlas.draw(prog, firstUnit);
+ */
+class ImpostorAtlas {
+public:
+
+    // Number of view directions along each side of the octahedral map
+    static const int numViews = 4;
+
+    // Size of the tile of one view, in pixels
+    static const int tileSize = 64;
+
+    // Make an atlas with room for count impostors, as many as fit in the
+    // largest atlas.  maxInstances is the number of objects expected per
+    // frame; the instance buffer grows when a frame has more.
+    ImpostorAtlas(int count, int maxInstances);
+
+    // Start and end a frame; the impostors of a frame are drawn between them.
+    void beginFrame();
+    void endFrame();
+
+    // Reserve an impostor of the given mesh of the store (see
+    // MeshStore::meshId) drawn with the given material, whose bounds in
+    // model space are given.  Returns the impostor, or -1 if the atlas is full.
+    int add(int mesh, int material, const Eigen::AlignedBox3f& bounds);
+
+    // The impostor of a mesh with a material, -1 if it has none
+    int find(int mesh, int material) const;
+
+    // Number of impostors in the atlas
+    int size() const { return mSpheres.size(); }
+
+    // Bind the atlas and set the viewport to render view v of impostor k
+    // into its tile, and return the view and projection matrices of the view,
+    // with the mesh at its place in model space.  The first view baked
+    // clears the atlas.
+    void bakeView(int k, int v, Eigen::Matrix4f& view, Eigen::Matrix4f& projection);
+
+    // Unbind the atlas once every view is rendered
+    void endBake();
+
+    // Draw impostor k in the next draw() with the given model transformation
+    void instance(int k, const Eigen::Matrix4f& model);
+
+    // Number of impostors to draw in the next draw()
+    int numInstances() const { return mRecords.size(); }
+
+    // Draw the impostors given by instance() since the last draw, with the
+    // impostor program, into the G-buffer bound for the geometry pass.
+    // The atlas textures are bound to the units from firstUnit on.
+    void draw(GLWrap::Program& prog, int firstUnit);
+
+    // Print the number of impostors and the memory used by the atlas
+    void printStats() const;
+
+private:
+
+    // size of the atlas in pixels, impostors per row and in all
+    Eigen::Vector2i mSize;
+    int mPerRow;
+    int mCapacity;
+
+    // the bounding sphere of each impostor in model space, and the impostor
+    // of each (mesh, material)
+    std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f>> mSpheres;
+    std::map<std::pair<int, int>, int> mImpostors;
+
+    std::unique_ptr<GLWrap::Framebuffer> mAtlas;
+    bool mBaking;
+
+    // the quad of the impostors and the per-object records of the frame
+    std::unique_ptr<GLWrap::Mesh> mQuad;
+    std::vector<ImpostorRecord> mRecords;
+    std::unique_ptr<GLWrap::StreamBuffer> mInstances;
+};
@@ -22,16 +22,21 @@ int main(int argc, char *argv[])  {
 
     int opt;
     std::string skybox_name = "rainbow";
-    while((opt = getopt(argc, argv, "hs:")) != -1)  
+    bool compress_vertices = false;
+    float impostor_distance = 0.0f;
+    while((opt = getopt(argc, argv, "hci:s:")) != -1)  
     {  
         switch(opt)  
         {  
             case 'h':  
                 printf("Rasterization input formats:\n");
-                printf("   Scene -s [skybox_name] [obj_or_dae_file] [scene_info_file]\n");
+                printf("   Scene -c -i [distance] -s [skybox_name] [obj_or_dae_file] [scene_info_file]\n");
                 printf("\n");
                 printf("\t-s specifies the skybox name.\n");
                 printf("\t   Skybox files are located under the Scene/skybox_files directory.\n");
+                printf("\t-c compresses the vertex data (quantized positions and normals, 8-bit bone data).\n");
+                printf("\t-i draws the objects farther than distance from the camera as impostors\n");
+                printf("\t   in deferred rendering.\n");
                 printf("\tThe default input file is bunnyscene.dae in the current directory.\n");
                 printf("\tThe default scene info file is bunnyscene_info.json in the current directory.\n");  
                 printf("\n");
@@ -48,6 +53,12 @@ int main(int argc, char *argv[])  {
             case 's':
                 skybox_name = optarg;
                 break;
+            case 'c':
+                compress_vertices = true;
+                break;
+            case 'i':
+                impostor_distance = atof(optarg);
+                break;
         }  
     }
  
@@ -73,7 +84,7 @@ int main(int argc, char *argv[])  {
     printf("The input file name is: %s\n", input_file.c_str());
     printf("The scene info file name is: %s\n", info_file.c_str());
     printf("The skybox files are named: %s\n", skybox_name.c_str());
-    nanogui::ref<SceneApp> app = new SceneApp(input_file, info_file, skybox_name);
+    nanogui::ref<SceneApp> app = new SceneApp(input_file, info_file, skybox_name, compress_vertices, impostor_distance);
     nanogui::mainloop(16);        
     nanogui::shutdown();
 }
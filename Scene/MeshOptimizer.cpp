@@ -0,0 +1,716 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <queue>
+#include <unordered_map>
+
+#include "MeshOptimizer.hpp"
+
+//# define DEBUG 1
+
+// Hash key of a grid cell; distinct cells may share a key, which only
+// costs extra comparisons
+static unsigned long long cellKey(const Eigen::Vector3f& cell) {
+    unsigned long long key = 0;
+    for (int c = 0; c < 3; c++) {
+        key = key * 0x1fffff + (unsigned long long) (long long) cell(c);
+    }
+    return key;
+}
+
+/*
+ * Spatial hashing: every kept vertex is filed under the grid cell of side
+ * positionTolerance holding it, so a vertex only needs to be compared with
+ * the kept vertices of the 27 cells around its own.  Vertices are visited in
+ * order and each is merged into the first kept vertex that matches.
+ */
+std::vector<int> MeshOptimizer::weldVertices(Eigen::VectorXi& indices,
+    const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions,
+    const Eigen::Matrix<float, 3, Eigen::Dynamic>& normals,
+    float positionTolerance, float normalTolerance, const std::vector<int>& groups, int& vertexCount) {
+    int numVertices = positions.cols();
+
+    // cells no smaller than a millionth of the largest coordinate, so that
+    // their coordinates fit in cellKey even when the tolerance is 0 (a
+    // collapsed mesh); a cell larger than the tolerance only costs extra
+    // comparisons
+    float extent = numVertices > 0 ? positions.cwiseAbs().maxCoeff() : 0.0f;
+    float cellSize = std::max(std::max(positionTolerance, 1e-6f * extent), 1e-20f);
+
+    std::unordered_map<unsigned long long, std::vector<int> > cells;
+    std::vector<int> kept;
+    std::vector<int> remap(numVertices);
+    for (int v = 0; v < numVertices; v++) {
+        Eigen::Vector3f cell = (positions.col(v) / cellSize).array().floor();
+        int match = -1;
+        for (int n = 0; n < 27 && match < 0; n++) {
+            Eigen::Vector3f neighbour = cell + Eigen::Vector3f(n % 3 - 1, n / 3 % 3 - 1, n / 9 - 1);
+            std::unordered_map<unsigned long long, std::vector<int> >::const_iterator it = cells.find(cellKey(neighbour));
+            if (it == cells.end()) {
+                continue;
+            }
+            for (int k = 0; k < it->second.size(); k++) {
+                int u = it->second[k];
+                if ((positions.col(u) - positions.col(v)).norm() <= positionTolerance &&
+                    normals.col(u).dot(normals.col(v)) >= normalTolerance &&
+                    (groups.empty() || groups[u] == groups[v])) {
+                    match = u;
+                    break;
+                }
+            }
+        }
+
+        if (match >= 0) {
+            remap[v] = remap[match];
+            continue;
+        }
+        remap[v] = kept.size();
+        kept.push_back(v);
+        cells[cellKey(cell)].push_back(v);
+    }
+    vertexCount = kept.size();
+
+    int numIndices = 0;
+    for (int t = 0; t < indices.size() / 3; t++) {
+        int i0 = remap[indices(3 * t)], i1 = remap[indices(3 * t + 1)], i2 = remap[indices(3 * t + 2)];
+        if (i0 == i1 || i1 == i2 || i2 == i0) {
+            continue;
+        }
+        indices(numIndices++) = i0;
+        indices(numIndices++) = i1;
+        indices(numIndices++) = i2;
+    }
+    indices.conservativeResize(numIndices);
+
+    #ifdef DEBUG
+        printf("MeshOptimizer: welded %d vertices into %d\n", numVertices, vertexCount);
+    #endif
+    return remap;
+}
+
+/*
+ * Count the cache misses of the triangles with a FIFO cache: a vertex is
+ * in the cache if fewer than cacheSize vertices were shaded since it was.
+ */
+float MeshOptimizer::acmr(const Eigen::VectorXi& indices, int vertexCount, int cacheSize) {
+    int numTriangles = indices.size() / 3;
+    if (numTriangles == 0) {
+        return 0.0f;
+    }
+
+    std::vector<int> shadedAt(vertexCount, -cacheSize - 1);
+    int misses = 0;
+    for (int i = 0; i < indices.size(); i++) {
+        int v = indices(i);
+        if (misses - shadedAt[v] > cacheSize) {
+            shadedAt[v] = misses;
+            misses++;
+        }
+    }
+    return (float) misses / numTriangles;
+}
+
+/*
+ * Tipsify: fan around a vertex, emitting all its triangles, then move on
+ * to the vertex of those triangles that is most likely still in the cache
+ * once its remaining triangles are emitted.  When no such vertex is left
+ * (a dead end), continue with the most recently used vertex that still has
+ * triangles, or the next one in input order.
+ */
+void MeshOptimizer::optimizeVertexCache(Eigen::VectorXi& indices, int vertexCount, std::vector<int>& clusters,
+    int cacheSize) {
+    int numTriangles = indices.size() / 3;
+    clusters.clear();
+    if (numTriangles == 0) {
+        return;
+    }
+
+    // triangles using each vertex, in a compressed adjacency list
+    std::vector<int> live(vertexCount, 0);
+    for (int i = 0; i < indices.size(); i++) {
+        live[indices(i)]++;
+    }
+    std::vector<int> firstTriangle(vertexCount + 1, 0);
+    for (int v = 0; v < vertexCount; v++) {
+        firstTriangle[v + 1] = firstTriangle[v] + live[v];
+    }
+    std::vector<int> adjacency(indices.size());
+    std::vector<int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (int i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices(i)]++] = i / 3;
+    }
+
+    std::vector<int> timeStamp(vertexCount, 0);
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<int> deadEnd;
+    std::vector<int> candidates;
+    Eigen::VectorXi output(indices.size());
+    int numOutput = 0;
+
+    int stamp = cacheSize + 1;
+    int cursor = 0;
+    int fan = 0;
+    clusters.push_back(0);
+    while (fan >= 0) {
+        candidates.clear();
+        for (int a = firstTriangle[fan]; a < firstTriangle[fan + 1]; a++) {
+            int t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+            for (int c = 0; c < 3; c++) {
+                int v = indices(3 * t + c);
+                output(numOutput++) = v;
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (stamp - timeStamp[v] > cacheSize) {
+                    timeStamp[v] = stamp++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // the candidate that will still be in the cache after its own triangles, oldest first
+        int next = -1;
+        int best = -1;
+        for (int i = 0; i < candidates.size(); i++) {
+            int v = candidates[i];
+            if (live[v] > 0) {
+                int priority = 0;
+                if (stamp - timeStamp[v] + 2 * live[v] <= cacheSize) {
+                    priority = stamp - timeStamp[v];
+                }
+                if (priority > best) {
+                    best = priority;
+                    next = v;
+                }
+            }
+        }
+
+        if (next == -1) {
+            // dead end: a recent vertex with triangles left, else the next in input order
+            while (!deadEnd.empty() && next == -1) {
+                int v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0) {
+                    next = v;
+                }
+            }
+            while (cursor < vertexCount && next == -1) {
+                if (live[cursor] > 0) {
+                    next = cursor;
+                }
+                cursor++;
+            }
+            if (next != -1 && numOutput / 3 > clusters.back()) {
+                clusters.push_back(numOutput / 3);
+            }
+        }
+        fan = next;
+    }
+
+    indices = output;
+
+    #ifdef DEBUG
+        printf("MeshOptimizer: %d triangles, %d dead ends\n", numTriangles, (int) clusters.size() - 1);
+    #endif
+}
+
+/*
+ * Merge the clusters until each is as cache efficient on its own as the
+ * whole mesh within threshold, then sort them by how much they face away
+ * from the center of the mesh: dot(cluster centroid - mesh centroid,
+ * cluster normal), largest first.  Centroids and normals are area weighted.
+ */
+void MeshOptimizer::optimizeOverdraw(Eigen::VectorXi& indices, const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions,
+    const std::vector<int>& clusters, float threshold, int cacheSize) {
+    int numTriangles = indices.size() / 3;
+    if (numTriangles == 0 || clusters.size() < 2) {
+        return;
+    }
+    float target = acmr(indices, positions.cols(), cacheSize) * threshold;
+
+    // grow each cluster over the dead ends until its own ACMR is low enough,
+    // simulating the cache from the start of the cluster
+    std::vector<int> shadedAt(positions.cols(), -1);
+    int misses = 0;
+    int base = 0;       // misses before the start of the current cluster
+    int boundary = 1;
+    std::vector<int> starts(1, 0);
+    for (int t = 0; t < numTriangles; t++) {
+        if (boundary < clusters.size() && clusters[boundary] == t) {
+            if ((float) (misses - base) / (t - starts.back()) <= target) {
+                starts.push_back(t);
+                base = misses;
+            }
+            boundary++;
+        }
+        for (int c = 0; c < 3; c++) {
+            int v = indices(3 * t + c);
+            if (shadedAt[v] < base || misses - shadedAt[v] > cacheSize) {
+                shadedAt[v] = misses;
+                misses++;
+            }
+        }
+    }
+    starts.push_back(numTriangles);
+
+    Eigen::Vector3f meshCentroid = Eigen::Vector3f::Zero();
+    float meshArea = 0.0f;
+    std::vector<std::pair<float, int> > order;
+    std::vector<Eigen::Vector3f> centroids(starts.size() - 1);
+    std::vector<Eigen::Vector3f> normals(starts.size() - 1);
+    for (int c = 0; c + 1 < starts.size(); c++) {
+        Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+        Eigen::Vector3f normal = Eigen::Vector3f::Zero();
+        float area = 0.0f;
+        for (int t = starts[c]; t < starts[c + 1]; t++) {
+            Eigen::Vector3f p0 = positions.col(indices(3 * t));
+            Eigen::Vector3f p1 = positions.col(indices(3 * t + 1));
+            Eigen::Vector3f p2 = positions.col(indices(3 * t + 2));
+            Eigen::Vector3f n = (p1 - p0).cross(p2 - p0);   // twice the area
+            float a = n.norm();
+            centroid += a * (p0 + p1 + p2) / 3.0f;
+            normal += n;
+            area += a;
+        }
+        meshCentroid += centroid;
+        meshArea += area;
+        centroids[c] = area > 0.0f ? Eigen::Vector3f(centroid / area) : Eigen::Vector3f(positions.col(indices(3 * starts[c])));
+        normals[c] = normal.normalized();
+    }
+    if (meshArea > 0.0f) {
+        meshCentroid /= meshArea;
+    }
+    for (int c = 0; c + 1 < starts.size(); c++) {
+        order.push_back(std::make_pair(-(centroids[c] - meshCentroid).dot(normals[c]), c));
+    }
+    std::stable_sort(order.begin(), order.end());
+
+    Eigen::VectorXi output(indices.size());
+    int numOutput = 0;
+    for (int i = 0; i < order.size(); i++) {
+        int c = order[i].second;
+        int count = 3 * (starts[c + 1] - starts[c]);
+        output.segment(numOutput, count) = indices.segment(3 * starts[c], count);
+        numOutput += count;
+    }
+    indices = output;
+
+    #ifdef DEBUG
+        printf("MeshOptimizer: %d clusters sorted for overdraw\n", (int) order.size());
+    #endif
+}
+
+/*
+ * Number the vertices in the order the triangles first reference them.
+ */
+std::vector<int> MeshOptimizer::optimizeVertexFetch(Eigen::VectorXi& indices, int vertexCount) {
+    std::vector<int> remap(vertexCount, -1);
+    int next = 0;
+    for (int i = 0; i < indices.size(); i++) {
+        int& v = remap[indices(i)];
+        if (v == -1) {
+            v = next++;
+        }
+        indices(i) = v;
+    }
+    for (int v = 0; v < vertexCount; v++) {
+        if (remap[v] == -1) {
+            remap[v] = next++;
+        }
+    }
+    return remap;
+}
+
+/*
+ * Number the distinct positions: point receives the number of the position
+ * of each vertex, and members the vertices at each position.
+ */
+static void mergePositions(const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions,
+    std::vector<int>& point, std::vector<std::vector<int> >& members) {
+    int numVertices = positions.cols();
+    std::vector<int> sorted(numVertices);
+    for (int v = 0; v < numVertices; v++) {
+        sorted[v] = v;
+    }
+    std::sort(sorted.begin(), sorted.end(), [&positions](int u, int v) {
+        for (int c = 0; c < 3; c++) {
+            if (positions(c, u) != positions(c, v)) {
+                return positions(c, u) < positions(c, v);
+            }
+        }
+        return u < v;
+    });
+
+    point.resize(numVertices);
+    members.clear();
+    for (int i = 0; i < numVertices; i++) {
+        int v = sorted[i];
+        if (i == 0 || positions.col(v) != positions.col(sorted[i - 1])) {
+            members.push_back(std::vector<int>());
+        }
+        point[v] = members.size() - 1;
+        members.back().push_back(v);
+    }
+}
+
+// Error quadric of a plane, or a sum of them: the squared distance of point p
+// to the planes is [p 1] Q [p 1]^T
+typedef Eigen::Matrix4d Quadric;
+
+static Quadric planeQuadric(const Eigen::Vector3d& n, double d, double weight) {
+    Eigen::Vector4d p(n(0), n(1), n(2), d);
+    return weight * p * p.transpose();
+}
+
+static double quadricError(const Quadric& q, const Eigen::Vector3f& p) {
+    Eigen::Vector4d v(p(0), p(1), p(2), 1.0);
+    return v.dot(q * v);
+}
+
+// An edge to collapse: vertex a moves onto vertex b.  Entries of the queue
+// go stale when either vertex changes; stamps tell them apart.
+struct Collapse {
+    double cost;
+    int a, b;
+    unsigned int stampA, stampB;
+    bool operator<(const Collapse& other) const { return cost > other.cost; }
+};
+
+/*
+ * Edge collapse on the mesh with the vertices at the same position merged.
+ * Every vertex has the quadric of the planes of its triangles (weighted by
+ * area), plus planes perpendicular to its boundary edges to keep the
+ * boundaries in place.  The cheapest collapse of a vertex onto a neighbour
+ * is done first, unless it would flip a triangle.
+ */
+std::vector<Eigen::VectorXi> MeshOptimizer::simplify(const Eigen::VectorXi& indices,
+    const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions,
+    const Eigen::Matrix<float, 3, Eigen::Dynamic>& normals, const std::vector<int>& targets) {
+    // weight of the boundary planes relative to the triangle planes
+    const double boundaryWeight = 10.0;
+    // smallest cosine between the normals of a triangle before and after a collapse
+    const float minCosine = 0.2f;
+
+    std::vector<Eigen::VectorXi> levels;
+    int numTriangles = indices.size() / 3;
+    if (numTriangles == 0 || targets.empty()) {
+        return levels;
+    }
+
+    // merge the vertices at the same position into one point
+    std::vector<int> point;
+    std::vector<std::vector<int> > members;
+    mergePositions(positions, point, members);
+    int numPoints = members.size();
+    std::vector<Eigen::Vector3f> location(numPoints);
+    for (int p = 0; p < numPoints; p++) {
+        location[p] = positions.col(members[p][0]);
+    }
+
+    // triangles over the points, and the triangles around each point
+    std::vector<int> corners(3 * numTriangles);
+    std::vector<bool> live(numTriangles, true);
+    std::vector<std::vector<int> > around(numPoints);
+    int numLive = 0;
+    for (int t = 0; t < numTriangles; t++) {
+        for (int c = 0; c < 3; c++) {
+            corners[3 * t + c] = point[indices(3 * t + c)];
+        }
+        int* p = &corners[3 * t];
+        if (p[0] == p[1] || p[1] == p[2] || p[2] == p[0]) {
+            live[t] = false;
+            continue;
+        }
+        numLive++;
+        for (int c = 0; c < 3; c++) {
+            around[p[c]].push_back(t);
+        }
+    }
+
+    // quadrics of the triangle planes, and of the boundary edges
+    std::vector<Quadric, Eigen::aligned_allocator<Quadric> > quadrics(numPoints, Quadric::Zero());
+    std::vector<std::pair<std::pair<int, int>, int> > edges;
+    for (int t = 0; t < numTriangles; t++) {
+        if (!live[t]) {
+            continue;
+        }
+        const int* p = &corners[3 * t];
+        Eigen::Vector3d p0 = location[p[0]].cast<double>();
+        Eigen::Vector3d n = (location[p[1]] - location[p[0]]).cross(location[p[2]] - location[p[0]]).cast<double>();
+        double area = n.norm();
+        if (area == 0.0) {
+            continue;
+        }
+        n /= area;
+        Quadric q = planeQuadric(n, -n.dot(p0), area);
+        for (int c = 0; c < 3; c++) {
+            quadrics[p[c]] += q;
+            int u = p[c], v = p[(c + 1) % 3];
+            edges.push_back(std::make_pair(std::make_pair(std::min(u, v), std::max(u, v)), t));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (int i = 0; i < edges.size(); i++) {
+        bool shared = (i > 0 && edges[i - 1].first == edges[i].first) ||
+                      (i + 1 < edges.size() && edges[i + 1].first == edges[i].first);
+        if (shared) {
+            continue;
+        }
+        int u = edges[i].first.first, v = edges[i].first.second, t = edges[i].second;
+        const int* p = &corners[3 * t];
+        Eigen::Vector3d e = (location[v] - location[u]).cast<double>();
+        Eigen::Vector3d n = (location[p[1]] - location[p[0]]).cross(location[p[2]] - location[p[0]]).cast<double>();
+        Eigen::Vector3d side = e.cross(n);
+        if (side.norm() == 0.0) {
+            continue;
+        }
+        side.normalize();
+        Quadric q = planeQuadric(side, -side.dot(location[u].cast<double>()), boundaryWeight * e.squaredNorm());
+        quadrics[u] += q;
+        quadrics[v] += q;
+    }
+
+    std::vector<bool> alive(numPoints, true);
+    std::vector<unsigned int> stamp(numPoints, 0);
+    std::priority_queue<Collapse> queue;
+
+    // queue the cheaper direction of the collapse of edge u-v
+    auto push = [&](int u, int v) {
+        Quadric q = quadrics[u] + quadrics[v];
+        double toV = quadricError(q, location[v]);
+        double toU = quadricError(q, location[u]);
+        Collapse collapse;
+        collapse.cost = std::min(toU, toV);
+        collapse.a = toV <= toU ? u : v;
+        collapse.b = toV <= toU ? v : u;
+        collapse.stampA = stamp[collapse.a];
+        collapse.stampB = stamp[collapse.b];
+        queue.push(collapse);
+    };
+    for (int i = 0; i < edges.size(); i++) {
+        if (i == 0 || edges[i - 1].first != edges[i].first) {
+            push(edges[i].first.first, edges[i].first.second);
+        }
+    }
+
+    // the triangles left, each corner on the vertex at its point with the closest normal
+    auto emit = [&]() {
+        Eigen::VectorXi level(3 * numLive);
+        int n = 0;
+        for (int t = 0; t < numTriangles; t++) {
+            if (!live[t]) {
+                continue;
+            }
+            for (int c = 0; c < 3; c++) {
+                int original = indices(3 * t + c);
+                int p = corners[3 * t + c];
+                int best = original;
+                if (point[original] != p) {
+                    float bestCosine = -2.0f;
+                    for (int i = 0; i < members[p].size(); i++) {
+                        float cosine = normals.col(original).dot(normals.col(members[p][i]));
+                        if (cosine > bestCosine) {
+                            bestCosine = cosine;
+                            best = members[p][i];
+                        }
+                    }
+                }
+                level(n++) = best;
+            }
+        }
+        levels.push_back(level);
+    };
+
+    std::vector<int> neighbourMark(numPoints, -1);
+    int next = 0;
+    while (next < targets.size() && !queue.empty()) {
+        if (numLive <= targets[next]) {
+            emit();
+            next++;
+            continue;
+        }
+
+        Collapse collapse = queue.top();
+        queue.pop();
+        int a = collapse.a, b = collapse.b;
+        if (!alive[a] || !alive[b] || stamp[a] != collapse.stampA || stamp[b] != collapse.stampB) {
+            continue;
+        }
+
+        // reject the collapse if a triangle around a would flip or become a sliver
+        bool flips = false;
+        bool adjacent = false;
+        for (int i = 0; i < around[a].size() && !flips; i++) {
+            int t = around[a][i];
+            if (!live[t]) {
+                continue;
+            }
+            const int* p = &corners[3 * t];
+            if (p[0] == b || p[1] == b || p[2] == b) {
+                adjacent = true;
+                continue;
+            }
+            Eigen::Vector3f q[3], r[3];
+            for (int c = 0; c < 3; c++) {
+                q[c] = location[p[c]];
+                r[c] = p[c] == a ? location[b] : q[c];
+            }
+            Eigen::Vector3f before = (q[1] - q[0]).cross(q[2] - q[0]);
+            Eigen::Vector3f after = (r[1] - r[0]).cross(r[2] - r[0]);
+            if (after.dot(before) < minCosine * after.norm() * before.norm()) {
+                flips = true;
+            }
+        }
+        if (flips || !adjacent) {
+            continue;
+        }
+
+        // move a onto b: the triangles on edge a-b disappear, the others follow
+        for (int i = 0; i < around[a].size(); i++) {
+            int t = around[a][i];
+            if (!live[t]) {
+                continue;
+            }
+            int* p = &corners[3 * t];
+            if (p[0] == b || p[1] == b || p[2] == b) {
+                live[t] = false;
+                numLive--;
+                continue;
+            }
+            for (int c = 0; c < 3; c++) {
+                if (p[c] == a) {
+                    p[c] = b;
+                }
+            }
+            around[b].push_back(t);
+        }
+        around[a].clear();
+        alive[a] = false;
+        quadrics[b] += quadrics[a];
+        stamp[b]++;
+
+        // drop the dead triangles around b and queue its edges again
+        std::vector<int> kept;
+        for (int i = 0; i < around[b].size(); i++) {
+            int t = around[b][i];
+            if (!live[t]) {
+                continue;
+            }
+            kept.push_back(t);
+            for (int c = 0; c < 3; c++) {
+                int v = corners[3 * t + c];
+                if (v != b && neighbourMark[v] != collapse.a) {
+                    neighbourMark[v] = collapse.a;
+                    push(b, v);
+                }
+            }
+        }
+        around[b].swap(kept);
+    }
+
+    // the targets that could not be reached get what is left, if it is simpler
+    if (next < targets.size() && (levels.empty() ? numTriangles : levels.back().size() / 3) > numLive) {
+        emit();
+    }
+
+    #ifdef DEBUG
+        printf("MeshOptimizer: %d triangles simplified to %d levels\n", numTriangles, (int) levels.size());
+    #endif
+
+    return levels;
+}
+
+/*
+ * Cut the triangles into runs of maxTriangles.  The sphere of a meshlet is
+ * centered on the center of its bounding box; the cone axis is the average
+ * of the triangle normals, and the cone is as wide as the normal furthest
+ * from it.  A cone of 90 degrees or more is not usable (coneCutoff 1).
+ */
+std::vector<Meshlet> MeshOptimizer::buildMeshlets(const Eigen::VectorXi& indices,
+    const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions, int maxTriangles) {
+    std::vector<Meshlet> meshlets;
+    int numTriangles = indices.size() / 3;
+    for (int first = 0; first < numTriangles; first += maxTriangles) {
+        int last = std::min(first + maxTriangles, numTriangles);
+
+        Eigen::AlignedBox3f box;
+        Eigen::Vector3f axis = Eigen::Vector3f::Zero();
+        std::vector<Eigen::Vector3f> normals;
+        for (int t = first; t < last; t++) {
+            Eigen::Vector3f p0 = positions.col(indices(3 * t));
+            Eigen::Vector3f p1 = positions.col(indices(3 * t + 1));
+            Eigen::Vector3f p2 = positions.col(indices(3 * t + 2));
+            box.extend(p0);
+            box.extend(p1);
+            box.extend(p2);
+            Eigen::Vector3f n = (p1 - p0).cross(p2 - p0);
+            if (n.norm() > 0.0f) {
+                normals.push_back(n.normalized());
+                axis += normals.back();
+            }
+        }
+
+        Meshlet meshlet;
+        meshlet.firstIndex = 3 * first;
+        meshlet.indexCount = 3 * (last - first);
+        meshlet.center = box.center();
+        meshlet.radius = 0.0f;
+        for (int i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++) {
+            meshlet.radius = std::max(meshlet.radius, (positions.col(indices(i)) - meshlet.center).norm());
+        }
+
+        meshlet.coneAxis = axis.norm() > 0.0f ? Eigen::Vector3f(axis.normalized()) : Eigen::Vector3f::UnitZ();
+        float minCosine = normals.empty() ? -1.0f : 1.0f;
+        for (int i = 0; i < normals.size(); i++) {
+            minCosine = std::min(minCosine, normals[i].dot(meshlet.coneAxis));
+        }
+        meshlet.coneCutoff = minCosine > 0.0f ? std::sqrt(1.0f - minCosine * minCosine) : 1.0f;
+        meshlets.push_back(meshlet);
+    }
+    return meshlets;
+}
+
+bool MeshOptimizer::isClosed(const Eigen::VectorXi& indices, const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions) {
+    std::vector<int> point;
+    std::vector<std::vector<int> > members;
+    mergePositions(positions, point, members);
+
+    // degenerate triangles are skipped, they add no surface
+    std::vector<std::pair<int, int> > edges;
+    for (int t = 0; t < indices.size() / 3; t++) {
+        int p0 = point[indices(3 * t)], p1 = point[indices(3 * t + 1)], p2 = point[indices(3 * t + 2)];
+        if (p0 == p1 || p1 == p2 || p2 == p0) {
+            continue;
+        }
+        for (int c = 0; c < 3; c++) {
+            int u = point[indices(3 * t + c)], v = point[indices(3 * t + (c + 1) % 3)];
+            edges.push_back(std::make_pair(std::min(u, v), std::max(u, v)));
+        }
+    }
+    if (edges.empty()) {
+        return false;
+    }
+
+    std::sort(edges.begin(), edges.end());
+    for (int i = 0; i < edges.size(); i += 2) {
+        if (i + 1 >= edges.size() || edges[i + 1] != edges[i] ||
+            (i + 2 < edges.size() && edges[i + 2] == edges[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+float MeshOptimizer::signedVolume(const Eigen::VectorXi& indices, const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions) {
+    double volume = 0.0;
+    for (int t = 0; t < indices.size() / 3; t++) {
+        Eigen::Vector3d p0 = positions.col(indices(3 * t)).cast<double>();
+        Eigen::Vector3d p1 = positions.col(indices(3 * t + 1)).cast<double>();
+        Eigen::Vector3d p2 = positions.col(indices(3 * t + 2)).cast<double>();
+        volume += p0.dot(p1.cross(p2)) / 6.0;
+    }
+    return volume;
+}
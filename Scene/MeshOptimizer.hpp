@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+/*
+ * A cluster of consecutive triangles of an index buffer, with the bounds
+ * used to cull it: a bounding sphere, and a cone holding the normals of its
+ * triangles.  The cluster faces away from every point p with
+ *   dot(center - p, coneAxis) >= coneCutoff * |center - p| + radius
+ * (a coneCutoff of 1 or more means it is never back-facing).
+ */
+struct Meshlet {
+    int firstIndex;         // first index of the cluster in the index buffer
+    int indexCount;         // number of indices of the cluster
+    Eigen::Vector3f center;
+    float radius;
+    Eigen::Vector3f coneAxis;
+    float coneCutoff;
+};
+
+/*
+ * Import-time reordering of indexed triangle meshes for the GPU.
+ *
+ * 0. weldVertices merges the duplicated vertices of meshes imported without
+ *    shared vertices, which the next steps need to find any reuse.
+ * 1. optimizeVertexCache reorders the triangles so that consecutive
+ *    triangles share vertices, using the Tipsify algorithm of
+ *    Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex
+ *    Locality and Reduced Overdraw" (SIGGRAPH 2007).  Vertices still in the
+ *    post-transform cache are not shaded again.
+ * 2. optimizeOverdraw reorders clusters of those triangles so that the
+ *    clusters facing outwards, which tend to occlude the others, are drawn
+ *    first (same paper).  Triangles within a cluster keep their order.
+ * 3. optimizeVertexFetch renumbers the vertices in the order the triangles
+ *    first use them, so that the vertex fetch reads memory mostly sequentially.
+ *
+ * buildMeshlets splits a mesh into clusters that can be culled on their own.
+ *
+ * simplify builds coarser levels of detail of a mesh that share its
+ * vertices, so that a level is just another index buffer.
+ *
+ * Cache efficiency is measured by the ACMR: the average number of cache
+ * misses, i.e. vertices shaded, per triangle (3 at worst, about 0.5 at best).
+ */
+class MeshOptimizer {
+public:
+
+    // Number of entries of the simulated post-transform cache
+    static const int cacheSize = 16;
+
+    // ACMR of the triangle list with a FIFO cache of the given size
+    static float acmr(const Eigen::VectorXi& indices, int vertexCount, int cacheSize = MeshOptimizer::cacheSize);
+
+    // Merge the vertices closer than positionTolerance to each other whose
+    // normals are within normalTolerance (the cosine of the angle between
+    // them), and that are in the same group if groups are given (one per
+    // vertex).  The indices are rewritten, dropping the triangles that
+    // become degenerate.  Returns the new number of each old vertex, as
+    // for remapVertices; vertexCount receives the number of vertices left.
+    static std::vector<int> weldVertices(Eigen::VectorXi& indices,
+        const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions,
+        const Eigen::Matrix<float, 3, Eigen::Dynamic>& normals,
+        float positionTolerance, float normalTolerance, const std::vector<int>& groups, int& vertexCount);
+
+    // Reorder the triangles for the post-transform cache.
+    // clusters receives the first triangle of each run of triangles that
+    // starts at a dead end, where the order may be changed without losing
+    // much cache efficiency.
+    static void optimizeVertexCache(Eigen::VectorXi& indices, int vertexCount, std::vector<int>& clusters,
+        int cacheSize = MeshOptimizer::cacheSize);
+
+    // Reorder the clusters found by optimizeVertexCache, outward facing
+    // clusters first.  Neighbouring clusters are merged until the ACMR of each
+    // cluster drawn alone is within threshold times the ACMR of the whole mesh.
+    static void optimizeOverdraw(Eigen::VectorXi& indices, const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions,
+        const std::vector<int>& clusters, float threshold = 1.05f, int cacheSize = MeshOptimizer::cacheSize);
+
+    // Renumber the vertices in the order of their first use by the indices,
+    // which are rewritten.  Vertices no triangle uses keep their relative
+    // order at the end.  Returns the new number of each old vertex.
+    static std::vector<int> optimizeVertexFetch(Eigen::VectorXi& indices, int vertexCount);
+
+    // Simplify the mesh by quadric error edge collapse (Garland and Heckbert,
+    // "Surface Simplification Using Quadric Error Metrics", SIGGRAPH 1997)
+    // and return the triangles left each time the number of triangles falls
+    // to the next of the targets, in decreasing order.  The simplified
+    // triangles index the vertices of the mesh: vertices at the same position
+    // are collapsed together, and each corner takes the vertex at the
+    // position it moved to with the closest normal.  Fewer levels are
+    // returned if the mesh cannot be simplified that far.
+    static std::vector<Eigen::VectorXi> simplify(const Eigen::VectorXi& indices,
+        const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions,
+        const Eigen::Matrix<float, 3, Eigen::Dynamic>& normals, const std::vector<int>& targets);
+
+    // Split the triangles into meshlets of up to maxTriangles consecutive
+    // triangles each.  The triangles are not reordered: after
+    // optimizeVertexCache consecutive triangles are close to each other.
+    static std::vector<Meshlet> buildMeshlets(const Eigen::VectorXi& indices,
+        const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions, int maxTriangles = 128);
+
+    // True if every edge is shared by exactly two triangles, vertices at the
+    // same position being one, so that the mesh encloses a volume
+    static bool isClosed(const Eigen::VectorXi& indices, const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions);
+
+    // Volume enclosed by a closed mesh, negative if its triangles wind inwards
+    static float signedVolume(const Eigen::VectorXi& indices, const Eigen::Matrix<float, 3, Eigen::Dynamic>& positions);
+
+    // Move the columns of per-vertex data to their new numbers.  When
+    // several vertices get the same number (weldVertices) the first is kept.
+    template <class T, int N>
+    static void remapVertices(Eigen::Matrix<T, N, Eigen::Dynamic>& data, const std::vector<int>& remap) {
+        Eigen::Matrix<T, N, Eigen::Dynamic> old = data;
+        int count = 0;
+        for (int v = 0; v < remap.size(); v++) {
+            count = std::max(count, remap[v] + 1);
+        }
+        data.resize(N, count);
+        for (int v = remap.size() - 1; v >= 0; v--) {
+            data.col(remap[v]) = old.col(v);
+        }
+    }
+};
@@ -0,0 +1,575 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "MeshStore.hpp"
+
+//# define DEBUG 1
+
+// Size of one vertex in the arena of each type
+static const std::size_t arenaStride[] = {
+    StaticVertex::stride, SkinnedVertex::stride,
+    CompactStaticVertex::stride, CompactSkinnedVertex::stride
+};
+
+// Size of one position-only vertex in the arena of each type
+static const std::size_t arenaPositionStride[] = {
+    PositionVertex::stride, PositionVertex::stride,
+    CompactPositionVertex::stride, CompactPositionVertex::stride
+};
+
+MeshStore::MeshStore() : mBoundArena(-1), mPositionsOnly(false), mMaxCommands(0), mInstanceOffset(0), mMultiDraw(false) {
+    for (int a = 0; a < NumArenas; a++) {
+        mArenas[a].numVertices = 0;
+        mArenas[a].numIndices = 0;
+        mFirstCommand[a] = 0;
+        mNumCommands[a] = 0;
+    }
+}
+
+// Number of passes per frame the instance buffer is first sized for;
+// it grows when a frame has more
+static const int initialPassesPerFrame = 4;
+
+/*
+ * Lay out every mesh in the node hierarchy below root in the arena of its
+ * vertex format, then upload each arena.
+ */
+void MeshStore::build(Node* root) {
+    clear();
+    std::map<std::pair<MeshData*, int>, int> sources;
+    collect(root, sources);
+    order();
+
+    #ifdef GL_VERSION_4_3
+        mMultiDraw = GLWrap::hasGLVersion(4, 3);
+    #else
+        mMultiDraw = false;
+    #endif
+
+    for (int a = 0; a < NumArenas; a++) {
+        upload(a);
+    }
+
+    mInstances.reset(new GLWrap::StreamBuffer(GL_ARRAY_BUFFER,
+        initialPassesPerFrame * std::max<std::size_t>(1, mObjects.size()) * InstanceData::stride));
+    if (mMultiDraw) {
+        mCommandBuffer.reset(new GLWrap::StreamBuffer(GL_DRAW_INDIRECT_BUFFER,
+            initialPassesPerFrame * std::max(1, mMaxCommands) * sizeof(GLWrap::DrawElementsIndirectCommand)));
+    }
+
+    #ifdef DEBUG
+        for (int a = 0; a < NumArenas; a++) {
+            printf("MeshStore: arena %d holds %d vertices, %d indices\n",
+                a, mArenas[a].numVertices, mArenas[a].numIndices);
+        }
+        printf("MeshStore: %d resident meshes for %d node meshes\n", size(), (int) mNodeMeshes.size());
+    #endif
+}
+
+void MeshStore::clear() {
+    mMeshes.clear();
+    mNodeMeshes.clear();
+    mObjects.clear();
+    mObjectMeshes.clear();
+    mLevels.clear();
+    mSlots.clear();
+    mVisibility.clear();
+    mFirstRun.clear();
+    mNumRuns.clear();
+    mRuns.clear();
+    mCommands.clear();
+    mMaxCommands = 0;
+    for (int a = 0; a < NumArenas; a++) {
+        mArenas[a].mesh.reset();
+        mArenas[a].numVertices = 0;
+        mArenas[a].numIndices = 0;
+    }
+    mInstances.reset();
+    mCommandBuffer.reset();
+    mBoundArena = -1;
+}
+
+/*
+ * The arena holding the meshes of a node, after the format they are packed in.
+ */
+int MeshStore::arenaOf(Node* node) {
+    if (node->mCompressVertices == true) {
+        return node->isSkinned() ? CompactSkinnedArena : CompactStaticArena;
+    }
+    return node->isSkinned() ? SkinnedArena : StaticArena;
+}
+
+/*
+ * The indices of a level of detail of a mesh, level 0 being the full mesh.
+ */
+const Eigen::VectorXi& MeshStore::levelIndices(const MeshData& data, int level) {
+    return level == 0 ? *(data.mIndices) : data.mLodIndices[level - 1];
+}
+
+/*
+ * Recursively reserve a range in the right arena for the meshes of this
+ * node and all the dependent nodes.  Node meshes that share the record of
+ * a mesh of the source file share the range reserved for the first of them.
+ * sources -- the range of each (mesh record, arena) seen so far
+ */
+void MeshStore::collect(Node* node, std::map<std::pair<MeshData*, int>, int>& sources) {
+    for (int m = 0; m < node->mNumMeshes; m++) {
+        int a = arenaOf(node);
+        MeshData* data = node->mMeshData[m];
+        std::pair<MeshData*, int> source(data, a);
+
+        int mesh;
+        if (sources.find(source) != sources.end()) {
+            mesh = sources[source];
+        } else {
+            MeshRange range;
+            range.arena = a;
+
+            Arena& arena = mArenas[a];
+            range.numLevels = node->numLevels(m);
+            for (int l = 0; l < range.numLevels; l++) {
+                range.firstIndex[l] = arena.numIndices;
+                range.indexCount[l] = levelIndices(*data, l).size();
+                arena.numIndices += range.indexCount[l];
+            }
+            range.baseVertex = arena.numVertices;
+            range.vertexCount = data->mVertices->cols();
+            range.node = node;
+            range.data = data;
+            range.version = data->mVersion;
+            range.firstObject = 0;
+            range.objectCount = 0;
+
+            arena.numVertices += range.vertexCount;
+
+            mesh = mMeshes.size();
+            sources[source] = mesh;
+            mMeshes.push_back(range);
+        }
+        mNodeMeshes[Key(node, m)] = mesh;
+    }
+
+    for (int i = 0; i < node->mNumChildren; i++) {
+        collect(node->mChildren[i], sources);
+    }
+}
+
+/*
+ * Put the objects in draw order: by arena, then by range, so that the
+ * objects drawing the same range are consecutive and each range is one
+ * instanced draw command whose base instance is its first object.
+ */
+void MeshStore::order() {
+    std::vector<std::vector<Key> > objectsOfMesh(mMeshes.size());
+    for (std::map<Key, int>::iterator it = mNodeMeshes.begin(); it != mNodeMeshes.end(); ++it) {
+        objectsOfMesh[it->second].push_back(it->first);
+    }
+
+    mObjects.clear();
+    for (int a = 0; a < NumArenas; a++) {
+        for (int i = 0; i < mMeshes.size(); i++) {
+            MeshRange& range = mMeshes[i];
+            if (range.arena != a) {
+                continue;
+            }
+            range.firstObject = mObjects.size();
+            range.objectCount = objectsOfMesh[i].size();
+            mObjects.insert(mObjects.end(), objectsOfMesh[i].begin(), objectsOfMesh[i].end());
+            mObjectMeshes.insert(mObjectMeshes.end(), range.objectCount, i);
+            mMaxCommands += std::min(range.numLevels, range.objectCount);
+        }
+    }
+    mLevels.assign(mObjects.size(), 0);
+    mSlots.assign(mObjects.size(), 0);
+    mVisibility.assign(mObjects.size(), Visible);
+    mFirstRun.assign(mObjects.size(), 0);
+    mNumRuns.assign(mObjects.size(), 0);
+}
+
+/*
+ * Copy the packed vertices, the packed positions and the indices of every
+ * mesh of an arena into two vertex buffers and one index buffer and upload them.
+ * Indices are kept local to their mesh; the base vertex of the range
+ * offsets them at draw time.  The levels of detail of a mesh follow each
+ * other in the index buffer.
+ */
+void MeshStore::upload(int a) {
+    Arena& arena = mArenas[a];
+    arena.mesh.reset();
+    if (arena.numVertices == 0) {
+        return;
+    }
+
+    std::vector<unsigned char> vertices(arena.numVertices * arenaStride[a]);
+    std::vector<unsigned char> positions(arena.numVertices * arenaPositionStride[a]);
+    Eigen::VectorXi indices(arena.numIndices);
+
+    for (int i = 0; i < mMeshes.size(); i++) {
+        const MeshRange& range = mMeshes[i];
+        if (range.arena != a) {
+            continue;
+        }
+
+        const std::vector<unsigned char>& packed = range.data->mPackedVertices;
+        std::memcpy(&vertices[range.baseVertex * arenaStride[a]], packed.data(), packed.size());
+        const std::vector<unsigned char>& packedPositions = range.data->mPackedPositions;
+        std::memcpy(&positions[range.baseVertex * arenaPositionStride[a]], packedPositions.data(), packedPositions.size());
+        for (int l = 0; l < range.numLevels; l++) {
+            indices.segment(range.firstIndex[l], range.indexCount[l]) = levelIndices(*range.data, l);
+        }
+    }
+
+    arena.mesh.reset(new GLWrap::Mesh());
+    switch (a) {
+        case StaticArena:         arena.mesh->setVertices<StaticVertex>(vertices); break;
+        case SkinnedArena:        arena.mesh->setVertices<SkinnedVertex>(vertices); break;
+        case CompactStaticArena:  arena.mesh->setVertices<CompactStaticVertex>(vertices); break;
+        case CompactSkinnedArena: arena.mesh->setVertices<CompactSkinnedVertex>(vertices); break;
+    }
+    arena.mesh->setIndices(indices, GL_TRIANGLES);
+    if (a == CompactStaticArena || a == CompactSkinnedArena) {
+        arena.mesh->setPositionVertices<CompactPositionVertex>(positions);
+    } else {
+        arena.mesh->setPositionVertices<PositionVertex>(positions);
+    }
+}
+
+void MeshStore::beginFrame() {
+    mInstances->beginFrame();
+    if (mCommandBuffer) {
+        mCommandBuffer->beginFrame();
+    }
+}
+
+void MeshStore::endFrame() {
+    mInstances->endFrame();
+    if (mCommandBuffer) {
+        mCommandBuffer->endFrame();
+    }
+}
+
+/*
+ * Bind for a pass. The ranges of meshes whose source data has changed are
+ * overwritten in place in their arena.  If a mesh changed size, the whole
+ * store is laid out again.
+ */
+void MeshStore::bind(bool positionsOnly) {
+    for (int i = 0; i < mMeshes.size(); i++) {
+        MeshRange& range = mMeshes[i];
+        const MeshData& data = *range.data;
+        if (range.version == data.mVersion) {
+            continue;
+        }
+        bool resized = range.vertexCount != data.mVertices->cols() || range.numLevels != 1 + data.mLodIndices.size();
+        for (int l = 0; l < range.numLevels && !resized; l++) {
+            resized = range.indexCount[l] != levelIndices(data, l).size();
+        }
+        if (resized) {
+            Node* root = range.node;
+            while (root->mParent != NULL) {
+                root = root->mParent;
+            }
+            build(root);
+            return bind(positionsOnly);
+        }
+        update(range);
+        range.version = data.mVersion;
+    }
+
+    // make sure the records of every object fit for this pass,
+    // the old buffer is released once the GPU is done with it
+    std::size_t passBytes = mObjects.size() * InstanceData::stride;
+    if (!mInstances->fits(passBytes)) {
+        std::size_t frameSize = std::max(2 * mInstances->frameSize(), initialPassesPerFrame * passBytes);
+        mInstances.reset(new GLWrap::StreamBuffer(GL_ARRAY_BUFFER, frameSize));
+        #ifdef DEBUG
+            printf("MeshStore: instance buffer grown to %d bytes per frame\n", (int) frameSize);
+        #endif
+    }
+
+    // every object is drawn whole at full detail unless its level is set
+    // and it is culled for this pass
+    std::fill(mLevels.begin(), mLevels.end(), 0);
+    std::fill(mVisibility.begin(), mVisibility.end(), Visible);
+    mRuns.clear();
+    mBoundArena = -1;
+    mPositionsOnly = positionsOnly;
+}
+
+/*
+ * Overwrite the vertices and indices of one mesh in its arena.
+ */
+void MeshStore::update(MeshRange& range) {
+    GLWrap::Mesh& mesh = *mArenas[range.arena].mesh;
+    const std::vector<unsigned char>& packed = range.data->mPackedVertices;
+    switch (range.arena) {
+        case StaticArena:         mesh.updateVertices<StaticVertex>(range.baseVertex, packed); break;
+        case SkinnedArena:        mesh.updateVertices<SkinnedVertex>(range.baseVertex, packed); break;
+        case CompactStaticArena:  mesh.updateVertices<CompactStaticVertex>(range.baseVertex, packed); break;
+        case CompactSkinnedArena: mesh.updateVertices<CompactSkinnedVertex>(range.baseVertex, packed); break;
+    }
+    if (range.arena == CompactStaticArena || range.arena == CompactSkinnedArena) {
+        mesh.updatePositionVertices<CompactPositionVertex>(range.baseVertex, range.data->mPackedPositions);
+    } else {
+        mesh.updatePositionVertices<PositionVertex>(range.baseVertex, range.data->mPackedPositions);
+    }
+    for (int l = 0; l < range.numLevels; l++) {
+        mesh.updateIndices(range.firstIndex[l], levelIndices(*range.data, l));
+    }
+
+    #ifdef DEBUG
+        printf("MeshStore: updated mesh %d of the source file in place\n", range.data->mIndex);
+    #endif
+}
+
+void MeshStore::unbind() {
+    GLWrap::Mesh::unbind();
+    mBoundArena = -1;
+}
+
+void MeshStore::setLevel(int i, int level) {
+    mLevels[i] = std::min(std::max(level, 0), numLevels(i) - 1);
+}
+
+/*
+ * Test the bounding sphere of the object, then the spheres and the normal
+ * cones of the meshlets of its level, and keep the visible meshlets as runs
+ * of consecutive indices.  The cones are tested in model space, where they
+ * were built.  An object whose meshlets are all visible is drawn whole.
+ */
+void MeshStore::cull(int i, const Eigen::Matrix4f& model, const Frustum& frustum, const Eigen::Vector3f& eye) {
+    const MeshRange& range = mMeshes[mObjectMeshes[i]];
+    const MeshData& data = *range.data;
+    const Eigen::AlignedBox3f& bounds = data.mBounds;
+    float scale = model.topLeftCorner<3, 3>().colwise().norm().maxCoeff();
+
+    Eigen::Vector3f center = (model * bounds.center().homogeneous()).head<3>();
+    if (!frustum.intersects(center, 0.5f * bounds.diagonal().norm() * scale)) {
+        mVisibility[i] = Hidden;
+        return;
+    }
+    mVisibility[i] = Visible;
+    if (data.mMeshlets.size() <= mLevels[i] || data.mMeshlets[mLevels[i]].size() < 2) {
+        return;
+    }
+
+    // the back of a closed mesh is hidden by its front when seen from outside
+    bool cones = false;
+    Eigen::Vector3f localEye;
+    if (data.mClosed) {
+        localEye = (model.inverse() * eye.homogeneous()).head<3>();
+        cones = !bounds.contains(localEye);
+    }
+
+    const std::vector<Meshlet>& meshlets = data.mMeshlets[mLevels[i]];
+    mFirstRun[i] = mRuns.size();
+    int visible = 0;
+    for (int k = 0; k < meshlets.size(); k++) {
+        const Meshlet& meshlet = meshlets[k];
+        center = (model * meshlet.center.homogeneous()).head<3>();
+        if (!frustum.intersects(center, meshlet.radius * scale)) {
+            continue;
+        }
+        if (cones) {
+            Eigen::Vector3f view = meshlet.center - localEye;
+            if (view.dot(meshlet.coneAxis) >= meshlet.coneCutoff * view.norm() + meshlet.radius) {
+                continue;
+            }
+        }
+
+        visible++;
+        if (mRuns.size() > mFirstRun[i] && mRuns.back().first + mRuns.back().second == meshlet.firstIndex) {
+            mRuns.back().second += meshlet.indexCount;
+        } else {
+            mRuns.push_back(std::make_pair(meshlet.firstIndex, meshlet.indexCount));
+        }
+    }
+    mNumRuns[i] = mRuns.size() - mFirstRun[i];
+
+    if (visible == meshlets.size()) {
+        mRuns.resize(mFirstRun[i]);
+    } else {
+        mVisibility[i] = visible == 0 ? Hidden : Partial;
+    }
+}
+
+/*
+ * Make the draw commands of this pass and reserve the records.  The
+ * objects of a range drawn whole take its first records in order of level
+ * of detail, so the objects at each level are consecutive and drawn by one
+ * command, whose base instance is the first of their records.  Each run of
+ * meshlets of a culled object is a command of its own record; hidden
+ * objects get a record but no command.
+ */
+InstanceRecord* MeshStore::instances() {
+    mCommands.clear();
+    for (int a = 0; a < NumArenas; a++) {
+        mFirstCommand[a] = mCommands.size();
+        for (int i = 0; i < mMeshes.size(); i++) {
+            const MeshRange& range = mMeshes[i];
+            if (range.arena != a) {
+                continue;
+            }
+
+            int first[MAX_LOD_LEVELS];
+            int count[MAX_LOD_LEVELS] = { 0 };
+            for (int o = range.firstObject; o < range.firstObject + range.objectCount; o++) {
+                if (mVisibility[o] == Visible) {
+                    count[mLevels[o]]++;
+                }
+            }
+            int next = range.firstObject;
+            for (int l = 0; l < range.numLevels; l++) {
+                first[l] = next;
+                next += count[l];
+                if (count[l] > 0) {
+                    GLWrap::DrawElementsIndirectCommand command;
+                    command.count = range.indexCount[l];
+                    command.instanceCount = count[l];
+                    command.firstIndex = range.firstIndex[l];
+                    command.baseVertex = range.baseVertex;
+                    command.baseInstance = first[l];
+                    mCommands.push_back(command);
+                }
+            }
+            for (int o = range.firstObject; o < range.firstObject + range.objectCount; o++) {
+                if (mVisibility[o] == Visible) {
+                    mSlots[o] = first[mLevels[o]]++;
+                    continue;
+                }
+                mSlots[o] = next++;
+                for (int r = mFirstRun[o]; mVisibility[o] == Partial && r < mFirstRun[o] + mNumRuns[o]; r++) {
+                    GLWrap::DrawElementsIndirectCommand command;
+                    command.count = mRuns[r].second;
+                    command.instanceCount = 1;
+                    command.firstIndex = range.firstIndex[mLevels[o]] + mRuns[r].first;
+                    command.baseVertex = range.baseVertex;
+                    command.baseInstance = mSlots[o];
+                    mCommands.push_back(command);
+                }
+            }
+        }
+        mNumCommands[a] = mCommands.size() - mFirstCommand[a];
+    }
+
+    return (InstanceRecord*) mInstances->allocate(mObjects.size() * InstanceData::stride, mInstanceOffset);
+}
+
+/*
+ * Draw all the objects, arena by arena.  The instance attributes of the
+ * arena are pointed at the records of this pass; each draw command starts
+ * at the record of its first object, through its base instance with the
+ * multi-draw or by moving the instance attributes along in the fallback.
+ */
+void MeshStore::draw() {
+    mInstances->flush();
+
+    GLintptr commandOffset = 0;
+    if (mMultiDraw) {
+        // culled objects add commands, grow the buffer if this pass has more
+        // than fit, the old buffer is released once the GPU is done with it
+        std::size_t commandBytes = mCommands.size() * sizeof(GLWrap::DrawElementsIndirectCommand);
+        if (!mCommandBuffer->fits(commandBytes)) {
+            std::size_t frameSize = std::max(2 * mCommandBuffer->frameSize(), initialPassesPerFrame * commandBytes);
+            mCommandBuffer.reset(new GLWrap::StreamBuffer(GL_DRAW_INDIRECT_BUFFER, frameSize));
+        }
+        commandOffset = mCommandBuffer->write(mCommands.data(), mCommands.size() * sizeof(GLWrap::DrawElementsIndirectCommand));
+        mCommandBuffer->flush();
+    }
+
+    for (int a = 0; a < NumArenas; a++) {
+        if (!mArenas[a].mesh || mNumCommands[a] == 0) {
+            continue;
+        }
+        bindArena(a);
+        GLWrap::Mesh& mesh = *mArenas[a].mesh;
+
+        if (mMultiDraw) {
+            mesh.setInstanceVertices<InstanceData>(*mInstances, mInstanceOffset);
+            mesh.multiDrawElementsIndirect(*mCommandBuffer,
+                commandOffset + mFirstCommand[a] * sizeof(GLWrap::DrawElementsIndirectCommand), mNumCommands[a]);
+        } else {
+            for (int i = mFirstCommand[a]; i < mFirstCommand[a] + mNumCommands[a]; i++) {
+                const GLWrap::DrawElementsIndirectCommand& c = mCommands[i];
+                mesh.setInstanceVertices<InstanceData>(*mInstances, mInstanceOffset + c.baseInstance * InstanceData::stride);
+                mesh.drawElementsInstancedBaseVertex(c.firstIndex, c.count, c.baseVertex, c.instanceCount);
+            }
+        }
+    }
+}
+
+/*
+ * Draw a single mesh with a record of its own, written after the records
+ * of the pass.
+ */
+void MeshStore::drawMesh(int mesh, int level, const InstanceRecord& record) {
+    if (!mInstances->fits(InstanceData::stride)) {
+        mInstances.reset(new GLWrap::StreamBuffer(GL_ARRAY_BUFFER, 2 * mInstances->frameSize()));
+    }
+    GLintptr offset = mInstances->write(&record, InstanceData::stride);
+    mInstances->flush();
+
+    const MeshRange& range = mMeshes[mesh];
+    level = std::min(std::max(level, 0), range.numLevels - 1);
+    bindArena(range.arena);
+    GLWrap::Mesh& arena = *mArenas[range.arena].mesh;
+    arena.setInstanceVertices<InstanceData>(*mInstances, offset);
+    arena.drawElementsInstancedBaseVertex(range.firstIndex[level], range.indexCount[level], range.baseVertex, 1);
+}
+
+void MeshStore::bindArena(int a) {
+    if (mBoundArena != a) {
+        if (mPositionsOnly) {
+            mArenas[a].mesh->bindPositions();
+        } else {
+            mArenas[a].mesh->bind();
+        }
+        mBoundArena = a;
+    }
+}
+
+void MeshStore::printStats() const {
+    std::size_t vertexBytes = 0;
+    std::size_t positionBytes = 0;
+    std::size_t indexBytes = 0;
+    for (int a = 0; a < NumArenas; a++) {
+        vertexBytes += mArenas[a].numVertices * arenaStride[a];
+        positionBytes += mArenas[a].numVertices * arenaPositionStride[a];
+        // indices are 16 bits when every mesh of the arena has fewer than 65536 vertices
+        bool shortIndices = true;
+        for (int i = 0; i < mMeshes.size(); i++) {
+            if (mMeshes[i].arena == a && mMeshes[i].vertexCount > 0x10000) {
+                shortIndices = false;
+            }
+        }
+        indexBytes += mArenas[a].numIndices * (shortIndices ? 2 : 4);
+    }
+    printf("\t%d resident meshes for %d node meshes, %.1f KB of vertices, %.1f KB of positions, %.1f KB of indices\n",
+        size(), (int) mNodeMeshes.size(), vertexBytes / 1024.0, positionBytes / 1024.0, indexBytes / 1024.0);
+
+    int arenas = 0;
+    for (int a = 0; a < NumArenas; a++) {
+        if (mArenas[a].mesh) {
+            arenas++;
+        }
+    }
+    int levels = 0;
+    int meshlets = 0;
+    int closed = 0;
+    for (int i = 0; i < mMeshes.size(); i++) {
+        const MeshRange& range = mMeshes[i];
+        levels += range.numLevels;
+        if (!range.data->mMeshlets.empty()) {
+            meshlets += range.data->mMeshlets[0].size();
+            closed += range.data->mClosed ? 1 : 0;
+        }
+    }
+    printf("\t%d levels of detail, %d draw commands per pass without culling\n", levels, mMaxCommands);
+    printf("\t%d meshlets at full detail, back-facing meshlets culled in %d closed meshes\n", meshlets, closed);
+    if (mMultiDraw) {
+        printf("\tsubmitted with %d glMultiDrawElementsIndirect per pass\n", arenas);
+    } else {
+        printf("\tsubmitted one instanced draw each (no OpenGL 4.3)\n");
+    }
+}
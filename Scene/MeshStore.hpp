@@ -0,0 +1,221 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <GLWrap/Mesh.hpp>
+#include <GLWrap/StreamBuffer.hpp>
+
+#include <../ext/assimp/include/assimp/scene.h>
+#include <../ext/assimp/include/assimp/mesh.h>
+
+#include "Frustum.hpp"
+#include "Node.hpp"
+#include "VertexFormats.hpp"
+
+/*
+ * A store of GPU meshes that stay resident for the lifetime of the scene.
+ *
+ * The store is built once after the scene file is read.  All meshes that
+ * share a vertex format live in one geometry arena: a single vertex buffer
+ * and a single index buffer behind one VAO.  Every mesh is recorded as a
+ * range in its arena (first index, index count, base vertex), so a pass
+ * binds the arena once and draws each mesh with a base-vertex draw.
+ *
+ * Each arena also holds the positions of its vertices alone in a second,
+ * tightly packed vertex buffer (PositionVertex or CompactPositionVertex)
+ * sharing the index buffer.  Passes that only write depth bind it instead,
+ * and read 12 bytes per vertex (8 if compressed).
+ *
+ * Nodes that reference the same mesh of the source file share its record
+ * (see MeshData) and one range.
+ * Every mesh of every node is an object with a record of per-object data
+ * (see InstanceRecord) that is streamed per pass and read by the vertex
+ * shaders as instance attributes.
+ *
+ * A range holds the indices of every level of detail of its mesh (see
+ * Node::buildLods), which all use its vertices.  Each pass sets the level
+ * of every object; the objects of a range at the same level become the
+ * consecutive instances of one draw command.  The commands of a pass are
+ * streamed to an indirect buffer and the whole scene is submitted with one
+ * glMultiDrawElementsIndirect per arena.  Without OpenGL 4.3 the same
+ * commands are issued one instanced draw each.
+ *
+ * Each pass may also cull the objects against its own view (cull()).  An
+ * object outside the frustum is not drawn; otherwise the meshlets of its
+ * level (see Node::buildMeshlets) that are outside the frustum, or that
+ * face away from the eye, are dropped and the runs of consecutive meshlets
+ * left are drawn as commands of one instance each.
+ *
+ * A mesh is uploaded again only when its source data changes, which is
+ * signalled by bumping the version counter of its record
+ * (Node::touchMesh).  Only its own range of the arena buffers is
+ * transferred.
+ */
+class MeshStore {
+public:
+
+    MeshStore();
+
+    // Upload every mesh of the given node and all of its descendants.
+    // Anything previously held by the store is released first.
+    void build(Node* root);
+
+    // Release all the GPU buffers held by the store.
+    void clear();
+
+    // Start and end a frame; the instance data of all the passes of a frame
+    // is written between them.
+    void beginFrame();
+    void endFrame();
+
+    // Bind the scene geometry for a pass.  Meshes whose source data has
+    // changed since the last upload are overwritten in place first.
+    // positionsOnly -- read the position-only vertices, for depth-only passes
+    void bind(bool positionsOnly = false);
+
+    // Unbind the scene geometry at the end of a pass.
+    void unbind();
+
+    // Number of objects (node meshes) drawn by draw()
+    int numObjects() const { return mObjects.size(); }
+
+    // The node and the index of the mesh in that node of object i
+    Node* objectNode(int i) const { return mObjects[i].first; }
+    int objectMesh(int i) const { return mObjects[i].second; }
+
+    // Number of levels of detail of object i, level 0 being the full mesh
+    int numLevels(int i) const { return mMeshes[mObjectMeshes[i]].numLevels; }
+
+    // Draw object i at the given level of detail in this pass; levels past
+    // the coarsest draw the coarsest.  Objects whose level is not set after
+    // bind() are drawn at full detail.
+    void setLevel(int i, int level);
+
+    // Cull object i against the view of this pass, model being its model
+    // transformation.  Its level of detail must be set first.  Back-facing
+    // meshlets are only dropped for closed meshes seen from outside their
+    // bounds: the scene is drawn without face culling, so the back of an open
+    // mesh may be seen.  Objects that are not culled are drawn whole.
+    void cull(int i, const Eigen::Matrix4f& model, const Frustum& frustum, const Eigen::Vector3f& eye);
+
+    // Do not draw object i in this pass, e.g. because something else stands
+    // in for it.  It still gets a record.
+    void hide(int i) { mVisibility[i] = Hidden; }
+
+    // Reserve the records of all the objects for this pass; the record of
+    // object i is at index slot(i).  The levels of detail and the culling
+    // must be done before, since the objects drawn whole at the same level
+    // are grouped together.
+    // The records must be filled before draw().
+    InstanceRecord* instances();
+    int slot(int i) const { return mSlots[i]; }
+
+    // Draw every object with the records written since instances(),
+    // one multi-draw per arena.  The store must be bound.
+    void draw();
+
+    // Draw one mesh (see meshId) alone at the given level of detail with
+    // the given record, apart from the objects of the pass, e.g. to render
+    // it offline.  The store must be bound.
+    void drawMesh(int mesh, int level, const InstanceRecord& record);
+
+    // Identifier of the GPU mesh used by mesh m of the given node.
+    // Node meshes with the same identifier are drawn as instances of each other.
+    int meshId(Node* node, int m) const { return mNodeMeshes.at(Key(node, m)); }
+
+    // Number of unique meshes held by the store
+    int size() const { return mMeshes.size(); }
+
+    // Print the number of meshes and the GPU memory used by their vertices and indices
+    void printStats() const;
+
+private:
+
+    // The vertex formats, one arena each
+    enum ArenaType {
+        StaticArena = 0,
+        SkinnedArena,
+        CompactStaticArena,
+        CompactSkinnedArena,
+        NumArenas
+    };
+
+    // Where a mesh lives in the arena of its vertex format
+    struct MeshRange {
+        int arena;                          // the arena holding the mesh
+        int numLevels;                      // number of levels of detail
+        int firstIndex[MAX_LOD_LEVELS];     // first index of each level in the arena index buffer
+        int indexCount[MAX_LOD_LEVELS];     // number of indices of each level
+        int baseVertex;                     // first vertex in the arena vertex buffer
+        int vertexCount;                    // number of vertices of the mesh
+        Node* node;                         // a node drawing the mesh
+        MeshData* data;                     // the source data of the mesh
+        unsigned int version;               // the version of the source data on the GPU
+        int firstObject;                    // first of the objects drawing the mesh
+        int objectCount;                    // number of objects drawing the mesh
+    };
+
+    // One vertex buffer and one index buffer shared by all the meshes of a format
+    struct Arena {
+        std::unique_ptr<GLWrap::Mesh> mesh;
+        int numVertices;
+        int numIndices;
+    };
+
+    typedef std::pair<Node*, int> Key;
+
+    std::vector<MeshRange> mMeshes;
+    std::map<Key, int> mNodeMeshes;     // the range of each node mesh
+    Arena mArenas[NumArenas];
+    int mBoundArena;
+    bool mPositionsOnly;     // the pass reads the position-only vertices
+
+    // the node meshes in draw order, grouped by arena and by range,
+    // and the range of each
+    std::vector<Key> mObjects;
+    std::vector<int> mObjectMeshes;
+
+    // the level of detail and the record of each object in this pass
+    std::vector<int> mLevels;
+    std::vector<int> mSlots;
+
+    // how each object is drawn in this pass: whole, not at all, or as the
+    // runs of its visible meshlets (first index and index count within its
+    // level), mNumRuns[i] of them from mRuns[mFirstRun[i]]
+    enum Visibility {
+        Visible = 0,
+        Hidden,
+        Partial
+    };
+    std::vector<unsigned char> mVisibility;
+    std::vector<int> mFirstRun;
+    std::vector<int> mNumRuns;
+    std::vector<std::pair<int, int> > mRuns;
+
+    // the draw commands of this pass, arena after arena
+    std::vector<GLWrap::DrawElementsIndirectCommand> mCommands;
+    int mFirstCommand[NumArenas];
+    int mNumCommands[NumArenas];
+    int mMaxCommands;
+
+    // per-object records of the draws, rewritten every pass,
+    // and the position of the records of the current pass
+    std::unique_ptr<GLWrap::StreamBuffer> mInstances;
+    GLintptr mInstanceOffset;
+
+    // true if the arenas are drawn with glMultiDrawElementsIndirect,
+    // reading the draw commands streamed every pass
+    bool mMultiDraw;
+    std::unique_ptr<GLWrap::StreamBuffer> mCommandBuffer;
+
+    static int arenaOf(Node* node);
+    static const Eigen::VectorXi& levelIndices(const MeshData& data, int level);
+    void collect(Node* node, std::map<std::pair<MeshData*, int>, int>& sources);
+    void order();
+    void upload(int arena);
+    void update(MeshRange& range);
+    void bindArena(int arena);
+};
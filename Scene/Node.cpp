@@ -11,6 +11,8 @@
 #include <RTUtil/conversions.hpp>
 
 #include "Node.hpp"
+#include "MeshOptimizer.hpp"
+#include "VertexFormats.hpp"
 
 //# define DEBUG 1
 
@@ -33,8 +35,10 @@ Node* Node::findNode(aiString nodeName) {
 
 /*
  * Recursively copies the node hierachy. 
+ * Each mesh of the aiScene is copied once, into the record at its index in
+ * meshData; the nodes referencing it share that record.
  */
-void Node::copyNodes(aiNode* in, aiMesh** meshes, RTUtil::SceneInfo sceneInfo) {
+void Node::copyNodes(aiNode* in, aiMesh** meshes, RTUtil::SceneInfo sceneInfo, std::vector<MeshData*>& meshData) {
 
     mName = aiString(in->mName);
     mTransformation = in->mTransformation;
@@ -47,14 +51,22 @@ void Node::copyNodes(aiNode* in, aiMesh** meshes, RTUtil::SceneInfo sceneInfo) {
 
     // copy the meshes
     if (in->mNumMeshes > 0 && in->mMeshes != NULL) {
-        mMeshes = new aiMesh*[in->mNumMeshes];
+        mMeshData = new MeshData*[in->mNumMeshes];
         mMaterials = new std::shared_ptr<nori::BSDF>[in->mNumMeshes];
         for (int i = 0; i < in->mNumMeshes; i++) {
             #ifdef DEBUG
                 printf("  Mesh number: %d\n", in->mMeshes[i]);
             #endif
-            mMeshes[i] = new(aiMesh);
-            Node::copyMesh(meshes[in->mMeshes[i]], mMeshes[i]);
+            MeshData*& data = meshData[in->mMeshes[i]];
+            if (data == NULL) {
+                data = new MeshData();
+                data->mMesh = new(aiMesh);
+                data->mIndex = in->mMeshes[i];
+                data->mOwner = this;
+                data->mOwnerMesh = i;
+                Node::copyMesh(meshes[in->mMeshes[i]], data->mMesh);
+            }
+            mMeshData[i] = data;
 
             // get material for this mesh from the scene info
             if (sceneInfo.nodeMaterials.find(mName.C_Str()) != sceneInfo.nodeMaterials.end()) {
@@ -64,18 +76,16 @@ void Node::copyNodes(aiNode* in, aiMesh** meshes, RTUtil::SceneInfo sceneInfo) {
             }
         }
     } else {
-        mMeshes = NULL;
+        mMeshData = NULL;
     }
 
-    mVertexBoneData = new VertexBoneData**[mNumMeshes];
-
     // recursively copy children nodes
     if (in->mNumChildren > 0 && in->mChildren != NULL) {
         mChildren = new Node*[in->mNumChildren];
         for (int i = 0; i < in->mNumChildren; i++) {
             mChildren[i] = new Node();
             mChildren[i]->mParent = this;
-            mChildren[i]->copyNodes(in->mChildren[i], meshes, sceneInfo);
+            mChildren[i]->copyNodes(in->mChildren[i], meshes, sceneInfo, meshData);
         }
     } else {
         mChildren = NULL;
@@ -147,15 +157,26 @@ void Node::copyNodes(aiNode* in, aiMesh** meshes, RTUtil::SceneInfo sceneInfo) {
     } 
 }
 
+/*
+ * Mark the source data of the given mesh as changed, for every node sharing it.
+ * The interleaved vertices are packed again from the source data,
+ * and the levels of detail and their meshlets are built again.
+ */
+void Node::touchMesh(int meshIndex) {
+    packVertices(meshIndex);
+    buildLods(meshIndex);
+    buildMeshlets(meshIndex);
+    mMeshData[meshIndex]->mVersion++;
+}
+
 /*
  * Recursively loads the vertices for all the meshes
  * for this and all the dependent nodes.
  */
 void Node::loadVerticesForAll() {
-    if (mNumMeshes > 0) {
-        mVertices = new Eigen::Matrix<float, 3, Eigen::Dynamic>*[mNumMeshes];
-        for (int i = 0; i < mNumMeshes; i++) {
-            mVertices[i] = getVertices(mMeshes[i]);
+    for (int i = 0; i < mNumMeshes; i++) {
+        if (ownsMesh(i)) {
+            mMeshData[i]->mVertices = getVertices(mMeshData[i]->mMesh);
         }
     }
 
@@ -185,10 +206,9 @@ Eigen::Matrix<float, 3, Eigen::Dynamic>*  Node::getVertices(aiMesh* nodeMeshes)
  * for this and all the dependent nodes.
  */
 void Node::loadNormalsForAll() {
-    if (mNumMeshes > 0) {
-        mNormals = new Eigen::Matrix<float, 3, Eigen::Dynamic>*[mNumMeshes];
-        for (int i = 0; i < mNumMeshes; i++) {
-            mNormals[i] = getNormals(mMeshes[i]);
+    for (int i = 0; i < mNumMeshes; i++) {
+        if (ownsMesh(i)) {
+            mMeshData[i]->mNormals = getNormals(mMeshData[i]->mMesh);
         }
     }
 
@@ -238,10 +258,9 @@ Eigen::Matrix<float, 3, Eigen::Dynamic>  Node::getTransformedVertices(aiMesh* no
  * for this and all the dependent nodes.
  */
 void Node::loadIndicesForAll() {
-    if (mNumMeshes > 0) {
-        mIndices = new Eigen::VectorXi*[mNumMeshes];
-        for (int i = 0; i < mNumMeshes; i++) {
-            mIndices[i] = getIndices(mMeshes[i]);
+    for (int i = 0; i < mNumMeshes; i++) {
+        if (ownsMesh(i)) {
+            mMeshData[i]->mIndices = getIndices(mMeshData[i]->mMesh);
         }
     }
 
@@ -285,7 +304,8 @@ aiMatrix4x4 Node::getTransformation(Node* node, aiMatrix4x4 m)
  *  get boneIds and weights that influence the vertices for the given mesh.
  */
 void Node::loadVertexBones(int meshIndex, aiMesh* nodeMesh, std::map<std::string, int> &boneMapping) {
-    mVertexBoneData[meshIndex] = new VertexBoneData*[nodeMesh->mNumVertices];
+    VertexBoneData**& vertexBoneData = mMeshData[meshIndex]->mVertexBoneData;
+    vertexBoneData = new VertexBoneData*[nodeMesh->mNumVertices];
 
     #ifdef DEBUG
         printf("meshIndex=%d, mNumBones=%d, mNumVertices=%d\n", meshIndex, nodeMesh->mNumBones, nodeMesh->mNumVertices);
@@ -293,15 +313,15 @@ void Node::loadVertexBones(int meshIndex, aiMesh* nodeMesh, std::map<std::string
 
     for (int v = 0; v < nodeMesh->mNumVertices; v++) {
         int i = 0;
-        mVertexBoneData[meshIndex][v] = new VertexBoneData();
+        vertexBoneData[v] = new VertexBoneData();
         for (int b = 0; b < nodeMesh->mNumBones; b++) {
             for (int w =0; w < nodeMesh->mBones[b]->mNumWeights; w++) {
                 //printf("vId=%d, weights=%f\n", nodeMesh->mBones[b]->mWeights[w].mVertexId, nodeMesh->mBones[b]->mWeights[w].mWeight);
                 if (nodeMesh->mBones[b]->mWeights[w].mVertexId == v) {
                     int boneId = boneMapping[nodeMesh->mBones[b]->mName.C_Str()];
                     //printf("bondid=%d\n", boneId);
-                    mVertexBoneData[meshIndex][v]->mIDs[i] = boneId;
-                    mVertexBoneData[meshIndex][v]->mWeights[i] = nodeMesh->mBones[b]->mWeights[w].mWeight;
+                    vertexBoneData[v]->mIDs[i] = boneId;
+                    vertexBoneData[v]->mWeights[i] = nodeMesh->mBones[b]->mWeights[w].mWeight;
                     i++;
                     break;
                 }
@@ -318,10 +338,9 @@ void Node::loadVertexBones(int meshIndex, aiMesh* nodeMesh, std::map<std::string
  * for this and all the dependent nodes.
  */
 void Node::loadBonIDsForAll() {
-    if (mNumMeshes > 0) {
-        mBoneIDs = new Eigen::Matrix<int, 4, Eigen::Dynamic>*[mNumMeshes];
-        for (int i = 0; i < mNumMeshes; i++) {
-            mBoneIDs[i] = getBoneIDs(i, mMeshes[i]);
+    for (int i = 0; i < mNumMeshes; i++) {
+        if (ownsMesh(i)) {
+            mMeshData[i]->mBoneIDs = getBoneIDs(i, mMeshData[i]->mMesh);
         }
     }
 
@@ -334,19 +353,20 @@ void Node::loadBonIDsForAll() {
  * get the bone ids that incluence the vertices for the given mesh
  */
 Eigen::Matrix<int, 4, Eigen::Dynamic>*  Node::getBoneIDs(int meshIndex, aiMesh* nodeMeshes) {
+    VertexBoneData** vertexBoneData = mMeshData[meshIndex]->mVertexBoneData;
     Eigen::Matrix<int, 4, Eigen::Dynamic>* boneIDs = new Eigen::Matrix<int, 4, Eigen::Dynamic>(4,nodeMeshes->mNumVertices);
     int i = 0;
     for (int v = 0; v < nodeMeshes->mNumVertices; v++) {
-        (*boneIDs)(i) = mVertexBoneData[meshIndex][v]->mIDs[0];
-        (*boneIDs)(i + 1) = mVertexBoneData[meshIndex][v]->mIDs[1];
-        (*boneIDs)(i + 2) = mVertexBoneData[meshIndex][v]->mIDs[2];
-        (*boneIDs)(i + 3) = mVertexBoneData[meshIndex][v]->mIDs[3];
+        (*boneIDs)(i) = vertexBoneData[v]->mIDs[0];
+        (*boneIDs)(i + 1) = vertexBoneData[v]->mIDs[1];
+        (*boneIDs)(i + 2) = vertexBoneData[v]->mIDs[2];
+        (*boneIDs)(i + 3) = vertexBoneData[v]->mIDs[3];
         i += 4;
 
         #ifdef DEBUG
             printf("Vertex id=%d, boneIds=(%d, %d, %d, %d)\n", v,
-                mVertexBoneData[meshIndex][v]->mIDs[0], mVertexBoneData[meshIndex][v]->mIDs[1],
-                mVertexBoneData[meshIndex][v]->mIDs[2], mVertexBoneData[meshIndex][v]->mIDs[3]);
+                vertexBoneData[v]->mIDs[0], vertexBoneData[v]->mIDs[1],
+                vertexBoneData[v]->mIDs[2], vertexBoneData[v]->mIDs[3]);
         #endif
     }
 
@@ -358,10 +378,9 @@ Eigen::Matrix<int, 4, Eigen::Dynamic>*  Node::getBoneIDs(int meshIndex, aiMesh*
  * for this and all the dependent nodes.
  */
 void Node::loadBonWeightsForAll() {
-    if (mNumMeshes > 0) {
-        mBoneWeights = new Eigen::Matrix<float, 4, Eigen::Dynamic>*[mNumMeshes];
-        for (int i = 0; i < mNumMeshes; i++) {
-            mBoneWeights[i] = getBoneWeights(i, mMeshes[i]);
+    for (int i = 0; i < mNumMeshes; i++) {
+        if (ownsMesh(i)) {
+            mMeshData[i]->mBoneWeights = getBoneWeights(i, mMeshData[i]->mMesh);
         }
     }
 
@@ -375,21 +394,363 @@ void Node::loadBonWeightsForAll() {
  * get the bone weights that incluence the vertices for the given mesh
  */
 Eigen::Matrix<float, 4, Eigen::Dynamic>* Node::getBoneWeights(int meshIndex, aiMesh* nodeMeshes) {
+    VertexBoneData** vertexBoneData = mMeshData[meshIndex]->mVertexBoneData;
     Eigen::Matrix<float, 4, Eigen::Dynamic>* boneWts = new Eigen::Matrix<float, 4, Eigen::Dynamic>(4,nodeMeshes->mNumVertices);
     int i = 0;
     for (int v = 0; v < nodeMeshes->mNumVertices; v++) {
-        (*boneWts)(i) = mVertexBoneData[meshIndex][v]->mWeights[0];
-        (*boneWts)(i + 1) = mVertexBoneData[meshIndex][v]->mWeights[1];
-        (*boneWts)(i + 2) = mVertexBoneData[meshIndex][v]->mWeights[2];
-        (*boneWts)(i + 3) = mVertexBoneData[meshIndex][v]->mWeights[3];
+        (*boneWts)(i) = vertexBoneData[v]->mWeights[0];
+        (*boneWts)(i + 1) = vertexBoneData[v]->mWeights[1];
+        (*boneWts)(i + 2) = vertexBoneData[v]->mWeights[2];
+        (*boneWts)(i + 3) = vertexBoneData[v]->mWeights[3];
         i += 4;
 
         #ifdef DEBUG
             printf("Vertex id=%d, boneWeights=(%f, %f, %f, %f)\n", v,
-                mVertexBoneData[meshIndex][v]->mWeights[0], mVertexBoneData[meshIndex][v]->mWeights[1],
-                mVertexBoneData[meshIndex][v]->mWeights[2], mVertexBoneData[meshIndex][v]->mWeights[3]);
+                vertexBoneData[v]->mWeights[0], vertexBoneData[v]->mWeights[1],
+                vertexBoneData[v]->mWeights[2], vertexBoneData[v]->mWeights[3]);
         #endif
     }
 
     return boneWts;
-}
\ No newline at end of file
+}
+
+/*
+ * Recursively welds the duplicated vertices of all the meshes for this and
+ * all the dependent nodes.
+ * It must be called after all the vertex data is loaded, and before optimizing.
+ */
+void Node::weldMeshesForAll() {
+    for (int i = 0; i < mNumMeshes; i++) {
+        if (ownsMesh(i)) {
+            weldMesh(i);
+        }
+    }
+
+    for (int i = 0; i < mNumChildren; i++) {
+        mChildren[i]->weldMeshesForAll();
+    }
+}
+
+/*
+ * Merge the vertices of the given mesh that are at the same position, up to
+ * a small fraction of its size, with nearly the same normal and (for skinned
+ * meshes) the same bones.  All the per-vertex data loaded for the mesh is
+ * moved along.
+ */
+void Node::weldMesh(int meshIndex) {
+    // position tolerance relative to the diagonal of the bounding box
+    const float relativeTolerance = 1e-5f;
+    // cosine of the largest angle between the normals of merged vertices
+    const float normalTolerance = 0.9999f;
+
+    MeshData& data = *mMeshData[meshIndex];
+    int numVertices = data.mVertices->cols();
+    if (numVertices == 0) {
+        return;
+    }
+    Eigen::AlignedBox3f bounds;
+    for (int v = 0; v < numVertices; v++) {
+        bounds.extend(data.mVertices->col(v));
+    }
+
+    // skinned vertices are only merged with vertices of the same bones and weights
+    std::vector<int> groups;
+    if (isSkinned()) {
+        const Eigen::Matrix<int, 4, Eigen::Dynamic>& boneIDs = *(data.mBoneIDs);
+        const Eigen::Matrix<float, 4, Eigen::Dynamic>& boneWts = *(data.mBoneWeights);
+        std::vector<int> sorted(numVertices);
+        for (int v = 0; v < numVertices; v++) {
+            sorted[v] = v;
+        }
+        auto less = [&boneIDs, &boneWts](int u, int v) {
+            for (int b = 0; b < MAX_BONES_PER_VERTEX; b++) {
+                if (boneIDs(b, u) != boneIDs(b, v)) return boneIDs(b, u) < boneIDs(b, v);
+                if (boneWts(b, u) != boneWts(b, v)) return boneWts(b, u) < boneWts(b, v);
+            }
+            return false;
+        };
+        std::sort(sorted.begin(), sorted.end(), less);
+        groups.resize(numVertices);
+        for (int i = 0; i < numVertices; i++) {
+            groups[sorted[i]] = (i > 0 && !less(sorted[i - 1], sorted[i])) ? groups[sorted[i - 1]] : i;
+        }
+    }
+
+    int welded;
+    std::vector<int> remap = MeshOptimizer::weldVertices(*(data.mIndices), *(data.mVertices), *(data.mNormals),
+        relativeTolerance * bounds.diagonal().norm(), normalTolerance, groups, welded);
+
+    MeshOptimizer::remapVertices(*(data.mVertices), remap);
+    MeshOptimizer::remapVertices(*(data.mNormals), remap);
+    if (isSkinned()) {
+        MeshOptimizer::remapVertices(*(data.mBoneIDs), remap);
+        MeshOptimizer::remapVertices(*(data.mBoneWeights), remap);
+    }
+
+    #ifdef DEBUG
+        printf("Mesh %d of %s: welded %d vertices into %d\n", meshIndex, mName.C_Str(), numVertices, welded);
+    #endif
+}
+
+/*
+ * Recursively reorders the triangles and the vertices of all the meshes
+ * for this and all the dependent nodes for the GPU (see MeshOptimizer),
+ * and prints the ACMR of each mesh before and after.
+ * It must be called after all the vertex data is loaded, and before packing.
+ */
+void Node::optimizeMeshesForAll() {
+    for (int i = 0; i < mNumMeshes; i++) {
+        if (ownsMesh(i)) {
+            optimizeMesh(i);
+        }
+    }
+
+    for (int i = 0; i < mNumChildren; i++) {
+        mChildren[i]->optimizeMeshesForAll();
+    }
+}
+
+/*
+ * Reorder the triangles of the given mesh for the post-transform cache and
+ * for less overdraw, then renumber its vertices in the order they are used.
+ * All the per-vertex data loaded for the mesh is moved along.
+ */
+void Node::optimizeMesh(int meshIndex) {
+    MeshData& data = *mMeshData[meshIndex];
+    Eigen::VectorXi& indices = *(data.mIndices);
+    int numVertices = data.mVertices->cols();
+    float before = MeshOptimizer::acmr(indices, numVertices);
+
+    std::vector<int> clusters;
+    MeshOptimizer::optimizeVertexCache(indices, numVertices, clusters);
+    MeshOptimizer::optimizeOverdraw(indices, *(data.mVertices), clusters);
+    std::vector<int> remap = MeshOptimizer::optimizeVertexFetch(indices, numVertices);
+
+    MeshOptimizer::remapVertices(*(data.mVertices), remap);
+    MeshOptimizer::remapVertices(*(data.mNormals), remap);
+    if (isSkinned()) {
+        MeshOptimizer::remapVertices(*(data.mBoneIDs), remap);
+        MeshOptimizer::remapVertices(*(data.mBoneWeights), remap);
+    }
+
+    printf("Mesh %d of %s: %d vertices, %d triangles, ACMR %.3f -> %.3f\n", meshIndex, mName.C_Str(),
+        numVertices, (int) indices.size() / 3, before, MeshOptimizer::acmr(indices, numVertices));
+}
+
+/*
+ * Recursively builds the levels of detail of all the meshes for this and
+ * all the dependent nodes, and prints their numbers of triangles.
+ * It must be called after the meshes are optimized, the coarser levels
+ * share the vertex order of the full mesh.
+ */
+void Node::buildLodsForAll() {
+    for (int i = 0; i < mNumMeshes; i++) {
+        if (!ownsMesh(i)) {
+            continue;
+        }
+        buildLods(i);
+
+        const MeshData& data = *mMeshData[i];
+        printf("Mesh %d of %s: %d levels of detail, triangles %d", i, mName.C_Str(),
+            numLevels(i), (int) data.mIndices->size() / 3);
+        for (int l = 0; l < data.mLodIndices.size(); l++) {
+            printf(" / %d", (int) data.mLodIndices[l].size() / 3);
+        }
+        printf("\n");
+    }
+
+    for (int i = 0; i < mNumChildren; i++) {
+        mChildren[i]->buildLodsForAll();
+    }
+}
+
+/*
+ * Simplify the given mesh to about 1/2, 1/4 and 1/8 of its triangles,
+ * skipping the levels under minLodTriangles, and order the triangles of
+ * each level for the vertex cache.
+ */
+void Node::buildLods(int meshIndex) {
+    // meshes are not simplified below this number of triangles
+    const int minLodTriangles = 64;
+
+    MeshData& data = *mMeshData[meshIndex];
+    std::vector<int> targets;
+    int numTriangles = data.mIndices->size() / 3;
+    for (int l = 1; l < MAX_LOD_LEVELS && (numTriangles >> l) >= minLodTriangles; l++) {
+        targets.push_back(numTriangles >> l);
+    }
+
+    data.mLodIndices = MeshOptimizer::simplify(*(data.mIndices), *(data.mVertices), *(data.mNormals), targets);
+
+    int numVertices = data.mVertices->cols();
+    for (int l = 0; l < data.mLodIndices.size(); l++) {
+        std::vector<int> clusters;
+        MeshOptimizer::optimizeVertexCache(data.mLodIndices[l], numVertices, clusters);
+    }
+}
+
+/*
+ * Recursively splits every level of detail of all the meshes for this and
+ * all the dependent nodes into meshlets.
+ * It must be called after the levels of detail are built.
+ */
+void Node::buildMeshletsForAll() {
+    for (int i = 0; i < mNumMeshes; i++) {
+        if (!ownsMesh(i)) {
+            continue;
+        }
+        buildMeshlets(i);
+
+        #ifdef DEBUG
+            printf("Mesh %d of %s: %d meshlets, %s\n", i, mName.C_Str(),
+                (int) mMeshData[i]->mMeshlets[0].size(), mMeshData[i]->mClosed ? "closed" : "open");
+        #endif
+    }
+
+    for (int i = 0; i < mNumChildren; i++) {
+        mChildren[i]->buildMeshletsForAll();
+    }
+}
+
+/*
+ * Split each level of detail of the given mesh into meshlets.  Whether the
+ * mesh is closed is decided on the full mesh; the cones are flipped if its
+ * triangles wind inwards, so that they always point out of the mesh.
+ */
+void Node::buildMeshlets(int meshIndex) {
+    MeshData& data = *mMeshData[meshIndex];
+    const Eigen::Matrix<float, 3, Eigen::Dynamic>& vertices = *(data.mVertices);
+    const Eigen::VectorXi& indices = *(data.mIndices);
+
+    data.mClosed = MeshOptimizer::isClosed(indices, vertices);
+    bool inwards = data.mClosed && MeshOptimizer::signedVolume(indices, vertices) < 0.0f;
+
+    std::vector<std::vector<Meshlet> >& levels = data.mMeshlets;
+    levels.clear();
+    for (int l = 0; l < numLevels(meshIndex); l++) {
+        levels.push_back(MeshOptimizer::buildMeshlets(l == 0 ? indices : data.mLodIndices[l - 1], vertices));
+        if (inwards) {
+            for (int k = 0; k < levels[l].size(); k++) {
+                levels[l][k].coneAxis = -levels[l][k].coneAxis;
+            }
+        }
+    }
+}
+
+/*
+ * Recursively packs the loaded vertex data into interleaved vertices
+ * for all the meshes for this and all the dependent nodes.
+ * It must be called after all the vertex data is loaded.
+ * compress -- pack in the compact vertex formats
+ */
+void Node::packVerticesForAll(bool compress) {
+    mCompressVertices = compress;
+    for (int i = 0; i < mNumMeshes; i++) {
+        if (ownsMesh(i)) {
+            packVertices(i);
+        }
+    }
+
+    for (int i = 0; i < mNumChildren; i++) {
+        mChildren[i]->packVerticesForAll(compress);
+    }
+}
+
+/*
+ * Pack position, normal and (for skinned meshes) bone IDs and weights
+ * of the given mesh into one interleaved array, and the positions alone
+ * into another.
+ */
+void Node::packVertices(int meshIndex) {
+    MeshData& mesh = *mMeshData[meshIndex];
+    std::vector<unsigned char>& data = mesh.mPackedVertices;
+    const Eigen::Matrix<float, 3, Eigen::Dynamic>& vertices = *(mesh.mVertices);
+    const Eigen::Matrix<float, 3, Eigen::Dynamic>& normals = *(mesh.mNormals);
+    int numVertices = vertices.cols();
+
+    mesh.mBounds.setEmpty();
+    for (int v = 0; v < numVertices; v++) {
+        mesh.mBounds.extend(vertices.col(v));
+    }
+
+    if (mCompressVertices == false) {
+        if (isSkinned()) {
+            SkinnedVertex::resize(data, numVertices);
+            SkinnedVertex::pack<0>(data, vertices);
+            SkinnedVertex::pack<1>(data, normals);
+            SkinnedVertex::pack<2>(data, *(mesh.mBoneIDs));
+            SkinnedVertex::pack<3>(data, *(mesh.mBoneWeights));
+        } else {
+            StaticVertex::resize(data, numVertices);
+            StaticVertex::pack<0>(data, vertices);
+            StaticVertex::pack<1>(data, normals);
+        }
+        PositionVertex::resize(mesh.mPackedPositions, numVertices);
+        PositionVertex::pack<0>(mesh.mPackedPositions, vertices);
+        return;
+    }
+
+    // quantize the positions within the bounding box, and octahedral-encode the normals
+    Eigen::Vector3f scale, offset;
+    getDequantization(meshIndex, scale, offset);
+    Eigen::Matrix<unsigned short, 4, Eigen::Dynamic> qPositions(4, numVertices);
+    Eigen::Matrix<short, 2, Eigen::Dynamic> qNormals(2, numVertices);
+    for (int v = 0; v < numVertices; v++) {
+        for (int c = 0; c < 3; c++) {
+            float t = scale(c) > 0 ? (vertices(c, v) - offset(c)) / scale(c) : 0.0f;
+            qPositions(c, v) = GLWrap::quantizeUnorm<unsigned short>(t);
+        }
+        qPositions(3, v) = 0;
+
+        Eigen::Vector2f e = GLWrap::octEncode(normals.col(v));
+        qNormals(0, v) = GLWrap::quantizeSnorm<short>(e(0));
+        qNormals(1, v) = GLWrap::quantizeSnorm<short>(e(1));
+    }
+    CompactPositionVertex::resize(mesh.mPackedPositions, numVertices);
+    CompactPositionVertex::pack<0>(mesh.mPackedPositions, qPositions);
+
+    if (isSkinned()) {
+        const Eigen::Matrix<int, 4, Eigen::Dynamic>& boneIDs = *(mesh.mBoneIDs);
+        const Eigen::Matrix<float, 4, Eigen::Dynamic>& boneWts = *(mesh.mBoneWeights);
+        Eigen::Matrix<unsigned short, 4, Eigen::Dynamic> qBoneIDs(4, numVertices);
+        Eigen::Matrix<unsigned char, 4, Eigen::Dynamic> qBoneWts(4, numVertices);
+        for (int v = 0; v < numVertices; v++) {
+            for (int b = 0; b < MAX_BONES_PER_VERTEX; b++) {
+                // unused slots have no valid ID and a zero weight, point them at bone 0
+                int id = boneIDs(b, v);
+                if (id > 65535) {
+                    throw std::runtime_error("bone IDs above 65535 do not fit compressed vertices of mesh "
+                        + std::string(mName.C_Str()));
+                }
+                qBoneIDs(b, v) = id < 0 ? 0 : id;
+                qBoneWts(b, v) = GLWrap::quantizeUnorm<unsigned char>(boneWts(b, v));
+            }
+        }
+
+        CompactSkinnedVertex::resize(data, numVertices);
+        CompactSkinnedVertex::pack<0>(data, qPositions);
+        CompactSkinnedVertex::pack<1>(data, qNormals);
+        CompactSkinnedVertex::pack<2>(data, qBoneIDs);
+        CompactSkinnedVertex::pack<3>(data, qBoneWts);
+    } else {
+        CompactStaticVertex::resize(data, numVertices);
+        CompactStaticVertex::pack<0>(data, qPositions);
+        CompactStaticVertex::pack<1>(data, qNormals);
+    }
+}
+
+/*
+ * get the transform from the packed positions of the given mesh to
+ * model space: position = packed * scale + offset.
+ * It is the identity unless the vertices are compressed.
+ */
+void Node::getDequantization(int meshIndex, Eigen::Vector3f& scale, Eigen::Vector3f& offset) {
+    const Eigen::AlignedBox3f& bounds = mMeshData[meshIndex]->mBounds;
+    if (mCompressVertices == true && !bounds.isEmpty()) {
+        scale = bounds.sizes();
+        offset = bounds.min();
+    } else {
+        scale = Eigen::Vector3f::Ones();
+        offset = Eigen::Vector3f::Zero();
+    }
+}
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <iostream>
 #include <nanogui/screen.h>
+#include <Eigen/Geometry>
 
 #include <GLWrap/Program.hpp>
 #include <GLWrap/Mesh.hpp>
@@ -12,7 +13,10 @@
 #include <RTUtil/sceneinfo.hpp>
 using namespace RTUtil;
 
+#include "MeshOptimizer.hpp"
+
 const int MAX_BONES_PER_VERTEX = 4;
+const int MAX_LOD_LEVELS = 4;     // full detail and 3 coarser levels
 
 struct VertexBoneData {        
     uint mIDs[MAX_BONES_PER_VERTEX];
@@ -25,6 +29,59 @@ struct VertexBoneData {
     }
 };
 
+class Node;
+
+/*
+ * One mesh of the source file and everything derived from it at import.
+ * Every node that references the same mesh of the aiScene holds a pointer
+ * to the same record, so a mesh instanced by many nodes is copied, loaded,
+ * optimized and packed once (and uploaded once, see MeshStore).  The first
+ * node mesh referencing a record owns it and does the processing for all.
+ */
+struct MeshData {
+    aiMesh* mMesh;          // copy of the aiScene mesh
+    unsigned int mIndex;    // index of the mesh in the aiScene
+    Node* mOwner;           // the node mesh that processes the record
+    int mOwnerMesh;
+
+    // to be passed to the shaders
+    VertexBoneData** mVertexBoneData;
+    Eigen::Matrix<float, 3, Eigen::Dynamic>* mNormals;
+    Eigen::Matrix<float, 3, Eigen::Dynamic>* mVertices;
+    Eigen::VectorXi* mIndices;
+    Eigen::Matrix<int, 4, Eigen::Dynamic>* mBoneIDs;
+    Eigen::Matrix<float, 4, Eigen::Dynamic>* mBoneWeights;
+
+    // interleaved vertices ready for upload, in the StaticVertex format,
+    // or in the SkinnedVertex format when mBoneIDs are loaded
+    // (CompactStaticVertex/CompactSkinnedVertex when the node compresses vertices)
+    std::vector<unsigned char> mPackedVertices;
+
+    // the positions alone, packed in PositionVertex (CompactPositionVertex)
+    std::vector<unsigned char> mPackedPositions;
+
+    // bounding box of the vertices, the quantization range of compressed positions
+    Eigen::AlignedBox3f mBounds;
+
+    // coarser levels of detail, level 1 first, each about half the
+    // triangles of the one before; they index the same vertices
+    std::vector<Eigen::VectorXi> mLodIndices;
+
+    // meshlets of each level of detail, level 0 first, and whether the mesh
+    // is closed.  The cones of the meshlets of a closed mesh point out of
+    // it, whichever way its triangles wind.
+    std::vector<std::vector<Meshlet> > mMeshlets;
+    bool mClosed;
+
+    // bumped whenever the source data changes, so that resident GPU
+    // copies know when to upload it again
+    unsigned int mVersion;
+
+    MeshData() : mMesh(NULL), mIndex(0), mOwner(NULL), mOwnerMesh(0), mVertexBoneData(NULL),
+        mNormals(NULL), mVertices(NULL), mIndices(NULL), mBoneIDs(NULL), mBoneWeights(NULL),
+        mClosed(false), mVersion(0) {}
+};
+
 class Node {
 public:
     aiString     mName;
@@ -33,26 +90,36 @@ public:
     unsigned int mNumChildren;
     Node**       mChildren;
     unsigned int mNumMeshes;
-    aiMesh**     mMeshes;
+    MeshData**   mMeshData;  // the shared record of each mesh of the node
     std::shared_ptr<nori::BSDF>* mMaterials;
 
-    // to be passed to the shaders
-    VertexBoneData*** mVertexBoneData;
-    Eigen::Matrix<float, 3, Eigen::Dynamic>** mNormals;
-    Eigen::Matrix<float, 3, Eigen::Dynamic>** mVertices;
-    Eigen::VectorXi** mIndices;
-    Eigen::Matrix<int, 4, Eigen::Dynamic>** mBoneIDs;
-    Eigen::Matrix<float, 4, Eigen::Dynamic>** mBoneWeights;
+    // pack meshes in the compact vertex formats
+    bool mCompressVertices;
 
     Node* findNode(aiString nodeName);
-    void copyNodes(aiNode* in, aiMesh** meshes, RTUtil::SceneInfo sceneInfo);
+    void copyNodes(aiNode* in, aiMesh** meshes, RTUtil::SceneInfo sceneInfo, std::vector<MeshData*>& meshData);
     static void copyMesh(aiMesh* in, aiMesh* out);
+    bool ownsMesh(int meshIndex) const { return mMeshData[meshIndex]->mOwner == this && mMeshData[meshIndex]->mOwnerMesh == meshIndex; }
+    void touchMesh(int meshIndex);
 
     void loadNormalsForAll();
     void loadVerticesForAll();
     void loadIndicesForAll();
     void loadBonIDsForAll();
     void loadBonWeightsForAll();
+    void weldMeshesForAll();
+    void weldMesh(int meshIndex);
+    void optimizeMeshesForAll();
+    void optimizeMesh(int meshIndex);
+    void buildLodsForAll();
+    void buildLods(int meshIndex);
+    int numLevels(int meshIndex) const { return 1 + mMeshData[meshIndex]->mLodIndices.size(); }
+    void buildMeshletsForAll();
+    void buildMeshlets(int meshIndex);
+    void packVerticesForAll(bool compress);
+    void packVertices(int meshIndex);
+    void getDequantization(int meshIndex, Eigen::Vector3f& scale, Eigen::Vector3f& offset);
+    bool isSkinned() const { return mNumMeshes > 0 && mMeshData[0]->mBoneIDs != NULL && mMeshData[0]->mBoneWeights != NULL; }
     Eigen::VectorXi* getIndices(aiMesh* nodeMeshes);
     Eigen::Matrix<float, 3, Eigen::Dynamic>* getVertices(aiMesh* nodeMeshes);
     Eigen::Matrix<float, 3, Eigen::Dynamic>* getNormals(aiMesh* nodeMeshes);
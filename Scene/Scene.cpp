@@ -22,6 +22,7 @@
 Scene::Scene(int wWidth, int wHeight) {
     windowWidth = wWidth;
     windowHeight = wHeight;
+    mCompressVertices = false;
 }
 
 void Scene::getSceneInfo(const std::string info_file) {
@@ -58,7 +59,9 @@ void Scene::readInptFile(const std::string input_file) {
     rootNode->mParent = NULL;
     // recursivly copy the nodes because sceneImport will be desctroyed
     // at the end of this function. 
-    rootNode->copyNodes(sceneImport->mRootNode, sceneImport->mMeshes, sceneInfo);
+    // Nodes that reference the same mesh share one copy of it
+    mMeshData.assign(sceneImport->mNumMeshes, NULL);
+    rootNode->copyNodes(sceneImport->mRootNode, sceneImport->mMeshes, sceneInfo, mMeshData);
     rootNode->loadNormalsForAll();
     rootNode->loadVerticesForAll();
     rootNode->loadIndicesForAll();
@@ -101,6 +104,25 @@ void Scene::readInptFile(const std::string input_file) {
         rootNode->loadBonWeightsForAll();
         mAnimation->printDebugInfo();
     }
+
+    // merge the duplicated vertices, which the import does not join, then
+    // the static meshes that share a material into world-space batches
+    printMeshCounts("before welding and batching");
+    rootNode->weldMeshesForAll();
+    batchStaticMeshes();
+    printMeshCounts("after welding and batching");
+
+    // reorder triangles and vertices for the vertex cache and fetch
+    rootNode->optimizeMeshesForAll();
+
+    // build the coarser levels of detail drawn for small or distant meshes
+    rootNode->buildLodsForAll();
+
+    // split every level into meshlets culled on their own in each pass
+    rootNode->buildMeshletsForAll();
+
+    // interleave the vertex data of every mesh, ready for upload
+    rootNode->packVerticesForAll(mCompressVertices);
 } 
 
 /*
@@ -129,7 +151,8 @@ void Scene::importNodeInfo(const std::string input_file) {
 
     // recursivly copy the nodes because sceneImport will be desctroyed
     // at the end of this function. 
-    rootNode->copyNodes(sceneImport->mRootNode, sceneImport->mMeshes, sceneInfo);
+    mMeshData.assign(sceneImport->mNumMeshes, NULL);
+    rootNode->copyNodes(sceneImport->mRootNode, sceneImport->mMeshes, sceneInfo, mMeshData);
 }
 
 /*
@@ -236,3 +259,207 @@ void Scene::printTransformation(std::string name, aiMatrix4x4 t) {
         name.c_str(), t.a1, t.a2, t.a3, t.a4, t.b1, t.b2, t.b3, t.b4, t.c1, t.c2, t.c3, t.c4, t.d1, t.d2, t.d3, t.d4);
 }
 
+/*
+ * A node is static if no animation moves it or any of its parents,
+ * and its meshes are not skinned.
+ */
+bool Scene::isStatic(Node* node) {
+    if (node->isSkinned()) {
+        return false;
+    }
+    for (Node* n = node; mAnimation != NULL && n != NULL; n = n->mParent) {
+        if (mAnimation->getNodeAnimation(n->mName) != NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Collect every mesh of the node hierarchy as (node, index of the mesh in the node)
+static void collectNodeMeshes(Node* node, std::vector<std::pair<Node*, int> >& nodeMeshes) {
+    for (int m = 0; m < node->mNumMeshes; m++) {
+        nodeMeshes.push_back(std::make_pair(node, m));
+    }
+    for (int i = 0; i < node->mNumChildren; i++) {
+        collectNodeMeshes(node->mChildren[i], nodeMeshes);
+    }
+}
+
+/*
+ * Merge the meshes of static nodes that share a BSDF into batches: each
+ * batch is the mesh of a new child of the root, whose transformation cancels
+ * the one of the root, and its vertices are transformed to world space.
+ * The merged meshes are removed from their nodes, so a static scene is drawn
+ * with one mesh per material instead of one per node.
+ * Meshes drawn by several nodes stay shared, they are drawn as instances.
+ * A batch is cut before maxBatchVertices, to keep its indices 16 bits.
+ */
+void Scene::batchStaticMeshes() {
+    const int maxBatchVertices = 0x10000;
+
+    std::vector<std::pair<Node*, int> > nodeMeshes;
+    collectNodeMeshes(rootNode, nodeMeshes);
+    std::map<MeshData*, int> references;
+    for (int i = 0; i < nodeMeshes.size(); i++) {
+        references[nodeMeshes[i].first->mMeshData[nodeMeshes[i].second]]++;
+    }
+
+    // the static meshes of each BSDF, in the order of the hierarchy
+    std::vector<nori::BSDF*> order;
+    std::map<nori::BSDF*, std::vector<std::pair<Node*, int> > > groups;
+    for (int i = 0; i < nodeMeshes.size(); i++) {
+        Node* node = nodeMeshes[i].first;
+        int m = nodeMeshes[i].second;
+        if (references[node->mMeshData[m]] > 1 || !isStatic(node)) {
+            continue;
+        }
+        nori::BSDF* bsdf = node->mMaterials[m].get();
+        if (groups.find(bsdf) == groups.end()) {
+            order.push_back(bsdf);
+        }
+        groups[bsdf].push_back(nodeMeshes[i]);
+    }
+
+    // cut the meshes of each BSDF into batches, and note the meshes merged
+    std::vector<Node*> batchNodes;
+    std::map<Node*, std::vector<bool> > removed;
+    for (int b = 0; b < order.size(); b++) {
+        std::vector<std::pair<Node*, int> >& group = groups[order[b]];
+        if (group.size() < 2) {
+            continue;
+        }
+
+        int first = 0;
+        while (first < group.size()) {
+            int numVertices = 0;
+            int numIndices = 0;
+            int end = first;
+            while (end < group.size()) {
+                MeshData* data = group[end].first->mMeshData[group[end].second];
+                if (end > first && numVertices + data->mVertices->cols() > maxBatchVertices) {
+                    break;
+                }
+                numVertices += data->mVertices->cols();
+                numIndices += data->mIndices->size();
+                end++;
+            }
+            if (end - first < 2) {
+                first = end;
+                continue;
+            }
+
+            MeshData* batch = new MeshData();
+            batch->mIndex = mMeshData.size();
+            batch->mVertices = new Eigen::Matrix<float, 3, Eigen::Dynamic>(3, numVertices);
+            batch->mNormals = new Eigen::Matrix<float, 3, Eigen::Dynamic>(3, numVertices);
+            batch->mIndices = new Eigen::VectorXi(numIndices);
+
+            int baseVertex = 0;
+            int baseIndex = 0;
+            for (int k = first; k < end; k++) {
+                Node* node = group[k].first;
+                MeshData* data = node->mMeshData[group[k].second];
+                Eigen::Matrix4f t = RTUtil::a2e(Node::getTransformation(node, node->mTransformation)).matrix();
+                Eigen::Matrix3f normalMatrix = t.topLeftCorner<3, 3>().inverse().transpose();
+                bool mirrored = t.topLeftCorner<3, 3>().determinant() < 0.0f;
+
+                int count = data->mVertices->cols();
+                for (int v = 0; v < count; v++) {
+                    batch->mVertices->col(baseVertex + v) = (t * data->mVertices->col(v).homogeneous()).head<3>();
+                    batch->mNormals->col(baseVertex + v) = (normalMatrix * data->mNormals->col(v)).normalized();
+                }
+                // a mirroring transformation turns the triangles over, keep their winding
+                const Eigen::VectorXi& indices = *(data->mIndices);
+                for (int i = 0; i < indices.size(); i += 3) {
+                    (*batch->mIndices)(baseIndex + i) = baseVertex + indices(i);
+                    (*batch->mIndices)(baseIndex + i + 1) = baseVertex + indices(mirrored ? i + 2 : i + 1);
+                    (*batch->mIndices)(baseIndex + i + 2) = baseVertex + indices(mirrored ? i + 1 : i + 2);
+                }
+                baseVertex += count;
+                baseIndex += indices.size();
+
+                std::vector<bool>& r = removed[node];
+                r.resize(node->mNumMeshes, false);
+                r[group[k].second] = true;
+                mMeshData[data->mIndex] = NULL;
+                delete data->mVertices;
+                delete data->mNormals;
+                delete data->mIndices;
+                delete data->mMesh;
+                delete data;
+            }
+
+            Node* batchNode = new Node();
+            batchNode->mName = aiString("static batch " + std::to_string(batchNodes.size()));
+            batchNode->mTransformation = rootNode->mTransformation;
+            batchNode->mTransformation.Inverse();
+            batchNode->mParent = rootNode;
+            batchNode->mNumMeshes = 1;
+            batchNode->mMeshData = new MeshData*[1];
+            batchNode->mMeshData[0] = batch;
+            batchNode->mMaterials = new std::shared_ptr<nori::BSDF>[1];
+            batchNode->mMaterials[0] = group[first].first->mMaterials[group[first].second];
+            batch->mOwner = batchNode;
+            batch->mOwnerMesh = 0;
+            mMeshData.push_back(batch);
+            batchNodes.push_back(batchNode);
+
+            first = end;
+        }
+    }
+
+    // drop the merged meshes from their nodes
+    for (std::map<Node*, std::vector<bool> >::iterator it = removed.begin(); it != removed.end(); ++it) {
+        Node* node = it->first;
+        int numMeshes = 0;
+        for (int m = 0; m < node->mNumMeshes; m++) {
+            if (it->second[m]) {
+                continue;
+            }
+            if (node->ownsMesh(m)) {
+                node->mMeshData[m]->mOwnerMesh = numMeshes;
+            }
+            node->mMeshData[numMeshes] = node->mMeshData[m];
+            node->mMaterials[numMeshes] = node->mMaterials[m];
+            numMeshes++;
+        }
+        node->mNumMeshes = numMeshes;
+    }
+
+    // hang the batches under the root
+    if (!batchNodes.empty()) {
+        Node** children = new Node*[rootNode->mNumChildren + batchNodes.size()];
+        for (int i = 0; i < rootNode->mNumChildren; i++) {
+            children[i] = rootNode->mChildren[i];
+        }
+        for (int i = 0; i < batchNodes.size(); i++) {
+            children[rootNode->mNumChildren + i] = batchNodes[i];
+        }
+        delete[] rootNode->mChildren;
+        rootNode->mChildren = children;
+        rootNode->mNumChildren += batchNodes.size();
+    }
+
+    #ifdef DEBUG
+        printf("Scene: %d static batches\n", (int) batchNodes.size());
+    #endif
+}
+
+/*
+ * Print the number of unique meshes, of node meshes (the objects drawn)
+ * and of vertices of the scene.
+ */
+void Scene::printMeshCounts(const char* stage) {
+    std::vector<std::pair<Node*, int> > nodeMeshes;
+    collectNodeMeshes(rootNode, nodeMeshes);
+    int numMeshes = 0;
+    int numVertices = 0;
+    for (int i = 0; i < mMeshData.size(); i++) {
+        if (mMeshData[i] != NULL && mMeshData[i]->mVertices != NULL) {
+            numMeshes++;
+            numVertices += mMeshData[i]->mVertices->cols();
+        }
+    }
+    printf("Meshes %s: %d meshes drawn by %d node meshes, %d vertices\n",
+        stage, numMeshes, (int) nodeMeshes.size(), numVertices);
+}
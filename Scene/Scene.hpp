@@ -29,15 +29,20 @@ public:
     std::shared_ptr<RTUtil::PerspectiveCamera> camera;
     std::shared_ptr<RTUtil::PerspectiveCamera> defaultCamera;
     Node* rootNode;
+    std::vector<MeshData*> mMeshData;  // one record per mesh of the source file, shared by the nodes using it
     int numLights;
     int mNumAnimations;
     Animation* mAnimation;
+    bool mCompressVertices;  // pack meshes in the compact vertex formats
 
 
     Scene(int wWidth, int wHeight);
     void getSceneInfo(const std::string info_file);
     void readInptFile(const std::string input_file);
     void importNodeInfo(const std::string input_file);
+    bool isStatic(Node* node);
+    void batchStaticMeshes();
+    void printMeshCounts(const char* stage);
     std::shared_ptr<RTUtil::LightInfo> getDefaultLight();
     std::shared_ptr<RTUtil::LightInfo> getFirstPointLight();
     aiMatrix4x4 getLightTransformation(std::string name);
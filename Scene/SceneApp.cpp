@@ -1,5 +1,6 @@
 
 #include <unistd.h>
+#include <chrono>
 
 #include <nanogui/window.h>
 #include <nanogui/glcanvas.h>
@@ -31,11 +32,29 @@ const int SceneApp::windowWidth = 800;
 const int shadowWidth = 1024;
 const int shadowHeight = 1024;
 
+// Levels of detail: a mesh is drawn at full detail while its bounding sphere
+// covers at least lodFullDetailSize of the viewport height, and one level
+// coarser every time that size halves.  The bias adds levels, shadow maps
+// can do with coarser meshes than the camera view.
+const float lodFullDetailSize = 0.5f;
+const int cameraLodBias = 0;
+const int shadowLodBias = 1;
+
+// Room for one uniform block of a pass in the uniform buffer, as aligned
+// (GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT is at most 256 on common hardware)
+const std::size_t passBlockSize = 256;
+
+// Buffer shown by the lighting passes instead of the lighting, for debugging:
+// one of the display modes of pointlightpass.fs and ambientlightpass.fs,
+// 0 for the lighting.  Non-zero values build the DEBUG_VIEW program variants.
+const int debugView = 0;
+
 
 // Constructor runs after nanogui is initialized and the OpenGL context is current.
-SceneApp::SceneApp(std::string inputFile, std::string infoFile, std::string skyboxName)
+SceneApp::SceneApp(std::string inputFile, std::string infoFile, std::string skyboxName, bool compressVertices,
+    float impostorDistance)
 : nanogui::Screen(Eigen::Vector2i(windowWidth, windowHeight), "Christina Li's Scene App", false),
-  backgroundColor(0.4f, 0.4f, 0.7f, 1.0f) {
+  mImpostorDistance(impostorDistance), backgroundColor(0.4f, 0.4f, 0.7f, 1.0f) {
 
     mScene = new Scene(windowWidth, windowHeight);
 
@@ -53,8 +72,14 @@ SceneApp::SceneApp(std::string inputFile, std::string infoFile, std::string skyb
 
 
     // get node hierarchy from the input .obj file and setup the camera
+    mScene->mCompressVertices = compressVertices;
     mScene->readInptFile(inputFile);
 
+    // upload all the meshes once, draw calls only bind the resident meshes
+    mMeshStore.reset(new MeshStore());
+    mMeshStore->build(mScene->rootNode);
+    setMaterials();
+
     #ifdef DEBUG
         Scene::printTransformation("Root", mScene->rootNode->mTransformation);
     #endif
@@ -76,33 +101,54 @@ SceneApp::SceneApp(std::string inputFile, std::string infoFile, std::string skyb
     mSkyboxName = skyboxName;
 
     setCamera();
+    mPrograms.reset(new GLWrap::ProgramCache("programcache"));
     setShaders();
 
-    // create a framebuffer for G-Buffers in geometry pass
+    // the camera block never grows; the pass blocks start with room for the
+    // shadow view and the light of every light, and grow when they are short
+    mFrameBlocks.reset(new GLWrap::StreamBuffer(GL_UNIFORM_BUFFER, sizeof(ViewBlock)));
+    mPassBlocks.reset(new GLWrap::StreamBuffer(GL_UNIFORM_BUFFER,
+        2 * (mScene->sceneInfo.lights.size() + 1) * passBlockSize));
+    mCameraBlock = 0;
+    mPassViewBound = mPassLightBound = false;
+
+    // the samplers of the passes, set up once instead of every frame
+    mNearestSampler.reset(new GLWrap::Sampler(GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE));
+    mMipmapSampler.reset(new GLWrap::Sampler(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE));
+    mLinearSampler.reset(new GLWrap::Sampler(GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE));
+    mStateIssued = mStateSkipped = 0;
+
+    // the render targets are made by the pool when a pass of the frame graph
+    // first asks for them
+    mTargets.reset(new GLWrap::RenderTargetPool());
+    mFrameGraph.reset(new GLWrap::FrameGraph(*mTargets));
+    mReportTargets = 0;
+
+    // the G-Buffers of the geometry pass
     Eigen::Vector2i size(windowWidth, windowHeight);
-    gBuffer = std::make_shared<GLWrap::Framebuffer>(size, 5);
-
-    // create a framebuffer for the shadow map in the shadow pass
-    Eigen::Vector2i shadowMapSize(shadowWidth, shadowHeight);
-    shadowMapBuffer = std::make_shared<GLWrap::Framebuffer>(shadowMapSize, 0);
-
-    // create a framebuffer for accumulating lightings in the lighting pass
-    std::vector<std::pair<GLenum, GLenum>> c_format;
-    c_format.emplace_back(std::make_pair(GL_RGBA32F, GL_RGBA));               
-    accumulationBuffer = std::make_shared<GLWrap::Framebuffer>(size, c_format);
-    accumulationBuffer->colorTexture(0).generateMipmap();
-
-    // create 2 framebuffers holding the intermediate results of the gaussion blur
-    // between the vertical and horizontal pass.
-    tempBuffer1 = std::make_shared<GLWrap::Framebuffer>(size, c_format);
-    tempBuffer2 = std::make_shared<GLWrap::Framebuffer>(size, c_format);
-    
-    // create buffer for merge pass
-    mergeBuffer = std::make_shared<GLWrap::Framebuffer>(size, c_format);
+    mGBufferDesc = GLWrap::RenderTargetDesc(size);
+    for (int i = 0; i < 5; i++) {
+        mGBufferDesc.addColor(GL_RGBA8, GL_RGBA);
+    }
+    mGBufferDesc.setDepth(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT);
+
+    // the shadow map of the shadow pass
+    mShadowMapDesc = GLWrap::RenderTargetDesc(Eigen::Vector2i(shadowWidth, shadowHeight));
+    mShadowMapDesc.setDepth(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT);
+
+    // the accumulation of the lighting passes, with the mipmap levels read by
+    // the blur pass, and the intermediate results of the gaussian blur
+    // between the vertical and horizontal pass
+    mMipmapDesc = GLWrap::RenderTargetDesc(size, GLWrap::Texture2D::mipmapLevels(size));
+    mMipmapDesc.addColor(GL_RGBA32F, GL_RGBA);
+
+    // the image of the merge pass; a blur target freed by then stands in for it
+    mImageDesc = GLWrap::RenderTargetDesc(size);
+    mImageDesc.addColor(GL_RGBA32F, GL_RGBA);
 
-    // create buffer for skybox pass to draw on, it contains the depth texture
-    std::pair<GLenum, GLenum> d_format=std::make_pair(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT);
-    skyboxBuffer = std::make_shared<GLWrap::Framebuffer>(size, c_format, d_format);
+    // the image of the skybox pass, with the depth of the G-Buffers
+    mSkyboxDesc = GLWrap::RenderTargetDesc(size);
+    mSkyboxDesc.addColor(GL_RGBA32F, GL_RGBA).setDepth(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT);
 
     mSky = std::make_shared<RTUtil::Sky>(85.0*M_PI/180.0 , 7.0);
 
@@ -147,107 +193,209 @@ void SceneApp::setCamera() {
 void SceneApp::setShaders() {
     const std::string resourcePath =
         cpplocate::locatePath("resources/Common", "", nullptr) + "resources/";
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    mPrograms->resetStats();
+
+    // the program variants of this scene: skinning for animations with
+    // bone weights, and the debug views of the lighting passes
+    std::vector<std::string> skinnedDefines;
+    if (mScene->mAnimation != NULL && mScene->mAnimation->mNumBones > 0) {
+        skinnedDefines.push_back("SKINNED");
+    }
+    std::vector<std::string> lightDefines;
+    if (debugView != 0) {
+        lightDefines.push_back("DEBUG_VIEW " + std::to_string(debugView));
+    }
 
     if (mShowSkybox == true) {
-        skyboxPassProg.reset(new GLWrap::Program("skyboxprogram", { 
+        skyboxPassProg = mPrograms->get("skyboxprogram", { 
             { GL_VERTEX_SHADER,   "../Scene/skybox.vs" },
             { GL_FRAGMENT_SHADER, "../Scene/skybox.fs" }
-        }));
+        });
     }
 
     if (mDeferredRendering == false) {
         if (mUseFlatShader == true) {
-            forwardRenderProg.reset(new GLWrap::Program("program", { 
+            forwardRenderProg = mPrograms->get("program", { 
                 { GL_VERTEX_SHADER, "../Scene/min_mod.vs" },
+                { GL_VERTEX_SHADER, "../Scene/vertexdecode.vs" },
                 { GL_GEOMETRY_SHADER, resourcePath + "Common/shaders/flat.gs" },
                 { GL_FRAGMENT_SHADER, resourcePath + "Common/shaders/lambert.fs"}
-            }));        
+            }, skinnedDefines);        
         } else {
-            forwardRenderProg.reset(new GLWrap::Program("forwardprogram", { 
+            forwardRenderProg = mPrograms->get("forwardprogram", { 
                 { GL_VERTEX_SHADER,   "../Scene/forwardrender.vs" },
+                { GL_VERTEX_SHADER,   "../Scene/vertexdecode.vs" },
                 { GL_FRAGMENT_SHADER, resourcePath + "Common/shaders/microfacet.fs" },
+                { GL_FRAGMENT_SHADER, "../Scene/material.fs" },
                 { GL_FRAGMENT_SHADER, "../Scene/forwardrender.fs" }
-            }));
+            }, skinnedDefines);
         }
     } else {
-        geoPassProg.reset(new GLWrap::Program("geopassprogram", { 
+        geoPassProg = mPrograms->get("geopassprogram", { 
             { GL_VERTEX_SHADER,   "../Scene/geopass.vs" },
+            { GL_VERTEX_SHADER,   "../Scene/vertexdecode.vs" },
+            { GL_FRAGMENT_SHADER, "../Scene/material.fs" },
             { GL_FRAGMENT_SHADER, "../Scene/geopass.fs" }
-        }));
+        });
 
-        shadowPassProg.reset(new GLWrap::Program("shadowpassprogram", { 
+        shadowPassProg = mPrograms->get("shadowpassprogram", { 
             { GL_VERTEX_SHADER,   "../Scene/shadowpass.vs" },
+            { GL_VERTEX_SHADER,   "../Scene/vertexdecode.vs" },
             { GL_FRAGMENT_SHADER, "../Scene/shadowpass.fs" }
-        }));
+        });
+
+        impostorProg = mPrograms->get("impostorprogram", { 
+            { GL_VERTEX_SHADER,   "../Scene/impostor.vs" },
+            { GL_FRAGMENT_SHADER, "../Scene/impostor.fs" }
+        });
 
-        pointLightPassProg.reset(new GLWrap::Program("pointlightpassprogram", { 
+        pointLightPassProg = mPrograms->get("pointlightpassprogram", { 
             { GL_VERTEX_SHADER,   "../Scene/passthrough.vs" },
             { GL_FRAGMENT_SHADER, resourcePath + "Common/shaders/microfacet.fs" },
+            { GL_FRAGMENT_SHADER, "../Scene/viewray.fs" },
             { GL_FRAGMENT_SHADER, "../Scene/pointlightpass.fs" }
-        }));
+        }, lightDefines);
 
-        ambientLightPassProg.reset(new GLWrap::Program("ambientlightpassprogram", { 
+        ambientLightPassProg = mPrograms->get("ambientlightpassprogram", { 
             { GL_VERTEX_SHADER,   "../Scene/passthrough.vs" },
+            { GL_FRAGMENT_SHADER, "../Scene/viewray.fs" },
             { GL_FRAGMENT_SHADER, "../Scene/ambientlightpass.fs" }
             //{ GL_FRAGMENT_SHADER, "../Scene/lightpass_diffuse.fs" }
-        }));
+        }, lightDefines);
 
-        sunSkyPassProg.reset(new GLWrap::Program("sunskypassprogram", { 
+        sunSkyPassProg = mPrograms->get("sunskypassprogram", { 
             { GL_VERTEX_SHADER,   "../Scene/passthrough.vs" },
             { GL_FRAGMENT_SHADER, resourcePath + "Common/shaders/sunsky.fs" },
+            { GL_FRAGMENT_SHADER, "../Scene/viewray.fs" },
             { GL_FRAGMENT_SHADER, "../Scene/sunskypass.fs" }
-        }));
+        });
 
-        blurPassProg.reset(new GLWrap::Program("blurpassprogram", { 
+        blurPassProg = mPrograms->get("blurpassprogram", { 
             { GL_VERTEX_SHADER,   "../Scene/passthrough.vs" },
             { GL_FRAGMENT_SHADER, resourcePath + "Common/shaders/blur.fs" }
-        }));
+        });
 
-        mergePassProg.reset(new GLWrap::Program("mergepassprogram", {
+        mergePassProg = mPrograms->get("mergepassprogram", {
             { GL_VERTEX_SHADER, "../Scene/passthrough.vs"}, 
             { GL_FRAGMENT_SHADER, "../Scene/mergepass.fs" }
-        }));
+        });
 
-        srgbPassProg.reset(new GLWrap::Program("srgbpassprogram", {
+        srgbPassProg = mPrograms->get("srgbpassprogram", {
             { GL_VERTEX_SHADER, resourcePath + "Common/shaders/fsq.vert" }, 
             { GL_FRAGMENT_SHADER, resourcePath + "Common/shaders/srgb.frag" }
-        }));
+        });
 
-        skyboxRflctPassProg.reset(new GLWrap::Program("skyboxreflectionprogram", {
+        skyboxRflctPassProg = mPrograms->get("skyboxreflectionprogram", {
             { GL_VERTEX_SHADER, "../Scene/passthrough.vs"}, 
+            { GL_FRAGMENT_SHADER, "../Scene/viewray.fs" },
             { GL_FRAGMENT_SHADER, "../Scene/skyboxreflection.fs" }
-        }));
+        });
+
+    }
 
+    // every program reads the camera and the light from the shared uniform blocks
+    std::shared_ptr<GLWrap::Program>* programs[] = {
+        &forwardRenderProg, &geoPassProg, &shadowPassProg, &pointLightPassProg, &ambientLightPassProg,
+        &sunSkyPassProg, &skyboxRflctPassProg, &skyboxPassProg, &impostorProg
+    };
+    for (std::shared_ptr<GLWrap::Program>* prog : programs) {
+        setUniformBlocks(*prog);
     }
+
+    // programs built from source make a cold start, the others a warm one
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("Shaders: %d built, %d loaded from disk, %d reused in %.1f ms\n",
+        mPrograms->numBuilt(), mPrograms->numLoaded(), mPrograms->numReused(), ms);
 }
 
 void SceneApp::drawContents() {
     GLWrap::checkGLError("drawContents start");
     glClearColor(0.0, 0.0, 0.0, 0.0);
 
+    // the GUI draws between frames with plain OpenGL calls, so the state
+    // cache starts every frame from scratch
+    GLWrap::StateCache::invalidate();
+    GLWrap::StateCache::resetCounters();
+
+    // the per-pass instance data and uniform blocks of this frame are
+    // streamed between these two calls
+    mMeshStore->beginFrame();
+    mFrameBlocks->beginFrame();
+    mPassBlocks->beginFrame();
+    if (mImpostors) {
+        mImpostors->beginFrame();
+    }
+    mTargets->beginFrame();
+    writeCameraBlock();
+    drawFrame();
+    mTargets->endFrame();
+    if (mImpostors) {
+        mImpostors->endFrame();
+    }
+    mPassBlocks->endFrame();
+    mFrameBlocks->endFrame();
+    mMeshStore->endFrame();
+
+    // the GUI reads its textures on unit 0 with their own parameters, not
+    // through the samplers the passes left on the units of their inputs
+    for (int unit = 0; unit < 7; unit++) {
+        GLWrap::Sampler::unbind(unit);
+    }
+
+    mStateIssued = GLWrap::StateCache::numIssued();
+    mStateSkipped = GLWrap::StateCache::numSkipped();
+
+    // the targets of the previous configuration are deleted at the end of
+    // its first frame, the second frame shows what this one needs
+    if (mReportTargets > 0 && --mReportTargets == 0) {
+        printf("Frame graph:\n");
+        mFrameGraph->printStats();
+        mTargets->printStats();
+    }
+}
+
+/*
+ * Declare the passes of one frame in the frame graph and run them.
+ * Each pass declares the targets it reads and writes; the graph orders the
+ * passes, culls those whose targets nothing shows (e.g. the lighting
+ * passes while the G-buffers are shown), acquires the targets from the
+ * pool for the passes using them, copies the depth and lighting under the
+ * skybox and generates the mipmaps the blur reads.
+ */
+void SceneApp::drawFrame() {
+    typedef GLWrap::FrameGraph::Resource Resource;
+    const Resource window = GLWrap::FrameGraph::backbuffer;
+    mFrameGraph->reset();
+
     if (mDeferredRendering == false) {
 
         // draw object in the scene
-        forwardRendering();
+        int forward = mFrameGraph->addPass("forward", [this]() { forwardRendering(); });
+        mFrameGraph->write(forward, window);
 
         // add skybox
         if (mShowSkybox == true) {
-            skyboxPass();
+            int skybox = mFrameGraph->addPass("skybox", [this]() { skyboxPass(NULL); });
+            mFrameGraph->write(skybox, window);
         }
     } else {
         // create g-buffers
-        geometryPass();
-        if (mShowGBuffers == true) {
-            displayGBuffers();
-            return;
-        }
+        Resource gBuffer = mFrameGraph->create("G-buffers", mGBufferDesc);
+        int geometry = mFrameGraph->addPass("geometry", [this, gBuffer]() {
+            geometryPass(mFrameGraph->target(gBuffer));
+        });
+        mFrameGraph->write(geometry, gBuffer);
 
         // clear the accumulation buffer
-        accumulationBuffer->bind(0);
-        unsigned int attachment[1] = { GL_COLOR_ATTACHMENT0};
-        glDrawBuffers(1, attachment);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        //accumulationBuffer->unbind();
+        Resource accumulation = mFrameGraph->create("accumulation", mMipmapDesc);
+        int clear = mFrameGraph->addPass("clear", [this, accumulation]() {
+            mFrameGraph->target(accumulation).bind(0);
+            unsigned int attachment[1] = { GL_COLOR_ATTACHMENT0};
+            glDrawBuffers(1, attachment);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        });
+        mFrameGraph->write(clear, accumulation);
 
         // go through each light, render light effect
         for (std::shared_ptr<RTUtil::LightInfo> light: mScene->sceneInfo.lights) {
@@ -269,65 +417,138 @@ void SceneApp::drawContents() {
                     1.0 // fov
                 );
 
-                shadowPass(light, lightCam);
-                pointLightingPass(light, lightCam);
+                // every light has its shadow map, they share one target
+                Resource shadowMap = mFrameGraph->create("shadow map", mShadowMapDesc);
+                int shadow = mFrameGraph->addPass("shadow", [this, lightCam, shadowMap]() {
+                    shadowPass(lightCam, mFrameGraph->target(shadowMap));
+                });
+                mFrameGraph->write(shadow, shadowMap);
+
+                int lighting = mFrameGraph->addPass("point light",
+                    [this, light, lightCam, gBuffer, shadowMap, accumulation]() {
+                    pointLightingPass(light, lightCam, mFrameGraph->target(gBuffer),
+                        mFrameGraph->target(shadowMap), mFrameGraph->target(accumulation));
+                });
+                mFrameGraph->read(lighting, gBuffer);
+                mFrameGraph->read(lighting, shadowMap);
+                mFrameGraph->write(lighting, accumulation);
             } else if (light->type == Ambient) {
-                ambientLightingPass(light);
+                int lighting = mFrameGraph->addPass("ambient light", [this, light, gBuffer, accumulation]() {
+                    ambientLightingPass(light, mFrameGraph->target(gBuffer), mFrameGraph->target(accumulation));
+                });
+                mFrameGraph->read(lighting, gBuffer);
+                mFrameGraph->write(lighting, accumulation);
             }
         }
 
+        // the image shown: the lighting, with the skybox or the sun-sky and its blur
+        Resource image = accumulation;
         if (mShowSkybox == true) {
             if (mShowMirrorRflt == true) {
-                skyboxMirrorReflectionPass();
+                int reflection = mFrameGraph->addPass("skybox reflection", [this, gBuffer, accumulation]() {
+                    skyboxMirrorReflectionPass(mFrameGraph->target(gBuffer), mFrameGraph->target(accumulation));
+                });
+                mFrameGraph->read(reflection, gBuffer);
+                mFrameGraph->write(reflection, accumulation);
             }
-            skyboxPass();
-            displayFBuffer(skyboxBuffer);
+
+            // the skybox is drawn behind the depth of the g-buffers, over the lighting
+            Resource skyboxBuffer = mFrameGraph->create("skybox", mSkyboxDesc);
+            int skybox = mFrameGraph->addPass("skybox", [this, skyboxBuffer]() {
+                skyboxPass(&mFrameGraph->target(skyboxBuffer));
+            });
+            mFrameGraph->copy(skybox, gBuffer, skyboxBuffer, GL_DEPTH_BUFFER_BIT);
+            mFrameGraph->copy(skybox, accumulation, skyboxBuffer, GL_COLOR_BUFFER_BIT);
+            image = skyboxBuffer;
         } else if (mShowSunSky){
-            sunSkyPass();
+            int sunSky = mFrameGraph->addPass("sun-sky", [this, gBuffer, accumulation]() {
+                sunSkyPass(mFrameGraph->target(gBuffer), mFrameGraph->target(accumulation));
+            });
+            mFrameGraph->read(sunSky, gBuffer);
+            mFrameGraph->write(sunSky, accumulation);
 
             if (mShowBlur){
-                blurPass();
-                mergePass();
-                displayFBuffer(mergeBuffer);
+                // the blur writes the levels of its targets itself, only the
+                // mipmaps of the lighting are generated
+                Resource tempBuffer1 = mFrameGraph->create("blur 1", mMipmapDesc);
+                Resource tempBuffer2 = mFrameGraph->create("blur 2", mMipmapDesc);
+                int blur = mFrameGraph->addPass("blur", [this, accumulation, tempBuffer1, tempBuffer2]() {
+                    blurPass(mFrameGraph->target(accumulation), mFrameGraph->target(tempBuffer1),
+                        mFrameGraph->target(tempBuffer2));
+                });
+                mFrameGraph->read(blur, accumulation, true);
+                mFrameGraph->write(blur, tempBuffer1);
+                mFrameGraph->write(blur, tempBuffer2);
+
+                Resource mergeBuffer = mFrameGraph->create("merge", mImageDesc);
+                int merge = mFrameGraph->addPass("merge", [this, accumulation, tempBuffer2, mergeBuffer]() {
+                    mergePass(mFrameGraph->target(accumulation), mFrameGraph->target(tempBuffer2),
+                        mFrameGraph->target(mergeBuffer));
+                });
+                mFrameGraph->read(merge, accumulation, true);
+                mFrameGraph->read(merge, tempBuffer2);
+                mFrameGraph->write(merge, mergeBuffer);
+                image = mergeBuffer;
             }
+        }
+
+        // show the image, or the g-buffers instead of it
+        if (mShowGBuffers == true) {
+            int show = mFrameGraph->addPass("show G-buffers", [this, gBuffer]() {
+                displayGBuffers(mFrameGraph->target(gBuffer));
+            });
+            mFrameGraph->read(show, gBuffer);
+            mFrameGraph->write(show, window);
         } else {
-            displayFBuffer(accumulationBuffer);
+            int show = mFrameGraph->addPass("show", [this, image]() {
+                displayFBuffer(mFrameGraph->target(image));
+            });
+            mFrameGraph->read(show, image);
+            mFrameGraph->write(show, window);
         }
     }
+
+    mFrameGraph->execute();
 }
 
 /*
  * Geometry pass: render geometry from camera view, write surface info
  * to g-buffers.
  */
-void SceneApp::geometryPass() {
-    gBuffer->bind(0);
+void SceneApp::geometryPass(const GLWrap::Framebuffer &gBuffer) {
+    if (mImpostorDistance > 0.0f && !mImpostors) {
+        bakeImpostors();
+    }
+
+    gBuffer.bind(0);
     unsigned int attachments[5] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4};
     glDrawBuffers(5, attachments);
 
-    glViewport(0, 0, windowWidth, windowHeight);
+    GLWrap::StateCache::viewport(0, 0, windowWidth, windowHeight);
+    GLWrap::StateCache::depthMask(true);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
-    glDisable(GL_BLEND); 
-    glDepthMask(GL_TRUE);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    GLWrap::StateCache::setEnabled(GL_DEPTH_TEST, true);
+    GLWrap::StateCache::setEnabled(GL_BLEND, false);
 
     geoPassProg->use();
 
-    // set camera uniforms
-    setCameraUniforms(geoPassProg, false);
+    geoPassProg->uniform("octNormals", mScene->mCompressVertices ? 1 : 0);
+    bindMaterials(geoPassProg);
 
     // set up and draw meshes for each node
-    drawMeshes(mScene->rootNode, geoPassProg, true);
+    mMeshStore->bind();
+    drawMeshes(geoPassProg, true, currentCamera(), cameraLodBias, mImpostors != NULL);
+    mMeshStore->unbind();
     geoPassProg->unuse();
 
-    glDisable(GL_DEPTH_TEST);
+    // the distant objects left out by drawMeshes
+    if (mImpostors && mImpostors->numInstances() > 0) {
+        impostorProg->use();
+        mImpostors->draw(*impostorProg, 0);
+        impostorProg->unuse();
+    }
+
+    GLWrap::StateCache::setEnabled(GL_DEPTH_TEST, false);
 }
 
 /*
@@ -335,31 +556,30 @@ void SceneApp::geometryPass() {
  * producing a depth buffer (shadow map).
  * lightCam -- the camera from the light view
  */
-void SceneApp::shadowPass(std::shared_ptr<RTUtil::LightInfo> light, std::shared_ptr<RTUtil::PerspectiveCamera> lightCam) {
+void SceneApp::shadowPass(std::shared_ptr<RTUtil::PerspectiveCamera> lightCam, const GLWrap::Framebuffer &shadowMapBuffer) {
 
     shadowPassProg->use();
 
-    shadowMapBuffer->bind(0);
+    shadowMapBuffer.bind(0);
 
-    glDepthMask(GL_TRUE);
-    glEnable(GL_DEPTH_TEST);
+    GLWrap::StateCache::depthMask(true);
+    GLWrap::StateCache::setEnabled(GL_DEPTH_TEST, true);
     glClear(GL_DEPTH_BUFFER_BIT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
 
-    glViewport(0, 0, shadowWidth, shadowHeight);
+    GLWrap::StateCache::viewport(0, 0, shadowWidth, shadowHeight);
 
-    shadowPassProg->uniform("mV", lightCam->getViewMatrix().matrix());
-    shadowPassProg->uniform("mP", lightCam->getProjectionMatrix().matrix());
+    bindViewBlock(lightCam->getViewMatrix().matrix(), lightCam->getProjectionMatrix().matrix(),
+        lightCam->getEye(), Eigen::Vector2i(shadowWidth, shadowHeight));
  
-    drawMeshes(mScene->rootNode, shadowPassProg, false);
+    mMeshStore->bind(true);
+    drawMeshes(shadowPassProg, false, lightCam, shadowLodBias, false);
+    mMeshStore->unbind();
+
+    // the passes after this one see the scene from the camera again
+    bindCameraBlock();
 
     shadowPassProg->unuse();
-    glDisable(GL_DEPTH_TEST);
+    GLWrap::StateCache::setEnabled(GL_DEPTH_TEST, false);
 }
 
 /*
@@ -367,27 +587,31 @@ void SceneApp::shadowPass(std::shared_ptr<RTUtil::LightInfo> light, std::shared_
  * effect for a point light and add to the accumulation buffer.
  * lightCam -- the camera from the light view.
  */
- void SceneApp::pointLightingPass(std::shared_ptr<RTUtil::LightInfo> light, std::shared_ptr<RTUtil::PerspectiveCamera> lightCam) {
+ void SceneApp::pointLightingPass(std::shared_ptr<RTUtil::LightInfo> light, std::shared_ptr<RTUtil::PerspectiveCamera> lightCam,
+    const GLWrap::Framebuffer &gBuffer, const GLWrap::Framebuffer &shadowMapBuffer, const GLWrap::Framebuffer &accumulationBuffer) {
     // bind accumulationBuffer for writing
-    accumulationBuffer->bind(0);
+    accumulationBuffer.bind(0);
 
-    glViewport(0, 0, windowWidth, windowHeight);
-    glEnable(GL_BLEND);
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_ONE, GL_ONE);
+    GLWrap::StateCache::viewport(0, 0, windowWidth, windowHeight);
+    GLWrap::StateCache::setEnabled(GL_BLEND, true);
+    GLWrap::StateCache::blendEquation(GL_FUNC_ADD);
+    GLWrap::StateCache::blendFunc(GL_ONE, GL_ONE);
 
     // bind the G-Buffers for reading
     pointLightPassProg->use();
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer->id());
+    GLWrap::StateCache::bindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer.id());
     for (int i = 0; i < 5; i++) {
-        gBuffer->colorTexture(i).bindToTextureUnit(i);
+        gBuffer.colorTexture(i).bindToTextureUnit(i);
+        mNearestSampler->bindToTextureUnit(i);
     }
 
     // bind the depth texture from the camera direction for reading
-    gBuffer->depthTexture().bindToTextureUnit(5);
+    gBuffer.depthTexture().bindToTextureUnit(5);
+    mNearestSampler->bindToTextureUnit(5);
 
     // bind the depth map from the light direction for reading. (shadowmap)  
-    shadowMapBuffer->depthTexture().bindToTextureUnit(6);
+    shadowMapBuffer.depthTexture().bindToTextureUnit(6);
+    mNearestSampler->bindToTextureUnit(6);
 
     pointLightPassProg->uniform("gNormal", 0);
     pointLightPassProg->uniform("gDiffuse_r", 1);
@@ -396,12 +620,8 @@ void SceneApp::shadowPass(std::shared_ptr<RTUtil::LightInfo> light, std::shared_
     pointLightPassProg->uniform("gDepth", 5);
     pointLightPassProg->uniform("shadowMap", 6);
 
-    // set window, camera and light related uniforms
-    setWindowUniforms(pointLightPassProg);
-    setCameraUniforms(pointLightPassProg, true);
-    setLightUniforms(pointLightPassProg, light);
-    pointLightPassProg->uniform("mV_l", lightCam->getViewMatrix().matrix());
-    pointLightPassProg->uniform("mP_l", lightCam->getProjectionMatrix().matrix());
+    // the light and its shadow map camera, the camera block is bound for the frame
+    bindLightBlock(light, lightCam);
 
     /*
     printf("lightCam mV:\n");
@@ -414,7 +634,7 @@ void SceneApp::shadowPass(std::shared_ptr<RTUtil::LightInfo> light, std::shared_
     renderQuad(pointLightPassProg);
 
     pointLightPassProg->unuse();
-    glDisable(GL_BLEND);
+    GLWrap::StateCache::setEnabled(GL_BLEND, false);
 }
 
 
@@ -422,95 +642,97 @@ void SceneApp::shadowPass(std::shared_ptr<RTUtil::LightInfo> light, std::shared_
  * Lighting pass for ambient light: render full screen quad. compute lighting 
  * effect for an ambient light and add to the accumulation buffer.
  */
- void SceneApp::ambientLightingPass(std::shared_ptr<RTUtil::LightInfo> light) {
+ void SceneApp::ambientLightingPass(std::shared_ptr<RTUtil::LightInfo> light, const GLWrap::Framebuffer &gBuffer,
+    const GLWrap::Framebuffer &accumulationBuffer) {
     // bind accumulationBuffer for writing
-    accumulationBuffer->bind(0);
+    accumulationBuffer.bind(0);
 
-    glViewport(0, 0, windowWidth, windowHeight);
-    glEnable(GL_BLEND);
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_ONE, GL_ONE);
+    GLWrap::StateCache::viewport(0, 0, windowWidth, windowHeight);
+    GLWrap::StateCache::setEnabled(GL_BLEND, true);
+    GLWrap::StateCache::blendEquation(GL_FUNC_ADD);
+    GLWrap::StateCache::blendFunc(GL_ONE, GL_ONE);
 
     // bind the G-Buffers for reading
     ambientLightPassProg->use();
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer->id());
-    gBuffer->colorTexture(0).bindToTextureUnit(0); 
+    GLWrap::StateCache::bindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer.id());
+    gBuffer.colorTexture(0).bindToTextureUnit(0); 
+    mNearestSampler->bindToTextureUnit(0);
     ambientLightPassProg->uniform("gNormal", 0);
-    gBuffer->colorTexture(1).bindToTextureUnit(1);
+    gBuffer.colorTexture(1).bindToTextureUnit(1);
+    mNearestSampler->bindToTextureUnit(1);
     ambientLightPassProg->uniform("gDiffuse_r", 1);
-    gBuffer->depthTexture().bindToTextureUnit(5);
+    gBuffer.depthTexture().bindToTextureUnit(5);
+    mNearestSampler->bindToTextureUnit(5);
     ambientLightPassProg->uniform("gDepth", 5);
 
-    // set window, camera and light related uniforms
-    setWindowUniforms(ambientLightPassProg);
-    setCameraUniforms(ambientLightPassProg, false);
-    setLightUniforms(ambientLightPassProg, light);
+    // the light, the camera block is bound for the frame
+    bindLightBlock(light, NULL);
 
     // go through each pixel, let the shader handle lighting
     renderQuad(ambientLightPassProg);
 
     ambientLightPassProg->unuse();
-    glDisable(GL_BLEND);
+    GLWrap::StateCache::setEnabled(GL_BLEND, false);
 }
 
 /*
 *  Lighting pass for sun sky model
 */
- void SceneApp::sunSkyPass() {
+ void SceneApp::sunSkyPass(const GLWrap::Framebuffer &gBuffer, const GLWrap::Framebuffer &accumulationBuffer) {
     // bind accumulationBuffer for writing
-    accumulationBuffer->bind(0);
+    accumulationBuffer.bind(0);
 
-    glViewport(0, 0, windowWidth, windowHeight);
-    glEnable(GL_BLEND);
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_ONE, GL_ONE);
+    GLWrap::StateCache::viewport(0, 0, windowWidth, windowHeight);
+    GLWrap::StateCache::setEnabled(GL_BLEND, true);
+    GLWrap::StateCache::blendEquation(GL_FUNC_ADD);
+    GLWrap::StateCache::blendFunc(GL_ONE, GL_ONE);
 
     // bind the G-Buffers for reading
     sunSkyPassProg->use();
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer->id());
-    gBuffer->colorTexture(0).bindToTextureUnit(0); 
+    GLWrap::StateCache::bindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer.id());
+    gBuffer.colorTexture(0).bindToTextureUnit(0); 
+    mNearestSampler->bindToTextureUnit(0);
     sunSkyPassProg->uniform("gNormal", 0);
-    gBuffer->depthTexture().bindToTextureUnit(5);
+    gBuffer.depthTexture().bindToTextureUnit(5);
+    mNearestSampler->bindToTextureUnit(5);
     sunSkyPassProg->uniform("gDepth", 5);
 
-    // set window, camera and light related uniforms
-    setWindowUniforms(sunSkyPassProg);
-    setCameraUniforms(sunSkyPassProg, true);
+    // set the sky uniforms, the camera block is bound for the frame
     mSky->setUniforms(*sunSkyPassProg);
 
     renderQuad(sunSkyPassProg);
 
     sunSkyPassProg->unuse();
-    glDisable(GL_BLEND);
+    GLWrap::StateCache::setEnabled(GL_BLEND, false);
 }
 
 /*
  * Blur pass: Use accumulationBuffer as input and apply the gaussian blur to it.
  * The result will be saved into tempBuffer2.
+ * The mipmaps of accumulationBuffer are generated by the frame graph.
  */
-void SceneApp::blurPass() {
-    accumulationBuffer->colorTexture(0).generateMipmap();
-
+void SceneApp::blurPass(const GLWrap::Framebuffer &accumulationBuffer, const GLWrap::Framebuffer &tempBuffer1,
+    const GLWrap::Framebuffer &tempBuffer2) {
     // bind tempBuffers for writing
-    tempBuffer1->bind(0);
+    tempBuffer1.bind(0);
     unsigned int attachment[1] = {GL_COLOR_ATTACHMENT0};
     glDrawBuffers(1, attachment);
-    tempBuffer1->colorTexture(0).generateMipmap();
+    tempBuffer1.colorTexture(0).generateMipmap();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    tempBuffer1->unbind();
+    tempBuffer1.unbind();
 
-    tempBuffer2->bind(0);
+    tempBuffer2.bind(0);
     unsigned int attachment2[1] = {GL_COLOR_ATTACHMENT0};
     glDrawBuffers(1, attachment2);
-    tempBuffer2->colorTexture(0).generateMipmap();
+    tempBuffer2.colorTexture(0).generateMipmap();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    tempBuffer2->unbind();
+    tempBuffer2.unbind();
 
     std::vector<float> blurStdev = {6.2, 24.9, 81.0, 263.0};
     std::vector<int> blurRadius = {24, 80, 243, 799};  
 
-    glDisable(GL_BLEND); 
-    glDisable(GL_DEPTH_TEST);
+    GLWrap::StateCache::setEnabled(GL_BLEND, false);
+    GLWrap::StateCache::setEnabled(GL_DEPTH_TEST, false);
 
     for(int i = 0; i < 4; i++) {
         /****** begin horizontal blur pass ******/
@@ -520,18 +742,14 @@ void SceneApp::blurPass() {
 
         blurPassProg->use();
 
-        glViewport(0, 0, mipMapLevelWidth, mipMapLevelHeight);
-        tempBuffer1->bind(mipMapLevel);
+        GLWrap::StateCache::viewport(0, 0, mipMapLevelWidth, mipMapLevelHeight);
+        tempBuffer1.bind(mipMapLevel);
         
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);        
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);        
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
         // bind the accumulationBuffer for reading
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, accumulationBuffer->id());
-        accumulationBuffer->colorTexture(0).bindToTextureUnit(0); 
+        GLWrap::StateCache::bindFramebuffer(GL_READ_FRAMEBUFFER, accumulationBuffer.id());
+        accumulationBuffer.colorTexture(0).bindToTextureUnit(0); 
+        mMipmapSampler->bindToTextureUnit(0);
         blurPassProg->uniform("image", 0);
 
         blurPassProg->uniform("dir", Eigen::Vector2f(1.0, 0.0));
@@ -548,20 +766,16 @@ void SceneApp::blurPass() {
 
         blurPassProg->use();
 
-        glDisable(GL_BLEND);
-        glDisable(GL_DEPTH_TEST);
+        GLWrap::StateCache::setEnabled(GL_BLEND, false);
+        GLWrap::StateCache::setEnabled(GL_DEPTH_TEST, false);
 
-        glViewport(0, 0, mipMapLevelWidth, mipMapLevelHeight);
-        tempBuffer2->bind(mipMapLevel);
+        GLWrap::StateCache::viewport(0, 0, mipMapLevelWidth, mipMapLevelHeight);
+        tempBuffer2.bind(mipMapLevel);
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);        
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);        
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, tempBuffer1->id());
-        tempBuffer1->colorTexture(0).bindToTextureUnit(0); 
+        GLWrap::StateCache::bindFramebuffer(GL_READ_FRAMEBUFFER, tempBuffer1.id());
+        tempBuffer1.colorTexture(0).bindToTextureUnit(0); 
+        mMipmapSampler->bindToTextureUnit(0);
         blurPassProg->uniform("image", 0);
 
         blurPassProg->uniform("dir", Eigen::Vector2f(0.0, 1.0));
@@ -579,22 +793,23 @@ void SceneApp::blurPass() {
 /*
 * Merge Pass for blurred mipmaps 
 */
-void SceneApp::mergePass() {
+void SceneApp::mergePass(const GLWrap::Framebuffer &accumulationBuffer, const GLWrap::Framebuffer &tempBuffer2,
+    const GLWrap::Framebuffer &mergeBuffer) {
     mergePassProg->use();
-    glViewport(0, 0, windowWidth, windowHeight);
+    GLWrap::StateCache::viewport(0, 0, windowWidth, windowHeight);
 
-    mergeBuffer->bind(0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    mergeBuffer.bind(0);
 
     // bind tempBuffer2 for reading
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, tempBuffer2->id());
-    tempBuffer2->colorTexture(0).bindToTextureUnit(0); 
+    GLWrap::StateCache::bindFramebuffer(GL_READ_FRAMEBUFFER, tempBuffer2.id());
+    tempBuffer2.colorTexture(0).bindToTextureUnit(0); 
+    mMipmapSampler->bindToTextureUnit(0);
     mergePassProg->uniform("image", 0);
 
     // bind original image for reading
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, accumulationBuffer->id());
-    accumulationBuffer->colorTexture(0).bindToTextureUnit(1); 
+    GLWrap::StateCache::bindFramebuffer(GL_READ_FRAMEBUFFER, accumulationBuffer.id());
+    accumulationBuffer.colorTexture(0).bindToTextureUnit(1); 
+    mMipmapSampler->bindToTextureUnit(1);
     mergePassProg->uniform("originalImage", 1);
 
     renderQuad(mergePassProg);
@@ -605,7 +820,7 @@ void SceneApp::mergePass() {
  * Draw all the pixels on the window and for each pixel to go through
  * the lighting shaders.
  */
-void SceneApp::renderQuad(std::unique_ptr<GLWrap::Program> &prog) {
+void SceneApp::renderQuad(std::shared_ptr<GLWrap::Program> &prog) {
     // Upload a two-triangle mesh for drawing a full screen quad
     Eigen::MatrixXf vertices(5, 4);
     vertices.col(0) << -1.0f, -1.0f, 0.0f, 0.0f, 0.0f;
@@ -629,10 +844,10 @@ void SceneApp::renderQuad(std::unique_ptr<GLWrap::Program> &prog) {
  * Use forward rendering (vs. deferred rendering/lighting) to render the image.
  */
 void SceneApp::forwardRendering() {
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    GLWrap::StateCache::bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
     glClearColor(0.0, 0.0, 0.0, 0.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
+    GLWrap::StateCache::setEnabled(GL_DEPTH_TEST, true);
 
     forwardRenderProg->use();
 
@@ -641,24 +856,17 @@ void SceneApp::forwardRendering() {
         forwardRenderProg->uniform("k_a", Eigen::Vector3f(0.1, 0.1, 0.1));
         forwardRenderProg->uniform("k_d", Eigen::Vector3f(0.9, 0.9, 0.9));
         forwardRenderProg->uniform("lightDir", Eigen::Vector3f(1.0, 1.0, 1.0).normalized());
-        setCameraUniforms(forwardRenderProg, false);
     } else { 
         // for non-flat shader
-        // set light, camera and window related uniforms
+        // set the light block, the camera block is bound for the frame
         std::shared_ptr<RTUtil::LightInfo> pointLight = mScene->getFirstPointLight();
-        setLightUniforms(forwardRenderProg, pointLight);
-        setWindowUniforms(forwardRenderProg);
-        setCameraUniforms(forwardRenderProg, true);         
+        bindLightBlock(pointLight, NULL);
+        forwardRenderProg->uniform("octNormals", mScene->mCompressVertices ? 1 : 0);
+        bindMaterials(forwardRenderProg);
 
         // pass the skybox textures to the shader for mirror reflection
         if (mShowSkybox == true && mShowMirrorRflt == true) {
-            glBindTexture(GL_TEXTURE_CUBE_MAP, mSkyboxTextureID);
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
+            bindSkybox(forwardRenderProg);
             forwardRenderProg->uniform("skyboxReflection", 1);
         } else {
             forwardRenderProg->uniform("skyboxReflection", 0);
@@ -675,16 +883,18 @@ void SceneApp::forwardRendering() {
     }
 
     // set up and draw meshes for each node, 
+    mMeshStore->bind();
     if (mUseFlatShader == true) {
-        drawMeshes(mScene->rootNode, forwardRenderProg, false);
+        drawMeshes(forwardRenderProg, false, currentCamera(), cameraLodBias, false);
     } else {
         if (mShowSkybox == true && mShowMirrorRflt == true) {
             // no need to setup the material related uniforms when showing the skybox mirror reflection
-            drawMeshes(mScene->rootNode, forwardRenderProg, false);
+            drawMeshes(forwardRenderProg, false, currentCamera(), cameraLodBias, false);
         } else {
-            drawMeshes(mScene->rootNode, forwardRenderProg, true);
+            drawMeshes(forwardRenderProg, true, currentCamera(), cameraLodBias, false);
         }
     }
+    mMeshStore->unbind();
 
     forwardRenderProg->unuse();
     //usleep(100);
@@ -693,12 +903,12 @@ void SceneApp::forwardRendering() {
 /*
  * Display the first 4 textures in g-buffers.
  */
-void SceneApp::displayGBuffers() {
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+void SceneApp::displayGBuffers(const GLWrap::Framebuffer &gBuffer) {
+    GLWrap::StateCache::bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glViewport(0, 0, windowWidth, windowHeight);
+    GLWrap::StateCache::viewport(0, 0, windowWidth, windowHeight);
 
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer->id());
+    GLWrap::StateCache::bindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer.id());
     glReadBuffer(GL_COLOR_ATTACHMENT0);
     glBlitFramebuffer(0, 0, windowWidth, windowHeight, 0, windowHeight/2, windowWidth/2, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
 
@@ -716,24 +926,23 @@ void SceneApp::displayGBuffers() {
  * Color correction pass: convert accumution values to sRGB.
  * Display the converted accumulation buffer on screen.
  */
-void SceneApp::displayFBuffer(std::shared_ptr<GLWrap::Framebuffer> buffer) {
+void SceneApp::displayFBuffer(const GLWrap::Framebuffer &buffer) {
     // switch to default framebuffer (window)
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    GLWrap::StateCache::bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 
     // set viewport to framebuffer size of the window to handle 
     // high resolution display problem
     int w,h;
     glfwGetFramebufferSize(glfwWindow(), &w, &h);
-    glViewport(0, 0, w, h);
+    GLWrap::StateCache::viewport(0, 0, w, h);
     //glViewport(0, 0, windowWidth, windowHeight);
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);    
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
     //display the texture from buffer
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, buffer->id());
-    buffer->colorTexture(0).bindToTextureUnit(0);
+    GLWrap::StateCache::bindFramebuffer(GL_READ_FRAMEBUFFER, buffer.id());
+    buffer.colorTexture(0).bindToTextureUnit(0);
+    mNearestSampler->bindToTextureUnit(0);
     srgbPassProg->use();
     srgbPassProg->uniform("image", 0);
     srgbPassProg->uniform("exposure", 1.0f);
@@ -742,160 +951,407 @@ void SceneApp::displayFBuffer(std::shared_ptr<GLWrap::Framebuffer> buffer) {
 }
 
 /*
- * Set window width and height uniforms.
+ * Connect the uniform blocks of a program to their binding points.
+ * Programs without some of the blocks are left as they are.
  */
-void SceneApp::setWindowUniforms(std::unique_ptr<GLWrap::Program> &prog) {
-    prog->uniform("windowWidth", (float)windowWidth);
-    prog->uniform("windowHeight", (float)windowHeight);
+void SceneApp::setUniformBlocks(std::shared_ptr<GLWrap::Program> &prog) {
+    if (prog) {
+        prog->uniformBlock("ViewBlock", ViewBinding);
+        prog->uniformBlock("LightBlock", LightBinding);
+    }
 }
 
 /*
- * Set camera releated unifroms, including transformation mV and mP. 
- * The camera eye position will be included if bEye is true.
+ * Fill a view block with the given camera matrices, camera eye in world
+ * space and window size.
  */
-void SceneApp::setCameraUniforms(std::unique_ptr<GLWrap::Program> &prog, bool bEye) {
-    // set camera related uniforms
-    std::shared_ptr<RTUtil::PerspectiveCamera> c;
-    if (mUseDefaultCamera == false && mScene->camera != NULL) {
-        c = mScene->camera;
-    } else {
-        c = mScene->defaultCamera;   
-    }
-    prog->uniform("mV", c->getViewMatrix().matrix());
-    prog->uniform("mP", c->getProjectionMatrix().matrix());
-    
-    if (bEye == true) {
-        // camera attributes are already in world space
-        prog->uniform("cameraEye", c->getEye());
-    }
+static void fillViewBlock(ViewBlock &block, const Eigen::Matrix4f &view, const Eigen::Matrix4f &projection,
+    const Eigen::Vector3f &eye, const Eigen::Vector2i &size) {
+    Eigen::Map<Eigen::Matrix4f>(block.mV) = view;
+    Eigen::Map<Eigen::Matrix4f>(block.mP) = projection;
+    Eigen::Map<Eigen::Matrix4f>(block.mVinv) = view.inverse();
+    Eigen::Map<Eigen::Matrix4f>(block.mVP) = projection * view;
+    Eigen::Map<Eigen::Vector3f>(block.cameraEye) = eye;
+    block.windowWidth = (float)size.x();
+    block.windowHeight = (float)size.y();
+}
+
+/*
+ * Write the view block of the current camera and window, once per frame,
+ * and bind it for all the passes of the frame.
+ */
+void SceneApp::writeCameraBlock() {
+    std::shared_ptr<RTUtil::PerspectiveCamera> c = currentCamera();
+    ViewBlock block = {};
+    fillViewBlock(block, c->getViewMatrix().matrix(), c->getProjectionMatrix().matrix(),
+        c->getEye(), Eigen::Vector2i(windowWidth, windowHeight));
+    mCameraBlock = mFrameBlocks->write(&block, sizeof(block));
+    mFrameBlocks->flush();
+    bindCameraBlock();
+}
+
+/*
+ * Bind the view block of the camera again, after a pass bound another view.
+ */
+void SceneApp::bindCameraBlock() {
+    mFrameBlocks->bindRange(ViewBinding, mCameraBlock, sizeof(ViewBlock));
+    mPassViewBound = false;
+}
+
+/*
+ * Bind a view other than the camera, e.g. of a light, until the camera is
+ * bound again with bindCameraBlock().
+ */
+void SceneApp::bindViewBlock(const Eigen::Matrix4f &view, const Eigen::Matrix4f &projection,
+    const Eigen::Vector3f &eye, const Eigen::Vector2i &size) {
+    ViewBlock block = {};
+    fillViewBlock(block, view, projection, eye, size);
+    mPassBlocks->bindRange(ViewBinding, writePassBlock(&block, sizeof(block)), sizeof(block));
+    mPassView = block;
+    mPassViewBound = true;
 }
 
 /*
- * Set light releated unifroms, including light center position, and light power.
+ * Bind the light block of a light: position and power for a point light,
+ * radiance and range for an ambient light.  lightCam is the camera of the
+ * shadow map of a point light, NULL if the pass reads no shadow map.
  */
-void SceneApp::setLightUniforms(std::unique_ptr<GLWrap::Program> &prog, std::shared_ptr<RTUtil::LightInfo> light) {
+void SceneApp::bindLightBlock(std::shared_ptr<RTUtil::LightInfo> light, std::shared_ptr<RTUtil::PerspectiveCamera> lightCam) {
+    LightBlock block = {};
     if (light->type == Point) {
         // get light positon in world space for point light
         aiMatrix4x4 t = mScene->getLightTransformation(light->nodeName);
         aiVector3D lp(light->position(0), light->position(1), light->position(2));
-        prog->uniform("lightPosition", RTUtil::a2e(t * lp));
-        prog->uniform("lightPower", light->power);
+        Eigen::Map<Eigen::Vector3f>(block.lightPosition) = RTUtil::a2e(t * lp);
+        Eigen::Map<Eigen::Vector3f>(block.lightPower) = light->power;
     }
 
     if (light->type == Ambient) {
-        prog->uniform("lightRadiance", light->radiance);
-        prog->uniform("lightRange", light->range);
+        Eigen::Map<Eigen::Vector3f>(block.lightRadiance) = light->radiance;
+        block.lightRange = light->range;
+    }
+
+    if (lightCam != NULL) {
+        Eigen::Map<Eigen::Matrix4f>(block.mVP_l) =
+            lightCam->getProjectionMatrix().matrix() * lightCam->getViewMatrix().matrix();
+    } else {
+        Eigen::Map<Eigen::Matrix4f>(block.mVP_l) = Eigen::Matrix4f::Identity();
     }
+
+    mPassBlocks->bindRange(LightBinding, writePassBlock(&block, sizeof(block)), sizeof(block));
+    mPassLight = block;
+    mPassLightBound = true;
 }
 
 /*
- * Recursively for each mesh:
- * 1. set vertices, indices, normals as openGL attributes,
- * 2. set uniform for transformation mM
- * 3. set the material related uniforms if bMat is true.
- * 4. draw the mesh.
- * 
+ * Write a uniform block of a pass and return its offset.  The buffer of the
+ * pass blocks grows when a frame needs more room, e.g. while baking the
+ * impostors; the old buffer is released once the GPU is done with it, so
+ * the view and light blocks still bound from it are written again to the
+ * new one and bound from there.
  */
-void SceneApp::drawMeshes(Node* node, std::unique_ptr<GLWrap::Program> &prog, bool bMat)
+GLintptr SceneApp::writePassBlock(const void *data, std::size_t bytes) {
+    if (!mPassBlocks->fits(bytes)) {
+        std::size_t needed = sizeof(ViewBlock) + sizeof(LightBlock) + bytes + 3 * passBlockSize;
+        mPassBlocks.reset(new GLWrap::StreamBuffer(GL_UNIFORM_BUFFER, std::max(2 * mPassBlocks->frameSize(), needed)));
+        if (mPassViewBound) {
+            mPassBlocks->bindRange(ViewBinding, mPassBlocks->write(&mPassView, sizeof(ViewBlock)), sizeof(ViewBlock));
+        }
+        if (mPassLightBound) {
+            mPassBlocks->bindRange(LightBinding, mPassBlocks->write(&mPassLight, sizeof(LightBlock)), sizeof(LightBlock));
+        }
+    }
+    GLintptr offset = mPassBlocks->write(data, bytes);
+    mPassBlocks->flush();
+    return offset;
+}
+
+/*
+ * Draw all the meshes of the scene with one submission:
+ * 1. bind the bone palette of a skinned animation, the same for all nodes,
+ * 2. pick the level of detail of every object (node mesh) of the mesh
+ *    store from the size of its bounding sphere seen from cam,
+ *    lodBias levels coarser; if impostors is true, the objects beyond the
+ *    impostor distance are left to the impostor atlas instead,
+ * 3. write the record of every object: the model transformation mM of its
+ *    node and its normal matrix, the dequantization of its positions, and
+ *    the row of its material in the material table (the empty material 0
+ *    if bMat is false),
+ * 4. draw them all, one multi-draw per vertex format.
+ * The mesh store must be bound.
+ */
+void SceneApp::drawMeshes(std::shared_ptr<GLWrap::Program> &prog, bool bMat,
+    std::shared_ptr<RTUtil::PerspectiveCamera> cam, int lodBias, bool impostors)
 {
-   if (node->mNumMeshes > 0) {
-        aiMatrix4x4 t = Node::getTransformation(node, node->mTransformation);
-        prog->uniform("mM", RTUtil::a2e(t).matrix());
-        #ifdef DEBUG
-            printf("node name=%s, mNumMeshes=%d\n", node->mName.C_Str(), node->mNumMeshes);
-            Scene::printTransformation(node->mName.C_Str(), t);
-        #endif
+    // animation: forward rendering only, with the SKINNED program variant
+    // when the animation has bone weight info.  Animations without bone
+    // weights, like BoxAnimated.dae, are in the instance transformations.
+    // Skinned meshes are deformed by their bones in the vertex shader, away
+    // from the bounds of their meshlets, so they are not culled.
+    bool skinning = mDeferredRendering == false && mScene->mAnimation != NULL && mScene->mAnimation->mNumBones > 0;
+    if (skinning) {
+        bindBones(prog);
+    }
 
-        // animation: forward rendering only
-        if (mDeferredRendering == false){
-            if (mScene->mAnimation != NULL){
-                if (mScene->mAnimation->mNumBones > 0) {
-                    // has animation and bone weight info
-                    prog->uniform("hasAnimation", 1);
+    // model transformation, level of detail and culling of every object
+    // against the view of this pass
+    int numObjects = mMeshStore->numObjects();
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> transforms(numObjects);
+    Eigen::Vector3f eye = cam->getEye();
+    float tanHalfFovy = std::tan(cam->getFOVY() / 2.0f);
+    Frustum frustum(cam->getViewProjectionMatrix().matrix());
+    Node* prevNode = NULL;
+    for (int i = 0; i < numObjects; i++) {
+        Node* node = mMeshStore->objectNode(i);
+        int m = mMeshStore->objectMesh(i);
+
+        // the meshes of a node are usually consecutive, get its transformation once
+        if (node != prevNode) {
+            aiMatrix4x4 t = Node::getTransformation(node, node->mTransformation);
+            if (mDeferredRendering == false && mScene->mAnimation != NULL && mScene->mAnimation->mNumBones == 0) {
+                // replace node model transformation with animation transformation
+                aiMatrix4x4 t_local = mScene->mAnimation->getNodeLocalAnimationTranformation(node);
+                t = mScene->mAnimation->getNodeGlobalAnimationTranformation(node, t_local);
+            }
+            transforms[i] = RTUtil::a2e(t).matrix();
+            prevNode = node;
+            #ifdef DEBUG
+                printf("node name=%s, mNumMeshes=%d\n", node->mName.C_Str(), node->mNumMeshes);
+                Scene::printTransformation(node->mName.C_Str(), t);
+            #endif
+        } else {
+            transforms[i] = transforms[i - 1];
+        }
 
-                    // set bone global transformation matrix
-                    Animation* anim = mScene->mAnimation;
-                    aiMatrix4x4 rootInverseT(mScene->rootNode->mTransformation);
-                    rootInverseT.Inverse();
+        const Eigen::AlignedBox3f& bounds = node->mMeshData[m]->mBounds;
+        Eigen::Vector3f center = (transforms[i] * bounds.center().homogeneous()).head<3>();
+        float scale = transforms[i].topLeftCorner<3, 3>().colwise().norm().maxCoeff();
+        float radius = 0.5f * bounds.diagonal().norm() * scale;
+        float distance = (center - eye).norm();
+
+        // an object entirely beyond the impostor distance is drawn as its impostor
+        if (impostors && distance - radius > mImpostorDistance) {
+            int k = mImpostors->find(mMeshStore->meshId(node, m), materialOf(node, m));
+            if (k >= 0) {
+                mMeshStore->hide(i);
+                if (frustum.intersects(center, radius)) {
+                    mImpostors->instance(k, transforms[i]);
+                }
+                continue;
+            }
+        }
 
-                    //printf("Current animation time: %f\n", mScene->mAnimation->mAnimationTime);
+        // size of the bounding sphere on screen, as a fraction of the viewport height
+        if (mMeshStore->numLevels(i) > 1) {
+            int level = lodBias;
+            if (distance > radius) {
+                float size = radius / (distance * tanHalfFovy);
+                level += std::max(0, (int) std::floor(std::log2(lodFullDetailSize / size)));
+            }
+            mMeshStore->setLevel(i, level);
+        }
 
-                    for (int b = 0; b < anim->mNumBones; b++) {
-                        aiMatrix4x4 t_bone = rootInverseT * anim->mBoneInfo[b].mTransformation;
+        if (!(skinning && node->isSkinned())) {
+            mMeshStore->cull(i, transforms[i], frustum, eye);
+        }
+    }
 
-                        std::string name = "boneTransform[" + std::to_string(b) + "]";
-                        prog->uniform(name, RTUtil::a2e(t_bone).matrix());
+    InstanceRecord* records = mMeshStore->instances();
+    for (int i = 0; i < numObjects; i++) {
+        Node* node = mMeshStore->objectNode(i);
+        int m = mMeshStore->objectMesh(i);
+        InstanceRecord& record = records[mMeshStore->slot(i)];
+        Eigen::Map<Eigen::Matrix4f>(record.model) = transforms[i];
+        Eigen::Map<Eigen::Matrix3f>(record.normal) = transforms[i].topLeftCorner<3, 3>().inverse().transpose();
+
+        // dequantization of the mesh positions, identity if not compressed
+        Eigen::Vector3f posScale, posOffset;
+        node->getDequantization(m, posScale, posOffset);
+        Eigen::Map<Eigen::Vector3f>(record.posScale) = posScale;
+        Eigen::Map<Eigen::Vector3f>(record.posOffset) = posOffset;
+
+        // add material factor
+        record.material = bMat == true ? materialOf(node, m) : 0;
+    }
 
-                        //Scene::printTransformation(name, t_bone);
-                    }
-                } else {
-                    // has animation but no bone weight, like BoxAnimated.dae
-                    prog->uniform("hasAnimation", 2);
+    // draw all the objects from the geometry arenas bound for this pass
+    mMeshStore->draw();
+}
 
-                    // replace node model transformation with animation transformation
-                    aiMatrix4x4 t_local = mScene->mAnimation->getNodeLocalAnimationTranformation(node);
-                    aiMatrix4x4 t_global = mScene->mAnimation->getNodeGlobalAnimationTranformation(node, t_local);
-                    prog->uniform("mM", RTUtil::a2e(t_global).matrix());
-                }
-            } else {
-                // no animation
-                prog->uniform("hasAnimation", 0);
-            }
-        }
+/*
+ * The camera the scene is viewed from: the camera of the scene file,
+ * unless there is none or the default camera is selected.
+ */
+std::shared_ptr<RTUtil::PerspectiveCamera> SceneApp::currentCamera()
+{
+    if (mUseDefaultCamera == false && mScene->camera != NULL) {
+        return mScene->camera;
+    } else {
+        return mScene->defaultCamera;   
+    }
+}
 
-        for (int m = 0; m < node->mNumMeshes; m++) {
-            // init mesh
-            mesh.reset(new GLWrap::Mesh());
+/*
+ * Build the material table read by the geometry pass and the forward
+ * rendering shaders (see material.fs): two texels per material,
+ *   (diffuse_r, 0) and (alpha, eta, k_s, 0).
+ * Row 0 is an empty material, all zero, used when a pass does not set
+ * up materials.
+ */
+void SceneApp::setMaterials()
+{
+    std::vector<float> texels(8, 0.0f);
+    mMaterialIndex.clear();
+    collectMaterials(mScene->rootNode, texels);
 
-            // set vertices
-            mesh->setAttribute(0, *(node->mVertices[m]));
+    mMaterials.reset(new GLWrap::TextureBuffer(GL_RGBA32F));
+    mMaterials->setData(texels.data(), texels.size() * sizeof(float));
+}
 
-            // set normals
-            if (node->mMeshes[m]->mNormals != NULL) {
-                mesh->setAttribute(1, *(node->mNormals[m]));
-            }
+/*
+ * The row of the material of mesh m of a node in the material table,
+ * the empty material 0 if it has none.
+ */
+int SceneApp::materialOf(Node* node, int m)
+{
+    if (node->mMaterials == NULL || node->mMaterials[m] == NULL) {
+        return 0;
+    }
+    return mMaterialIndex[node->mMaterials[m].get()];
+}
 
-            // set indices
-            mesh->setIndices(*(node->mIndices[m]), GL_TRIANGLES);
+/*
+ * Render an impostor of every mesh of the mesh store, once for each
+ * material it is drawn with, into a new impostor atlas with the geometry
+ * pass program (see ImpostorAtlas).  The meshes are drawn at full detail
+ * in model space.
+ */
+void SceneApp::bakeImpostors()
+{
+    // the first object of each mesh and material
+    std::map<std::pair<int, int>, int> objects;
+    for (int i = 0; i < mMeshStore->numObjects(); i++) {
+        Node* node = mMeshStore->objectNode(i);
+        int m = mMeshStore->objectMesh(i);
+        objects.insert(std::make_pair(std::make_pair(mMeshStore->meshId(node, m), materialOf(node, m)), i));
+    }
+    mImpostors.reset(new ImpostorAtlas(objects.size(), mMeshStore->numObjects()));
 
-            if (!mDeferredRendering){
-                if (mScene->mAnimation != NULL && mScene->mAnimation->mNumBones > 0) {
-                    // set bone IDs and weights
-                    mesh->setAttribute(2, *(node->mBoneIDs[m]));
-                    mesh->setAttribute(3, *(node->mBoneWeights[m]));
+    geoPassProg->use();
+    geoPassProg->uniform("octNormals", mScene->mCompressVertices ? 1 : 0);
+    bindMaterials(geoPassProg);
+    GLWrap::StateCache::setEnabled(GL_DEPTH_TEST, true);
+    GLWrap::StateCache::setEnabled(GL_BLEND, false);
+    GLWrap::StateCache::depthMask(true);
+
+    const int tile = ImpostorAtlas::tileSize;
+    const Eigen::Vector2i tileSize(tile, tile);
+    mMeshStore->bind();
+    for (const std::pair<const std::pair<int, int>, int>& object : objects) {
+        Node* node = mMeshStore->objectNode(object.second);
+        int m = mMeshStore->objectMesh(object.second);
+        int k = mImpostors->add(object.first.first, object.first.second, node->mMeshData[m]->mBounds);
+        if (k < 0) {
+            break;  // the atlas is full, the other meshes are always drawn
+        }
 
-                    //printf("Vertex Id = %d,\t Bone ID = (%d,%d,%d,%d),\t Bone Weights = (%f,%f,%f,%f)\n", m,
-                    //    *(node->mBoneIDs[m])(0), node->mBoneIDs[m](1), node->mBoneIDs[m](2), node->mBoneIDs[m](3),                                node->mBoneWeights[m](0), node->mBoneWeights[m](1), node->mBoneWeights[m](2), node->mBoneWeights[m](3));
-                }
-            }
+        InstanceRecord record;
+        Eigen::Map<Eigen::Matrix4f>(record.model) = Eigen::Matrix4f::Identity();
+        Eigen::Map<Eigen::Matrix3f>(record.normal) = Eigen::Matrix3f::Identity();
+        Eigen::Vector3f posScale, posOffset;
+        node->getDequantization(m, posScale, posOffset);
+        Eigen::Map<Eigen::Vector3f>(record.posScale) = posScale;
+        Eigen::Map<Eigen::Vector3f>(record.posOffset) = posOffset;
+        record.material = object.first.second;
+
+        for (int v = 0; v < ImpostorAtlas::numViews * ImpostorAtlas::numViews; v++) {
+            Eigen::Matrix4f view, projection;
+            mImpostors->bakeView(k, v, view, projection);
+            bindViewBlock(view, projection, view.topLeftCorner<3, 3>().transpose() * -view.topRightCorner<3, 1>(),
+                tileSize);
+            mMeshStore->drawMesh(object.first.first, 0, record);
+        }
+    }
+    mMeshStore->unbind();
+    mImpostors->endBake();
+    bindCameraBlock();
+    geoPassProg->unuse();
+    GLWrap::StateCache::setEnabled(GL_DEPTH_TEST, false);
 
-            // add material factor
-            if (bMat == true) {
-                if (node->mMaterials != NULL && node->mMaterials[m] != NULL) {
-                    // set material related uniforms
-                    std::shared_ptr<nori::Microfacet>  mat = std::dynamic_pointer_cast<nori::Microfacet>(node->mMaterials[m]);
-                    nori::Color3f d = mat->diffuseReflectance();
-                    Eigen::Vector3f disffuse_r(d.x(), d.y(), d.z());
-                    prog->uniform("diffuse_r", disffuse_r);
-                    prog->uniform("eta", mat->eta()); 
-                    prog->uniform("alpha", mat->alpha());
-                    prog->uniform("k_s", mat->k_s());
-                    #ifdef DEBUG
-                        printf("material for %s: eta=%f, alpha=%f, k_s=%f, diffuse_r=(%f, %f, %f)\n", node->mName.C_Str(), 
-                            mat->eta(), mat->alpha(), mat->k_s(),
-                            disffuse_r(0), disffuse_r(1), disffuse_r(2));     
-                    #endif
-                }
-            }
+    mImpostors->printStats();
+}
 
-            // draw it
-            mesh->drawElements();
+/*
+ * Recursively add the materials of the meshes of this node and all the
+ * dependent nodes to the material table, once per material.
+ */
+void SceneApp::collectMaterials(Node* node, std::vector<float>& texels)
+{
+    for (int m = 0; m < node->mNumMeshes; m++) {
+        if (node->mMaterials == NULL || node->mMaterials[m] == NULL ||
+            mMaterialIndex.find(node->mMaterials[m].get()) != mMaterialIndex.end()) {
+            continue;
         }
+        std::shared_ptr<nori::Microfacet> mat = std::dynamic_pointer_cast<nori::Microfacet>(node->mMaterials[m]);
+        nori::Color3f d = mat->diffuseReflectance();
+        float row[8] = { d.x(), d.y(), d.z(), 0.0f, mat->alpha(), mat->eta(), mat->k_s(), 0.0f };
+        mMaterialIndex[node->mMaterials[m].get()] = texels.size() / 8;
+        texels.insert(texels.end(), row, row + 8);
+        #ifdef DEBUG
+            printf("material for %s: eta=%f, alpha=%f, k_s=%f, diffuse_r=(%f, %f, %f)\n", node->mName.C_Str(), 
+                mat->eta(), mat->alpha(), mat->k_s(), d.x(), d.y(), d.z());     
+        #endif
     }
 
     for (int i = 0; i < node->mNumChildren; i++) {
-        drawMeshes(node->mChildren[i], prog, bMat);
-    } 
+        collectMaterials(node->mChildren[i], texels);
+    }
+}
+
+/*
+ * Bind the material table for a program that reads it (material.fs).
+ * It uses texture unit 7, after the units of the G-buffers and the shadow map.
+ */
+void SceneApp::bindMaterials(std::shared_ptr<GLWrap::Program> &prog)
+{
+    mMaterials->bindToTextureUnit(7);
+    prog->uniform("materials", 7);
+}
+
+/*
+ * Compute the bone palette at the current animation time, the global
+ * transformation of every bone relative to the root node, upload it to the
+ * bone table with one buffer update and bind it for a program that reads it
+ * (forwardrender.vs, min_mod.vs): four texels per bone, the columns of its
+ * transformation.  There is no limit on the number of bones.
+ * It uses texture unit 8, after the material table.
+ */
+void SceneApp::bindBones(std::shared_ptr<GLWrap::Program> &prog)
+{
+    Animation* anim = mScene->mAnimation;
+    aiMatrix4x4 rootInverseT(mScene->rootNode->mTransformation);
+    rootInverseT.Inverse();
+
+    //printf("Current animation time: %f\n", mScene->mAnimation->mAnimationTime);
+
+    mBonePalette.resize(anim->mNumBones);
+    for (int b = 0; b < anim->mNumBones; b++) {
+        aiMatrix4x4 t_bone = rootInverseT * anim->mBoneInfo[b].mTransformation;
+        mBonePalette[b] = RTUtil::a2e(t_bone).matrix();
+    }
+
+    // the table is allocated once and overwritten in place every frame
+    std::size_t bytes = mBonePalette.size() * sizeof(Eigen::Matrix4f);
+    if (!mBones || mBones->size() != bytes) {
+        mBones.reset(new GLWrap::TextureBuffer(GL_RGBA32F));
+        mBones->setData(mBonePalette.data(), bytes, GL_STREAM_DRAW);
+    } else {
+        mBones->updateData(0, mBonePalette.data(), bytes);
+    }
+
+    static constexpr GLWrap::UniformHandle bones("bones");
+    mBones->bindToTextureUnit(8);
+    prog->uniform(bones, 8);
 }
 
 /*
@@ -917,7 +1373,7 @@ unsigned int SceneApp::loadSkyBox() {
 
     unsigned int textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    GLWrap::StateCache::bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
     int width, height, channels;
     unsigned char *dataRight = stbi_load(sb.mRight.c_str(), &width, &height, &channels, 0);
@@ -954,6 +1410,17 @@ unsigned int SceneApp::loadSkyBox() {
     return textureID;
 }
 
+/*
+ * Bind the skybox cubemap for a program that reads it (skybox.fs,
+ * skyboxreflection.fs, forwardrender.fs) on texture unit 0, with linear
+ * filtering; the cubemap has no mipmaps.
+ */
+void SceneApp::bindSkybox(std::shared_ptr<GLWrap::Program> &prog) {
+    GLWrap::StateCache::bindTexture(0, GL_TEXTURE_CUBE_MAP, mSkyboxTextureID);
+    mLinearSampler->bindToTextureUnit(0);
+    prog->uniform("skybox", 0);
+}
+
 void SceneApp::initSkyboxVertices() {
     Eigen::MatrixXf vertices(3, 36);
     vertices.col(0) << -1.0f,  1.0f, -1.0f;
@@ -1002,54 +1469,36 @@ void SceneApp::initSkyboxVertices() {
 }
 
 /*
- * It renders the skybox.
+ * It renders the skybox, on the window (forward rendering) or on
+ * skyboxBuffer (deferred rendering), where the frame graph copies the
+ * depth of the G-buffers and the accumulated lighting first.
  */
-void SceneApp::skyboxPass() {
+void SceneApp::skyboxPass(const GLWrap::Framebuffer *skyboxBuffer) {
 
-    if (mDeferredRendering == false) {
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    if (skyboxBuffer == NULL) {
+        GLWrap::StateCache::bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
         int w,h;
         glfwGetFramebufferSize(glfwWindow(), &w, &h);
-        glViewport(0, 0, w, h);
+        GLWrap::StateCache::viewport(0, 0, w, h);
 
     } else {
         // bind skyboxBuffer for writing
         skyboxBuffer->bind(0);
 
-        glViewport(0, 0, windowWidth, windowHeight);
-        
-        // copy the depth texture from gBuffer to skyboxBuffer
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer->id());
-        glBlitFramebuffer(0, 0, windowWidth, windowHeight,
-            0, 0, windowWidth, windowHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-
-        // copy the color texture from accumulationBuffer to skyboxBuffer
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, accumulationBuffer->id());
-        glBlitFramebuffer(0, 0, windowWidth, windowHeight,
-                        0, 0, windowWidth, windowHeight,
-                        GL_COLOR_BUFFER_BIT, GL_NEAREST);
-
+        GLWrap::StateCache::viewport(0, 0, windowWidth, windowHeight);
     }
 
-    glDepthMask(GL_TRUE);
-    glEnable(GL_DEPTH_TEST);
+    GLWrap::StateCache::depthMask(true);
+    GLWrap::StateCache::setEnabled(GL_DEPTH_TEST, true);
 
     // this makes the skybox to draw on the background pixels only.
-    glDepthFunc(GL_LEQUAL); 
+    GLWrap::StateCache::depthFunc(GL_LEQUAL); 
 
 
     skyboxPassProg->use();
 
-    // set camera uniforms
-    setCameraUniforms(skyboxPassProg, false);
-
     // bind skybox tectures for reading
-    glBindTexture(GL_TEXTURE_CUBE_MAP, mSkyboxTextureID);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    bindSkybox(skyboxPassProg);
 
     // draw skybox
     skyboxMesh.reset(new GLWrap::Mesh());
@@ -1058,9 +1507,9 @@ void SceneApp::skyboxPass() {
  
     skyboxPassProg->unuse();
 
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_LESS); 
-    glDisable(GL_BLEND);
+    GLWrap::StateCache::depthMask(true);
+    GLWrap::StateCache::depthFunc(GL_LESS); 
+    GLWrap::StateCache::setEnabled(GL_BLEND, false);
 }
 
 /*
@@ -1068,40 +1517,33 @@ void SceneApp::skyboxPass() {
  *  It is called in the deferred rendering process only.
  *  The normals and depth g-buffers are used in the shaders. 
 */
- void SceneApp::skyboxMirrorReflectionPass() {
+ void SceneApp::skyboxMirrorReflectionPass(const GLWrap::Framebuffer &gBuffer, const GLWrap::Framebuffer &accumulationBuffer) {
     // bind accumulationBuffer for writing
-    accumulationBuffer->bind(0);
+    accumulationBuffer.bind(0);
 
-    glViewport(0, 0, windowWidth, windowHeight);
-    glEnable(GL_BLEND);
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_ONE, GL_ONE);
+    GLWrap::StateCache::viewport(0, 0, windowWidth, windowHeight);
+    GLWrap::StateCache::setEnabled(GL_BLEND, true);
+    GLWrap::StateCache::blendEquation(GL_FUNC_ADD);
+    GLWrap::StateCache::blendFunc(GL_ONE, GL_ONE);
 
     skyboxRflctPassProg->use();
 
-    // camera uniforms
-    setCameraUniforms(skyboxRflctPassProg, true);
-    setWindowUniforms(skyboxRflctPassProg);
-
     // bind the G-Buffers for reading
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer->id());
-    gBuffer->colorTexture(0).bindToTextureUnit(1); 
+    GLWrap::StateCache::bindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer.id());
+    gBuffer.colorTexture(0).bindToTextureUnit(1); 
+    mNearestSampler->bindToTextureUnit(1);
     skyboxRflctPassProg->uniform("gNormal", 1);
-    gBuffer->depthTexture().bindToTextureUnit(5);
+    gBuffer.depthTexture().bindToTextureUnit(5);
+    mNearestSampler->bindToTextureUnit(5);
     skyboxRflctPassProg->uniform("gDepth", 5);
 
     // bind skybox tectures for reading
-    glBindTexture(GL_TEXTURE_CUBE_MAP, mSkyboxTextureID);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    bindSkybox(skyboxRflctPassProg);
 
     renderQuad(skyboxRflctPassProg);
 
     skyboxRflctPassProg->unuse();
-    glDisable(GL_BLEND);
+    GLWrap::StateCache::setEnabled(GL_BLEND, false);
 }
 
 
@@ -1109,6 +1551,10 @@ void SceneApp::printConfig() {
     printf("Configuration:\n");
     printf("\t%s\n", mUseDefaultCamera ? "default camera": "built-in camera");
     printf("\t%s\n", mDeferredRendering ? "deferred rendering": "forward rendering");
+    printf("\t%s\n", mScene->mCompressVertices ? "compressed vertices": "full precision vertices");
+    mMeshStore->printStats();
+    printf("\tstate changes in the last frame: %d issued, %d skipped\n", mStateIssued, mStateSkipped);
+    mReportTargets = 2;
     printf("Usage:\n");
     printf("\tPress d to toggle between deferred and forward rendering.\n"); 
     printf("\tPress e to toggle between showing skybox or not.\n"); 
@@ -2,12 +2,21 @@
 
 #include <string.h>
 #include <iostream>
+#include <map>
+#include <vector>
 #include <nanogui/screen.h>
 
 #include <GLWrap/Program.hpp>
+#include <GLWrap/ProgramCache.hpp>
+#include <GLWrap/RenderTargetPool.hpp>
 #include <GLWrap/Mesh.hpp>
+#include <GLWrap/FrameGraph.hpp>
 #include <GLWrap/Framebuffer.hpp>
+#include <GLWrap/Sampler.hpp>
 #include <GLWrap/Shader.hpp>
+#include <GLWrap/StateCache.hpp>
+#include <GLWrap/StreamBuffer.hpp>
+#include <GLWrap/TextureBuffer.hpp>
 
 #include <../ext/assimp/include/assimp/scene.h>
 #include <../ext/assimp/include/assimp/Importer.hpp>
@@ -19,6 +28,9 @@
 using namespace RTUtil;
 
 #include "Scene.hpp"
+#include "ImpostorAtlas.hpp"
+#include "MeshStore.hpp"
+#include "UniformBlocks.hpp"
 
 // sky box files
 struct SkyboxFiles {
@@ -33,7 +45,8 @@ struct SkyboxFiles {
 class SceneApp : public nanogui::Screen {
 public:
 
-    SceneApp(std::string inputFile, std::string infoFile, std::string skyboxName);
+    SceneApp(std::string inputFile, std::string infoFile, std::string skyboxName, bool compressVertices,
+        float impostorDistance);
 
     virtual bool keyboardEvent(int key, int scancode, int action, int modifiers) override;
     virtual bool mouseButtonEvent(const Eigen::Vector2i &p, int button, bool down, int modifiers) override;
@@ -50,30 +63,72 @@ private:
     std::unique_ptr<RTUtil::DefaultCC> cc;
     //std::shared_ptr<RTUtil::PerspectiveCamera> cam;
 
-    std::unique_ptr<GLWrap::Mesh> mesh;
+    std::unique_ptr<MeshStore> mMeshStore;
+
+    // the impostors of the meshes, baked on the first geometry pass, and the
+    // distance beyond which objects are drawn as their impostor (0 for never)
+    std::unique_ptr<ImpostorAtlas> mImpostors;
+    float mImpostorDistance;
+
+    // the material of every node mesh, two texels per material, and the row of each material
+    std::unique_ptr<GLWrap::TextureBuffer> mMaterials;
+    std::map<const nori::BSDF*, int> mMaterialIndex;
+
+    // the bone palette of the animation, the transformation of every bone
+    // at the current time, rewritten every frame
+    std::unique_ptr<GLWrap::TextureBuffer> mBones;
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> mBonePalette;
+    // the uniform blocks (see UniformBlocks.hpp): the camera of the frame,
+    // written once per frame, and the views and lights of the passes
+    std::unique_ptr<GLWrap::StreamBuffer> mFrameBlocks;
+    std::unique_ptr<GLWrap::StreamBuffer> mPassBlocks;
+    GLintptr mCameraBlock;
+    // the pass blocks bound now, bound again if the pass blocks grow
+    ViewBlock mPassView;
+    LightBlock mPassLight;
+    bool mPassViewBound, mPassLightBound;
+
+    // the samplers the passes read their textures with: nearest for the
+    // G-buffers, the shadow map and the final image, trilinear for the
+    // mipmaps of the blur, linear for the skybox
+    std::unique_ptr<GLWrap::Sampler> mNearestSampler;
+    std::unique_ptr<GLWrap::Sampler> mMipmapSampler;
+    std::unique_ptr<GLWrap::Sampler> mLinearSampler;
+
+    // the state changes issued and skipped by the state cache in the last frame
+    int mStateIssued, mStateSkipped;
+
+    // the passes of the frame (see drawFrame) and the pool of their render
+    // targets; the passes and the pool statistics are printed once a new
+    // configuration is drawn
+    std::unique_ptr<GLWrap::RenderTargetPool> mTargets;
+    std::unique_ptr<GLWrap::FrameGraph> mFrameGraph;
+    GLWrap::RenderTargetDesc mGBufferDesc;      // the G-buffers and depth
+    GLWrap::RenderTargetDesc mShadowMapDesc;    // depth from a light
+    GLWrap::RenderTargetDesc mMipmapDesc;       // RGBA32F with mipmaps: accumulation and blur
+    GLWrap::RenderTargetDesc mImageDesc;        // RGBA32F: merge
+    GLWrap::RenderTargetDesc mSkyboxDesc;       // RGBA32F and depth: skybox
+    int mReportTargets;  // frames until the statistics are printed, 0 for never
+
     std::unique_ptr<GLWrap::Mesh> fsqMesh;
     std::unique_ptr<GLWrap::Mesh> skyboxMesh;
 
-    std::unique_ptr<GLWrap::Program> forwardRenderProg;
-
-    std::unique_ptr<GLWrap::Program> geoPassProg;
-    std::unique_ptr<GLWrap::Program> shadowPassProg;
-    std::unique_ptr<GLWrap::Program> pointLightPassProg;
-    std::unique_ptr<GLWrap::Program> ambientLightPassProg;
-    std::unique_ptr<GLWrap::Program> blurPassProg;
-    std::unique_ptr<GLWrap::Program> srgbPassProg;
-    std::unique_ptr<GLWrap::Program> sunSkyPassProg;
-    std::unique_ptr<GLWrap::Program> mergePassProg;
-    std::unique_ptr<GLWrap::Program> skyboxRflctPassProg;
-    std::unique_ptr<GLWrap::Program> skyboxPassProg;
-
-    std::shared_ptr<GLWrap::Framebuffer> gBuffer;
-    std::shared_ptr<GLWrap::Framebuffer> accumulationBuffer;
-    std::shared_ptr<GLWrap::Framebuffer> shadowMapBuffer;
-    std::shared_ptr<GLWrap::Framebuffer> tempBuffer1;
-    std::shared_ptr<GLWrap::Framebuffer> tempBuffer2;
-    std::shared_ptr<GLWrap::Framebuffer> mergeBuffer;
-    std::shared_ptr<GLWrap::Framebuffer> skyboxBuffer;
+    // every program built so far, and their binaries on disk
+    std::unique_ptr<GLWrap::ProgramCache> mPrograms;
+
+    std::shared_ptr<GLWrap::Program> forwardRenderProg;
+
+    std::shared_ptr<GLWrap::Program> geoPassProg;
+    std::shared_ptr<GLWrap::Program> shadowPassProg;
+    std::shared_ptr<GLWrap::Program> pointLightPassProg;
+    std::shared_ptr<GLWrap::Program> ambientLightPassProg;
+    std::shared_ptr<GLWrap::Program> blurPassProg;
+    std::shared_ptr<GLWrap::Program> srgbPassProg;
+    std::shared_ptr<GLWrap::Program> sunSkyPassProg;
+    std::shared_ptr<GLWrap::Program> mergePassProg;
+    std::shared_ptr<GLWrap::Program> skyboxRflctPassProg;
+    std::shared_ptr<GLWrap::Program> skyboxPassProg;
+    std::shared_ptr<GLWrap::Program> impostorProg;
 
     std::shared_ptr<RTUtil::Sky> mSky;
     unsigned int mSkyboxTextureID;
@@ -96,31 +151,48 @@ private:
     void setCamera();
     void setShaders();
 
-    void drawMeshes(Node* node, std::unique_ptr<GLWrap::Program> &prog, bool bMat);
+    void setMaterials();
+    void collectMaterials(Node* node, std::vector<float>& texels);
+    void bindMaterials(std::shared_ptr<GLWrap::Program> &prog);
+    void bindBones(std::shared_ptr<GLWrap::Program> &prog);
+    int materialOf(Node* node, int m);
+    void bakeImpostors();
+
+    void drawFrame();
+    void drawMeshes(std::shared_ptr<GLWrap::Program> &prog, bool bMat,
+        std::shared_ptr<RTUtil::PerspectiveCamera> cam, int lodBias, bool impostors);
+    std::shared_ptr<RTUtil::PerspectiveCamera> currentCamera();
     void forwardRendering();
-    void renderQuad(std::unique_ptr<GLWrap::Program> &prog);
-
-    void displayGBuffers();
-    void displayFBuffer(std::shared_ptr<GLWrap::Framebuffer> buffer);
-
-    void setCameraUniforms(std::unique_ptr<GLWrap::Program> &prog, bool bEye);
-    void setWindowUniforms(std::unique_ptr<GLWrap::Program> &prog);
-    void setLightUniforms(std::unique_ptr<GLWrap::Program> &prog, std::shared_ptr<RTUtil::LightInfo> pointLight);
+    void renderQuad(std::shared_ptr<GLWrap::Program> &prog);
+
+    void displayGBuffers(const GLWrap::Framebuffer &gBuffer);
+    void displayFBuffer(const GLWrap::Framebuffer &buffer);
+
+    void setUniformBlocks(std::shared_ptr<GLWrap::Program> &prog);
+    void writeCameraBlock();
+    void bindCameraBlock();
+    void bindViewBlock(const Eigen::Matrix4f &view, const Eigen::Matrix4f &projection,
+        const Eigen::Vector3f &eye, const Eigen::Vector2i &size);
+    void bindLightBlock(std::shared_ptr<RTUtil::LightInfo> light, std::shared_ptr<RTUtil::PerspectiveCamera> lightCam);
+    GLintptr writePassBlock(const void *data, std::size_t bytes);
     
-    void geometryPass();
-    void shadowPass(std::shared_ptr<RTUtil::LightInfo> light, std::shared_ptr<RTUtil::PerspectiveCamera> camera);
-    void pointLightingPass(std::shared_ptr<RTUtil::LightInfo> light, std::shared_ptr<RTUtil::PerspectiveCamera> lightCam); 
-    void ambientLightingPass(std::shared_ptr<RTUtil::LightInfo> light);
-    void sunSkyPass();
-    void blurPass(); 
-    void mergePass();
-    void skyboxPass();
-    void skyboxMirrorReflectionPass();
+    // the passes, drawing into the targets of the frame graph
+    void geometryPass(const GLWrap::Framebuffer &gBuffer);
+    void shadowPass(std::shared_ptr<RTUtil::PerspectiveCamera> camera, const GLWrap::Framebuffer &shadowMapBuffer);
+    void pointLightingPass(std::shared_ptr<RTUtil::LightInfo> light, std::shared_ptr<RTUtil::PerspectiveCamera> lightCam,
+        const GLWrap::Framebuffer &gBuffer, const GLWrap::Framebuffer &shadowMapBuffer, const GLWrap::Framebuffer &accumulationBuffer);
+    void ambientLightingPass(std::shared_ptr<RTUtil::LightInfo> light, const GLWrap::Framebuffer &gBuffer, const GLWrap::Framebuffer &accumulationBuffer);
+    void sunSkyPass(const GLWrap::Framebuffer &gBuffer, const GLWrap::Framebuffer &accumulationBuffer);
+    void blurPass(const GLWrap::Framebuffer &accumulationBuffer, const GLWrap::Framebuffer &tempBuffer1, const GLWrap::Framebuffer &tempBuffer2);
+    void mergePass(const GLWrap::Framebuffer &accumulationBuffer, const GLWrap::Framebuffer &tempBuffer2, const GLWrap::Framebuffer &mergeBuffer);
+    void skyboxPass(const GLWrap::Framebuffer *skyboxBuffer);
+    void skyboxMirrorReflectionPass(const GLWrap::Framebuffer &gBuffer, const GLWrap::Framebuffer &accumulationBuffer);
 
     void printTransformation(std::string name, aiMatrix4x4 t);
     void printConfig();
 
     unsigned int loadSkyBox();
+    void bindSkybox(std::shared_ptr<GLWrap::Program> &prog);
     void initSkyboxVertices(); 
 
 
@@ -103,10 +103,12 @@ bool SceneDemoApp::scrollEvent(const Eigen::Vector2i &p, const Eigen::Vector2f &
 
 void SceneDemoApp::drawContents() {
     GLWrap::checkGLError("drawContents start");
+    // the GUI draws between frames behind the back of the state cache
+    GLWrap::StateCache::invalidate();
     glClearColor(backgroundColor.r(), backgroundColor.g(), backgroundColor.b(), backgroundColor.w());
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glEnable(GL_DEPTH_TEST);
+    GLWrap::StateCache::setEnabled(GL_DEPTH_TEST, true);
 
     prog->use();
     prog->uniform("mM", Eigen::Affine3f::Identity().matrix());
@@ -12,6 +12,7 @@
 
 #include <GLWrap/Program.hpp>
 #include <GLWrap/Mesh.hpp>
+#include <GLWrap/StateCache.hpp>
 #include <RTUtil/Camera.hpp>
 #include <RTUtil/CameraController.hpp>
 
@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * The uniform blocks shared by the scene shaders, laid out as std140 so that
+ * they are written to a uniform buffer as they are.  Each block has a fixed
+ * binding point, to which every program connects it (see
+ * GLWrap::Program::uniformBlock), so binding a block once serves every
+ * program of the passes that follow.
+ *
+ * In std140 a vec3 takes the room of a vec4 unless a float follows it, and
+ * a mat4 is four vec4 columns, as stored by Eigen.
+ */
+
+// The binding points of GL_UNIFORM_BUFFER
+enum UniformBinding {
+    ViewBinding = 0,
+    LightBinding = 1
+};
+
+// The camera and the window of a pass: the camera of the frame, the light
+// camera of a shadow pass or the camera of an impostor tile.  The inverse
+// and the product of the matrices are computed once per view, so that the
+// shaders do not compute them per vertex or per fragment.
+struct ViewBlock {
+    float mV[16];           // view matrix
+    float mP[16];           // projection matrix
+    float mVinv[16];        // inverse of the view matrix
+    float mVP[16];          // mP * mV
+    float cameraEye[3];     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+    float pad[3];
+};
+static_assert(sizeof(ViewBlock) == 288, "ViewBlock does not match its std140 layout");
+
+// The light of a lighting pass; an ambient light only sets radiance and range
+struct LightBlock {
+    float lightPosition[3]; // point light position in world space
+    float pad0;
+    float lightPower[3];
+    float pad1;
+    float lightRadiance[3]; // ambient light
+    float lightRange;
+    float mVP_l[16];        // projection * view matrix of the shadow map
+};
+static_assert(sizeof(LightBlock) == 112, "LightBlock does not match its std140 layout");
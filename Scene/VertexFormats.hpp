@@ -0,0 +1,116 @@
+#pragma once
+
+#include <GLWrap/VertexFormat.hpp>
+
+/*
+ * Interleaved vertex layouts used by the scene meshes.
+ * The attribute indices match the layout locations in the mesh shaders:
+ *   0 position, 1 normal, 2 bone IDs, 3 bone weights,
+ *   4-7 model matrix, 8-9 position dequantization, 10 material index,
+ *   11-13 normal matrix (per instance, see InstanceData)
+ *
+ * The compact layouts are used when the scene is loaded with vertex
+ * compression.  Positions are quantized to 16 bits within the bounding box
+ * of their mesh and dequantized in the vertex shader with posScale and
+ * posOffset; normals are octahedral-encoded in two 16-bit components and
+ * decoded when octNormals is set.
+ *
+ * Every mesh also has its positions alone in PositionVertex (or
+ * CompactPositionVertex), read by the passes that only write depth.
+ */
+
+// meshes without skinning information
+typedef GLWrap::VertexFormat<
+    GLWrap::Attribute<0, float, 3>,     // position
+    GLWrap::Attribute<1, float, 3>      // normal
+> StaticVertex;
+
+// meshes of animated scenes, with the bones that influence each vertex
+typedef GLWrap::VertexFormat<
+    GLWrap::Attribute<0, float, 3>,                         // position
+    GLWrap::Attribute<1, float, 3>,                         // normal
+    GLWrap::Attribute<2, int, 4, GLWrap::AttribInteger>,    // bone IDs
+    GLWrap::Attribute<3, float, 4>                          // bone weights
+> SkinnedVertex;
+
+// compressed meshes without skinning information, 12 bytes per vertex instead of 24
+typedef GLWrap::VertexFormat<
+    GLWrap::Attribute<0, unsigned short, 4, GLWrap::AttribNormalized>,  // quantized position, w unused
+    GLWrap::Attribute<1, short, 2, GLWrap::AttribNormalized>            // octahedral normal
+> CompactStaticVertex;
+
+// compressed meshes of animated scenes, 24 bytes per vertex instead of 56;
+// bone IDs are 16 bits, the bone palette is not limited to 256 bones
+typedef GLWrap::VertexFormat<
+    GLWrap::Attribute<0, unsigned short, 4, GLWrap::AttribNormalized>,  // quantized position, w unused
+    GLWrap::Attribute<1, short, 2, GLWrap::AttribNormalized>,           // octahedral normal
+    GLWrap::Attribute<2, unsigned short, 4, GLWrap::AttribInteger>,     // bone IDs
+    GLWrap::Attribute<3, unsigned char, 4, GLWrap::AttribNormalized>    // bone weights
+> CompactSkinnedVertex;
+
+// positions alone, for the depth-only passes
+typedef GLWrap::VertexFormat<
+    GLWrap::Attribute<0, float, 3>      // position
+> PositionVertex;
+
+// quantized positions alone, 8 bytes per vertex
+typedef GLWrap::VertexFormat<
+    GLWrap::Attribute<0, unsigned short, 4, GLWrap::AttribNormalized>   // quantized position, w unused
+> CompactPositionVertex;
+
+// per-object data of the instanced and indirect draws: the model matrix,
+// a column-major mat4 (GLSL mat4 at location 4), the dequantization of the
+// mesh positions, the row of the material in the material table and the
+// normal matrix, the inverse transpose of the model matrix computed once per
+// object (GLSL mat3 at location 11)
+typedef GLWrap::VertexFormat<
+    GLWrap::Attribute<4, float, 4>,                         // model matrix column 0
+    GLWrap::Attribute<5, float, 4>,                         // model matrix column 1
+    GLWrap::Attribute<6, float, 4>,                         // model matrix column 2
+    GLWrap::Attribute<7, float, 4>,                         // model matrix column 3
+    GLWrap::Attribute<8, float, 3>,                         // position scale
+    GLWrap::Attribute<9, float, 3>,                         // position offset
+    GLWrap::Attribute<10, int, 1, GLWrap::AttribInteger>,   // material index
+    GLWrap::Attribute<11, float, 3>,                        // normal matrix column 0
+    GLWrap::Attribute<12, float, 3>,                        // normal matrix column 1
+    GLWrap::Attribute<13, float, 3>                         // normal matrix column 2
+> InstanceData;
+
+// one element of InstanceData, as written to the instance buffer
+struct InstanceRecord {
+    float model[16];
+    float posScale[3];
+    float posOffset[3];
+    int material;
+    float normal[9];
+};
+static_assert(sizeof(InstanceRecord) == InstanceData::stride, "InstanceRecord must match InstanceData");
+
+// corners of the impostor quads, in [-1,1] (see ImpostorAtlas)
+typedef GLWrap::VertexFormat<
+    GLWrap::Attribute<0, float, 2>      // corner
+> ImpostorVertex;
+
+// per-object data of the impostor quads: the model matrix, the bounding
+// sphere of the mesh in model space, the impostor in the atlas and the
+// normal matrix (GLSL mat3 at location 10)
+typedef GLWrap::VertexFormat<
+    GLWrap::Attribute<4, float, 4>,                         // model matrix column 0
+    GLWrap::Attribute<5, float, 4>,                         // model matrix column 1
+    GLWrap::Attribute<6, float, 4>,                         // model matrix column 2
+    GLWrap::Attribute<7, float, 4>,                         // model matrix column 3
+    GLWrap::Attribute<8, float, 4>,                         // sphere center and radius
+    GLWrap::Attribute<9, int, 1, GLWrap::AttribInteger>,    // impostor index
+    GLWrap::Attribute<10, float, 3>,                        // normal matrix column 0
+    GLWrap::Attribute<11, float, 3>,                        // normal matrix column 1
+    GLWrap::Attribute<12, float, 3>                         // normal matrix column 2
+> ImpostorData;
+
+// one element of ImpostorData, as written to the impostor instance buffer
+struct ImpostorRecord {
+    float model[16];
+    float sphere[4];
+    int impostor;
+    float normal[9];
+};
+static_assert(sizeof(ImpostorRecord) == ImpostorData::stride, "ImpostorRecord must match ImpostorData");
@@ -3,7 +3,16 @@
 // function from sunsky.fs
 vec3 sunskyRadiance(vec3 dir);
 
+// function from viewray.fs
+vec3 eyePosition(vec2 fragCoord, float depth);
+
+// DEBUG_VIEW is defined to one of the display modes below by the debug
+// program variant (see SceneApp::setShaders), to show a buffer instead of the lighting
+#ifdef DEBUG_VIEW
+const int displayMode = DEBUG_VIEW;
+#else
 const int displayMode = 0;
+#endif
 
 const int displayImage = 0;
 const int displayEyeSpacePos = 1;
@@ -16,14 +25,25 @@ uniform sampler2D gNormal;
 uniform sampler2D gDiffuse_r;
 uniform sampler2D gDepth;
 
-uniform float windowWidth;
-uniform float windowHeight;
-
-uniform mat4 mV;     // View matrix from camera view
-uniform mat4 mP;     // Projection matrix from camera view
-
-uniform vec3  lightRadiance;
-uniform float lightRange;
+// Camera and window of the pass (see ViewBlock in UniformBlocks.hpp)
+layout (std140) uniform ViewBlock {
+    mat4  mV;            // View matrix
+    mat4  mP;            // Projection matrix
+    mat4  mVinv;         // inverse of the view matrix
+    mat4  mVP;           // mP * mV
+    vec3  cameraEye;     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+};
+
+// The light of the pass (see LightBlock in UniformBlocks.hpp)
+layout (std140) uniform LightBlock {
+    vec3  lightPosition; // point light position in world space
+    vec3  lightPower;
+    vec3  lightRadiance; // ambient light
+    float lightRange;
+    mat4  mVP_l;         // Projection * view matrix from light view
+};
 
 in vec2 geom_texCoord;
 
@@ -55,21 +75,8 @@ vec3 getSample(int i, vec3 pos) {
     return oc_scale * c*p;
 }
 
-// convert a point from screen sapce to eye space
-vec3 screenSpaceToEyeSpace(vec3 point) {
-    vec4 ndcPos;
-    vec4 viewport = vec4(0.0, 0.0, windowWidth, windowHeight);
-    ndcPos.xy = 2.0 * point.xy / viewport.zw - 1.0;
-    ndcPos.z = 2.0 * point.z - 1.0;
-    ndcPos.w = 1.0;
-    vec4 clip = inverse(mP) * ndcPos;    
-    vec3 eyeSpacePos = (clip/clip.w).xyz;
-    return eyeSpacePos;      
-}
-
 void main() {
     // unpacking the texture 
-    vec4 viewport = vec4(0.0, 0.0, windowWidth, windowHeight);
     vec3 tNormal = texture(gNormal, geom_texCoord).xyz;
     vec3 tDiffuse_r = texture(gDiffuse_r, geom_texCoord).xyz;
     vec3 tDepth = texture(gDepth, geom_texCoord).xyz;
@@ -80,15 +87,17 @@ void main() {
     //    fragColor = vec4(0.0, 0.0, 0.0, 1.0);
     //}
 
-    // surface normal in eye space
-    vec3 eyeSpaceNormal = (transpose(inverse(mV)) * vec4(worldSpaceNormal, 0.0)).xyz;    
+    // surface normal in eye space; the view is a rigid transformation,
+    // so it transforms the normals as it is
+    vec3 eyeSpaceNormal = mat3(mV) * worldSpaceNormal;
     eyeSpaceNormal = normalize(eyeSpaceNormal);
 
 
     //get the position of the fragment in eye space
-    vec3 eyeSpacePos = screenSpaceToEyeSpace(vec3(gl_FragCoord.x, gl_FragCoord.y, tDepth.r)); 
+    vec3 eyeSpacePos = eyePosition(gl_FragCoord.xy, tDepth.r);
 
     // display some buffers for debug
+#ifdef DEBUG_VIEW
     if (displayMode == displayEyeSpacePos) {
         fragColor = vec4(0.0, 0.0, 0.0, 1.0);
         fragColor.rgb += eyeSpacePos.xyz;
@@ -97,7 +106,9 @@ void main() {
         fragColor = vec4(0.0, 0.0, 0.0, 1.0);
         fragColor.rgb += eyeSpaceNormal.xyz;
 
-    } else { // display image 
+    } else
+#endif
+    { // display image 
         //get the tangent vectors for the surface frame
         vec3 t0, t1;
         if (eyeSpaceNormal.x == 0.0 && eyeSpaceNormal.y == 0.0) {
@@ -135,8 +146,8 @@ void main() {
                 // between the point on the depth buffer and the current 
                 // fragment is greater than the occlussion range
                 // defined by the ambient light. 
-                vec3 p_depth = vec3(screenSpaceSample.x, screenSpaceSample.y, depth);
-                if (length(screenSpaceToEyeSpace(p_depth) - eyeSpacePos) > 4) {
+                vec2 p_window = screenSpaceSample.xy * vec2(windowWidth, windowHeight);
+                if (length(eyePosition(p_window, depth) - eyeSpacePos) > 4) {
                     total_unoccluded = total_unoccluded + 1;
                 }
             }
@@ -2,23 +2,29 @@
 
 const float PI = 3.14159265358979323846264;
 
-uniform float windowWidth;
-uniform float windowHeight;
-
-uniform mat4 mM;  // Model matrix
-uniform mat4 mV;  // View matrix
-uniform mat4 mP;  // Projection matrix
-
-uniform vec3  lightPosition; // light position in word space
-uniform vec3  lightPower;
-uniform vec3  diffuse_r;
-uniform float alpha;
-uniform float eta;
-uniform float k_s;
-uniform vec3  cameraEye;     // camera eye position in world space
+// Camera and window of the pass (see ViewBlock in UniformBlocks.hpp)
+layout (std140) uniform ViewBlock {
+    mat4  mV;            // View matrix
+    mat4  mP;            // Projection matrix
+    mat4  mVinv;         // inverse of the view matrix
+    mat4  mVP;           // mP * mV
+    vec3  cameraEye;     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+};
+
+// The light of the pass (see LightBlock in UniformBlocks.hpp)
+layout (std140) uniform LightBlock {
+    vec3  lightPosition; // point light position in world space
+    vec3  lightPower;
+    vec3  lightRadiance; // ambient light
+    float lightRange;
+    mat4  mVP_l;         // Projection * view matrix from light view
+};
 
 in vec3 vNormal;    // serface normal in world space
 in vec3 vPosition;  // vertex position in world space
+flat in int vMaterial;  // row of the material table
 
 uniform samplerCube skybox;
 uniform int skyboxReflection;
@@ -30,27 +36,18 @@ out vec4 fragColor;
 // function from microfacet.fs
 float isotropicMicrofacet(vec3 i, vec3 o, vec3 n, float eta, float alpha);
 
+// function from material.fs
+void getMaterial(int m, out vec3 diffuse_r, out float alpha, out float eta, out float k_s);
+
 void main() {
+    vec3 diffuse_r;
+    float alpha, eta, k_s;
+    getMaterial(vMaterial, diffuse_r, alpha, eta, k_s);
     
     vec3 snormal = (gl_FrontFacing) ? vNormal : -vNormal;
 
-    //get the position of the pixel in workd space
-    /*********************
-    * this part is copied from 
-    *   https://www.khronos.org/opengl/wiki/Compute_eye_space_from_window_space 
-    */
-    vec4 viewport = vec4(0.0, 0.0, windowWidth, windowHeight);
-    vec4 ndcPos;
-    ndcPos.xy = ((2.0 * gl_FragCoord.xy) - (2.0 * viewport.xy)) / (viewport.zw) - 1;
-    ndcPos.z = (2.0 * gl_FragCoord.z - gl_DepthRange.near - gl_DepthRange.far) / (gl_DepthRange.far - gl_DepthRange.near);
-    ndcPos.w = 1.0;
-    vec4 clipPos = ndcPos / gl_FragCoord.w;
-    vec4 eyePos = inverse(mP) * clipPos;
-    /**********************/
-
-
-    // get to the world space
-    vec3 vPos = (inverse(mV) * eyePos).xyz;
+    // position of the pixel in world space, interpolated from the vertices
+    vec3 vPos = vPosition;
 
     // get intensity of the light
     vec3 lightDir1 = normalize(vPos - lightPosition);
@@ -1,51 +1,68 @@
 #version 330
 
-uniform mat4 mM;  // Model matrix
-uniform mat4 mV;  // View matrix
-uniform mat4 mP;  // Projection matrix
+// Camera and window of the pass (see ViewBlock in UniformBlocks.hpp)
+layout (std140) uniform ViewBlock {
+    mat4  mV;            // View matrix
+    mat4  mP;            // Projection matrix
+    mat4  mVinv;         // inverse of the view matrix
+    mat4  mVP;           // mP * mV
+    vec3  cameraEye;     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+};
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
+#ifdef SKINNED
 layout (location = 2) in ivec4 boneIDs;
 layout (location = 3) in vec4 boneWts;
+#endif
+layout (location = 4) in mat4 mM;  // Model matrix, per instance (locations 4-7)
+layout (location = 10) in int material;  // row of the material table, per instance
+layout (location = 11) in mat3 mN;  // Normal matrix, inverse transpose of mM, per instance (locations 11-13)
 
-// 0 if no animation; 1 if has animation with bone info; 2 if has animation no bone info
-uniform int  hasAnimation;
-const int maxTotalBones = 100;
+// SKINNED is defined by the program variant of animations with bone info
+// (see SceneApp::setShaders); without it the vertices are only transformed by mM
+#ifdef SKINNED
 const int maxVertexBones = 4;
-uniform mat4 boneTransform[maxTotalBones];
+uniform samplerBuffer bones;  // bone palette, the four columns of the transformation of each bone
+
+// transformation of bone b, from the bone palette
+mat4 boneTransform(int b) {
+    return mat4(texelFetch(bones, 4 * b), texelFetch(bones, 4 * b + 1),
+                texelFetch(bones, 4 * b + 2), texelFetch(bones, 4 * b + 3));
+}
+#endif
 
 out vec3 vPosition;  // vertex position in world space
 out vec3 vNormal;    // vertex normal in world space
+flat out int vMaterial;
 //out vec4 temp;
 
+// functions from vertexdecode.vs
+vec3 decodePosition(vec3 p);
+vec3 decodeNormal(vec3 n);
+
 void main()
 {
-    if (hasAnimation == 1) {
-        mat4 bT = boneTransform[boneIDs[0]] * boneWts[0]
-                    + boneTransform[boneIDs[1]] * boneWts[1]
-                    + boneTransform[boneIDs[2]] * boneWts[2]
-                    + boneTransform[boneIDs[3]] * boneWts[3];
-        vec4 localPos = bT * vec4(position, 1.0);
-        vec4 localNorm = bT * vec4(normal, 0.0);
-        vPosition = (mM * localPos).xyz;
-        vNormal = (transpose(inverse(mM)) * localNorm).xyz;
-        vNormal = normalize(vNormal);
-
-        //vPosition = (mM * vec4(position, 1.0)).xyz;
-        //vNormal = (transpose(inverse(mM)) * vec4(normal, 0.0)).xyz;
-        //vNormal = normalize(vNormal);
-
-        gl_Position = mP * mV * vec4(vPosition, 1.0);
-
-        //temp = vec4(boneTransform[boneIDs[0]][0]);
-        //temp = boneIDs;
-
-    } else {
-        vPosition = (mM * vec4(position, 1.0)).xyz;
-        vNormal = (transpose(inverse(mM)) * vec4(normal, 0.0)).xyz;
-        vNormal = normalize(vNormal);
-
-        gl_Position = mP * mV * vec4(vPosition, 1.0);
-    }
+    vMaterial = material;
+    vec3 objPosition = decodePosition(position);  // position in model space
+    vec3 objNormal = decodeNormal(normal);        // normal in model space
+
+#ifdef SKINNED
+    mat4 bT = boneTransform(boneIDs[0]) * boneWts[0]
+                + boneTransform(boneIDs[1]) * boneWts[1]
+                + boneTransform(boneIDs[2]) * boneWts[2]
+                + boneTransform(boneIDs[3]) * boneWts[3];
+    objPosition = (bT * vec4(objPosition, 1.0)).xyz;
+    objNormal = (bT * vec4(objNormal, 0.0)).xyz;
+
+    //temp = vec4(boneTransform(boneIDs[0])[0]);
+    //temp = boneIDs;
+#endif
+
+    vPosition = (mM * vec4(objPosition, 1.0)).xyz;
+    vNormal = normalize(mN * objNormal);
+
+    gl_Position = mVP * vec4(vPosition, 1.0);
 }
@@ -1,11 +1,7 @@
 #version 330
 
-uniform vec3  diffuse_r;
-uniform float alpha;
-uniform float eta;
-uniform float k_s;
-
 in vec3 vNormal;    // serface normal in world space
+flat in int vMaterial;  // row of the material table
 
 layout (location = 0) out vec3 gNormal;
 layout (location = 1) out vec3 gDiffuse_r;
@@ -14,7 +10,14 @@ layout (location = 3) out vec3 gConvert;
 
 out vec4 fragColor;
 
+// function from material.fs
+void getMaterial(int m, out vec3 diffuse_r, out float alpha, out float eta, out float k_s);
+
 void main() {
+    vec3 diffuse_r;
+    float alpha, eta, k_s;
+    getMaterial(vMaterial, diffuse_r, alpha, eta, k_s);
+
 	// make sure all the g-buffer values are in the range of [0.1]
     gNormal = (vNormal + 1.0)/2.0; 
     gDiffuse_r = diffuse_r;
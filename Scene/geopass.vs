@@ -1,17 +1,32 @@
 #version 330
 
-uniform mat4 mM;  // Model matrix
-uniform mat4 mV;  // View matrix
-uniform mat4 mP;  // Projection matrix
+// Camera and window of the pass (see ViewBlock in UniformBlocks.hpp)
+layout (std140) uniform ViewBlock {
+    mat4  mV;            // View matrix
+    mat4  mP;            // Projection matrix
+    mat4  mVinv;         // inverse of the view matrix
+    mat4  mVP;           // mP * mV
+    vec3  cameraEye;     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+};
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
+layout (location = 4) in mat4 mM;  // Model matrix, per instance (locations 4-7)
+layout (location = 10) in int material;  // row of the material table, per instance
+layout (location = 11) in mat3 mN;  // Normal matrix, inverse transpose of mM, per instance (locations 11-13)
 
 out vec3 vNormal;    // vertex normal in world space
+flat out int vMaterial;
+
+// functions from vertexdecode.vs
+vec3 decodePosition(vec3 p);
+vec3 decodeNormal(vec3 n);
 
 void main()
 {
-    vNormal = (transpose(inverse(mM)) * vec4(normal, 0.0)).xyz;
-    vNormal = normalize(vNormal);
-    gl_Position = mP * mV * mM * vec4(position, 1.0);
+    vMaterial = material;
+    vNormal = normalize(mN * decodeNormal(normal));
+    gl_Position = mVP * (mM * vec4(decodePosition(position), 1.0));
 }
@@ -0,0 +1,53 @@
+#version 330
+
+// Write the G-buffer from the view of the atlas read by the impostor quad
+// (see impostor.vs), with the depth of the surface seen in the view.
+
+uniform sampler2D atlasNormal;     // normals in model space, as in gNormal
+uniform sampler2D atlasDiffuse_r;
+uniform sampler2D atlasAlpha;
+uniform sampler2D atlasConvert;
+uniform sampler2D atlasDepth;      // linear, 0 at the front of the sphere, 1 at the back
+
+uniform int tileSize;       // size of the tile of a view in texels
+uniform vec2 tileScale;     // size of the tile of a view in atlas texture coordinates
+
+in vec2 vTileCoord;
+in vec3 vTilePoint;
+flat in vec3 vDepthAxis;
+flat in vec2 vTileOrigin;
+flat in mat4 vMVP;
+flat in mat3 vNormalMatrix;
+
+layout (location = 0) out vec3 gNormal;
+layout (location = 1) out vec3 gDiffuse_r;
+layout (location = 2) out vec3 gAlpha;
+layout (location = 3) out vec3 gConvert;
+
+out vec4 fragColor;
+
+void main() {
+    if (abs(vTileCoord.x) > 1.0 || abs(vTileCoord.y) > 1.0) {
+        discard;
+    }
+
+    // stay half a texel inside the tile, away from the next view
+    float margin = 0.5 / float(tileSize);
+    vec2 uv = vTileOrigin + clamp(vTileCoord * 0.5 + 0.5, margin, 1.0 - margin) * tileScale;
+    float depth = texture(atlasDepth, uv).x;
+    if (depth >= 1.0) {
+        discard;    // the mesh does not cover this texel
+    }
+
+    vec3 n = texture(atlasNormal, uv).xyz * 2.0 - 1.0;
+    gNormal = (normalize(vNormalMatrix * n) + 1.0) / 2.0;
+    gDiffuse_r = texture(atlasDiffuse_r, uv).xyz;
+    gAlpha = texture(atlasAlpha, uv).xyz;
+    gConvert = texture(atlasConvert, uv).xyz;
+
+    // depth of the surface point, instead of the depth of the quad
+    vec4 clip = vMVP * vec4(vTilePoint + vDepthAxis * (1.0 - 2.0 * depth), 1.0);
+    gl_FragDepth = clamp(clip.z / clip.w * 0.5 + 0.5, 0.0, 1.0);
+
+    fragColor = vec4(0.0, 0.0, 0.0, 0.0);
+}
@@ -0,0 +1,93 @@
+#version 330
+
+// Quads standing in for distant meshes (see ImpostorAtlas). Each quad faces
+// the camera and covers the bounding sphere of its object; it reads the view
+// of the atlas nearest to the direction of the camera.
+
+// Camera and window of the pass (see ViewBlock in UniformBlocks.hpp)
+layout (std140) uniform ViewBlock {
+    mat4  mV;            // View matrix
+    mat4  mP;            // Projection matrix
+    mat4  mVinv;         // inverse of the view matrix
+    mat4  mVP;           // mP * mV
+    vec3  cameraEye;     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+};
+
+uniform int numViews;         // views along each side of the octahedral map
+uniform int impostorsPerRow;  // impostors along each row of the atlas
+uniform vec2 tileScale;       // size of the tile of a view in atlas texture coordinates
+
+layout (location = 0) in vec2 corner;    // corner of the quad, in [-1,1]
+layout (location = 4) in mat4 mM;        // Model matrix, per instance (locations 4-7)
+layout (location = 8) in vec4 sphere;    // bounding sphere in model space, per instance
+layout (location = 9) in int impostor;   // impostor in the atlas, per instance
+layout (location = 10) in mat3 mN;       // Normal matrix, inverse transpose of mM, per instance (locations 10-12)
+
+out vec2 vTileCoord;     // point of the quad projected in the view, in [-1,1] on the tile
+out vec3 vTilePoint;     // the same point on the plane of the view, in model space
+flat out vec3 vDepthAxis;     // from the front of the sphere to its center in the view
+flat out vec2 vTileOrigin;    // corner of the tile of the view in the atlas
+flat out mat4 vMVP;
+flat out mat3 vNormalMatrix;
+
+// Unit direction at the center of cell c of the octahedral map
+// (see viewDirection in ImpostorAtlas.cpp)
+vec3 viewDirection(ivec2 c) {
+    vec2 e = (vec2(c) + 0.5) / float(numViews) * 2.0 - 1.0;
+    vec3 d = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (d.z < 0.0) {
+        d.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(d);
+}
+
+// Cell of the octahedral map holding direction d (see GLWrap::octEncode)
+ivec2 viewCell(vec3 d) {
+    d /= abs(d.x) + abs(d.y) + abs(d.z);
+    vec2 e = d.xy;
+    if (d.z < 0.0) {
+        e = (1.0 - abs(d.yx)) * vec2(d.x >= 0.0 ? 1.0 : -1.0, d.y >= 0.0 ? 1.0 : -1.0);
+    }
+    ivec2 c = ivec2(floor((e * 0.5 + 0.5) * float(numViews)));
+    return clamp(c, ivec2(0), ivec2(numViews - 1));
+}
+
+// Right and up axes of a camera looking along -d (see viewBasis in ImpostorAtlas.cpp)
+void viewBasis(vec3 d, out vec3 right, out vec3 up) {
+    vec3 reference = abs(d.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0);
+    right = normalize(cross(reference, d));
+    up = cross(d, right);
+}
+
+void main()
+{
+    vec3 center = sphere.xyz;
+    float radius = sphere.w;
+
+    // direction of the camera from the center, in model space; the inverse
+    // of the linear part of mM is the transpose of mN
+    vec3 toEye = (cameraEye - mM[3].xyz) * mN - center;
+    toEye = length(toEye) > 0.0 ? normalize(toEye) : vec3(0.0, 0.0, 1.0);
+
+    // the quad faces the camera
+    vec3 right, up;
+    viewBasis(toEye, right, up);
+    vec3 p = center + radius * (corner.x * right + corner.y * up);
+    vMVP = mVP * mM;
+    gl_Position = vMVP * vec4(p, 1.0);
+
+    // the view nearest to the camera, and where the point falls in it
+    ivec2 cell = viewCell(toEye);
+    vec3 d = viewDirection(cell);
+    vec3 tileRight, tileUp;
+    viewBasis(d, tileRight, tileUp);
+    vTileCoord = vec2(dot(p - center, tileRight), dot(p - center, tileUp)) / radius;
+    vTilePoint = center + radius * (vTileCoord.x * tileRight + vTileCoord.y * tileUp);
+    vDepthAxis = radius * d;
+
+    ivec2 block = ivec2(impostor % impostorsPerRow, impostor / impostorsPerRow);
+    vTileOrigin = vec2(block * numViews + cell) * tileScale;
+    vNormalMatrix = mN;
+}
@@ -5,15 +5,25 @@ uniform sampler2D gDiffuse_r;
 uniform sampler2D gAlpha;
 uniform sampler2D gConvert;
 
-uniform float windowWidth;
-uniform float windowHeight;
+// Camera and window of the pass (see ViewBlock in UniformBlocks.hpp)
+layout (std140) uniform ViewBlock {
+    mat4  mV;            // View matrix
+    mat4  mP;            // Projection matrix
+    mat4  mVinv;         // inverse of the view matrix
+    mat4  mVP;           // mP * mV
+    vec3  cameraEye;     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+};
 
-uniform mat4 mV;  // View matrix
-uniform mat4 mP;  // Projection matrix
-
-uniform vec3  lightPosition; // light position in word space
-uniform vec3  lightPower;
-uniform vec3  cameraEye;     // camera eye position in world space.
+// The light of the pass (see LightBlock in UniformBlocks.hpp)
+layout (std140) uniform LightBlock {
+    vec3  lightPosition; // point light position in world space
+    vec3  lightPower;
+    vec3  lightRadiance; // ambient light
+    float lightRange;
+    mat4  mVP_l;         // Projection * view matrix from light view
+};
 
 in vec2 geom_texCoord;
 
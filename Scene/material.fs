@@ -0,0 +1,19 @@
+#version 330
+
+// This is a shader code fragment (not a complete shader) that contains 
+// the function to read a material from the material table, a buffer
+// texture with two texels per material (see SceneApp::setMaterials):
+//   texel 2*m:     diffuse_r, 0
+//   texel 2*m + 1: alpha, eta, k_s, 0
+
+uniform samplerBuffer materials;
+
+// Microfacet parameters of a material
+//   m -- row of the material in the table
+void getMaterial(int m, out vec3 diffuse_r, out float alpha, out float eta, out float k_s) {
+    diffuse_r = texelFetch(materials, 2 * m).rgb;
+    vec4 p = texelFetch(materials, 2 * m + 1);
+    alpha = p.x;
+    eta = p.y;
+    k_s = p.z;
+}
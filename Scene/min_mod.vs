@@ -1,35 +1,56 @@
 #version 330
 
-uniform mat4 mM;  // Model matrix
-uniform mat4 mV;  // View matrix
-uniform mat4 mP;  // Projection matrix
+// Camera and window of the pass (see ViewBlock in UniformBlocks.hpp)
+layout (std140) uniform ViewBlock {
+    mat4  mV;            // View matrix
+    mat4  mP;            // Projection matrix
+    mat4  mVinv;         // inverse of the view matrix
+    mat4  mVP;           // mP * mV
+    vec3  cameraEye;     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+};
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
+#ifdef SKINNED
 layout (location = 2) in ivec4 boneIDs;
 layout (location = 3) in vec4 boneWts;
+#endif
+layout (location = 4) in mat4 mM;  // Model matrix, per instance (locations 4-7)
 
-// 0 if no animation; 1 if has animation with bone info; 2 if has animation no bone info
-uniform int  hasAnimation;
-const int maxTotalBones = 100;
+// SKINNED is defined by the program variant of animations with bone info
+// (see SceneApp::setShaders); without it the vertices are only transformed by mM
+#ifdef SKINNED
 const int maxVertexBones = 4;
-uniform mat4 boneTransform[maxTotalBones];
+uniform samplerBuffer bones;  // bone palette, the four columns of the transformation of each bone
+
+// transformation of bone b, from the bone palette
+mat4 boneTransform(int b) {
+    return mat4(texelFetch(bones, 4 * b), texelFetch(bones, 4 * b + 1),
+                texelFetch(bones, 4 * b + 2), texelFetch(bones, 4 * b + 3));
+}
+#endif
 
 out vec3 vPosition;  // vertex position in eye space
 
+// function from vertexdecode.vs
+vec3 decodePosition(vec3 p);
+
 void main()
 {
-    if (hasAnimation == 1) {
-        mat4 bT = boneTransform[boneIDs[0]] * boneWts[0]
-                    + boneTransform[boneIDs[1]] * boneWts[1]
-                    + boneTransform[boneIDs[2]] * boneWts[2]
-                    + boneTransform[boneIDs[3]] * boneWts[3];
-        vec4 localPos = bT * vec4(position, 1.0);
-        vPosition = (mM * localPos).xyz;
-        gl_Position = mP * mV * vec4(vPosition, 1.0);
-
-    } else {
-        vPosition = (mV * mM * vec4(position, 1.0)).xyz;
-        gl_Position = mP * vec4(vPosition, 1.0);
-    }
+    vec3 objPosition = decodePosition(position);  // position in model space
+
+#ifdef SKINNED
+    mat4 bT = boneTransform(boneIDs[0]) * boneWts[0]
+                + boneTransform(boneIDs[1]) * boneWts[1]
+                + boneTransform(boneIDs[2]) * boneWts[2]
+                + boneTransform(boneIDs[3]) * boneWts[3];
+    vec4 localPos = bT * vec4(objPosition, 1.0);
+    vPosition = (mM * localPos).xyz;
+    gl_Position = mVP * vec4(vPosition, 1.0);
+#else
+    vPosition = (mV * mM * vec4(objPosition, 1.0)).xyz;
+    gl_Position = mP * vec4(vPosition, 1.0);
+#endif
 }
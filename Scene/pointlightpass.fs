@@ -1,6 +1,12 @@
 #version 330
 
+// DEBUG_VIEW is defined to one of the display modes below by the debug
+// program variant (see SceneApp::setShaders), to show a buffer instead of the lighting
+#ifdef DEBUG_VIEW
+const int displayMode = DEBUG_VIEW;
+#else
 const int displayMode = 0;
+#endif
 
 const int displayImage = 0;
 const int displayWordPos = 1;
@@ -21,17 +27,25 @@ uniform sampler2D gConvert;
 uniform sampler2D gDepth;
 uniform sampler2D shadowMap;
 
-uniform float windowWidth;
-uniform float windowHeight;
-
-uniform mat4 mV;     // View matrix from camera view
-uniform mat4 mP;     // Projection matrix from camera view
-uniform mat4 mV_l;   // View matrix from light view
-uniform mat4 mP_l;   // Projection matrix from light view
-
-uniform vec3  lightPosition; // light position in word space
-uniform vec3  lightPower;
-uniform vec3  cameraEye;     // camera eye position in world space.
+// Camera and window of the pass (see ViewBlock in UniformBlocks.hpp)
+layout (std140) uniform ViewBlock {
+    mat4  mV;            // View matrix
+    mat4  mP;            // Projection matrix
+    mat4  mVinv;         // inverse of the view matrix
+    mat4  mVP;           // mP * mV
+    vec3  cameraEye;     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+};
+
+// The light of the pass (see LightBlock in UniformBlocks.hpp)
+layout (std140) uniform LightBlock {
+    vec3  lightPosition; // point light position in world space
+    vec3  lightPower;
+    vec3  lightRadiance; // ambient light
+    float lightRange;
+    mat4  mVP_l;         // Projection * view matrix from light view
+};
 
 in vec2 geom_texCoord;
 
@@ -40,6 +54,9 @@ out vec4 fragColor;
 // function from microfacet.fs
 float isotropicMicrofacet(vec3 i, vec3 o, vec3 n, float eta, float alpha);
 
+// function from viewray.fs
+vec3 worldPosition(vec2 fragCoord, float depth);
+
 // Make the depth linear for display.
 // The formular can be found here: 
 //   https://learnopengl.com/Advanced-OpenGL/Depth-testing 
@@ -54,7 +71,6 @@ float LinearDepth(float depth)
 
 void main() {
     // unpacking the texture 
-    vec4 viewport = vec4(0.0, 0.0, windowWidth, windowHeight);
     vec3 tNormal = texture(gNormal, geom_texCoord).xyz;
     vec3 tDiffuse_r = texture(gDiffuse_r, geom_texCoord).xyz;
     vec3 tAlpha = texture(gAlpha, geom_texCoord).xyz;
@@ -79,20 +95,16 @@ void main() {
     snormal = normalize(snormal);
 
     //get the position of the fragment in world space
-    vec4 ndcPos;
-    ndcPos.xy = 2.0 * gl_FragCoord.xy / viewport.zw - 1.0;
-    ndcPos.z = 2.0 * tDepth.r - 1.0;
-    ndcPos.w = 1.0;
-    vec4 eyePos = inverse(mP) * ndcPos;    
-    vec3 vPos = (inverse(mV) * (eyePos/eyePos.w)).xyz; // world space  
+    vec3 vPos = worldPosition(gl_FragCoord.xy, tDepth.r);
 
     // get the shadow texture coordinates and depth from the shadow map
-    vec4 clipPos_l = mP_l * mV_l * vec4(vPos, 1.0);
+    vec4 clipPos_l = mVP_l * vec4(vPos, 1.0);
     vec4 ndcPos_l = clipPos_l/clipPos_l.w;
     vec4 shadowTextCoord = ndcPos_l * 0.5  + 0.5;  
     vec3 tLight_Depth = texture(shadowMap, shadowTextCoord.xy).xyz;
 
     // display some buffers for debug 
+#ifdef DEBUG_VIEW
     if (displayMode == displayWordPos) {
         fragColor = vec4(0.0, 0.0, 0.0, 1.0);
         fragColor.rgb += vPos.xyz;
@@ -117,7 +129,9 @@ void main() {
         fragColor = vec4(0.0, 0.0, 0.0, 1.0);
         fragColor.rgb += tDiffuse_r.xyz;
 
-    } else { // display image 
+    } else
+#endif
+    { // display image 
 
         // if shadow, color will be black
         if (tLight_Depth.r < shadowTextCoord.z - 0.0001) {
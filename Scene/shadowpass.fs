@@ -1,9 +1,6 @@
 #version 330
 
-
-out vec4 fragColor;
- 
+// Depth only, the shadow map has no color attachment
 void main()
 {
-    fragColor = vec4(0.0, 0.0, 0.0, 1.0); 
-}
\ No newline at end of file
+}
@@ -1,14 +1,25 @@
 #version 330
 
-uniform mat4 mM;  // Model matrix
-uniform mat4 mV;  // View matrix
-uniform mat4 mP;  // Projection matrix
+// Camera and window of the pass (see ViewBlock in UniformBlocks.hpp)
+layout (std140) uniform ViewBlock {
+    mat4  mV;            // View matrix
+    mat4  mP;            // Projection matrix
+    mat4  mVinv;         // inverse of the view matrix
+    mat4  mVP;           // mP * mV
+    vec3  cameraEye;     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+};
 
+// Reads the position-only vertices (see MeshStore::bind): nothing but the
+// position is fetched, the pass only writes depth
 layout (location = 0) in vec3 position;
+layout (location = 4) in mat4 mM;  // Model matrix, per instance (locations 4-7)
 
-out vec3 vNormal;    // vertex normal in world space
+// function from vertexdecode.vs
+vec3 decodePosition(vec3 p);
   
 void main()
 {
-    gl_Position = mP * mV * mM * vec4(position, 1.0);
+    gl_Position = mVP * (mM * vec4(decodePosition(position), 1.0));
 }
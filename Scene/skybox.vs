@@ -1,7 +1,15 @@
 #version 330
 
-uniform mat4 mV;  // View matrix
-uniform mat4 mP;  // Projection matrix
+// Camera and window of the pass (see ViewBlock in UniformBlocks.hpp)
+layout (std140) uniform ViewBlock {
+    mat4  mV;            // View matrix
+    mat4  mP;            // Projection matrix
+    mat4  mVinv;         // inverse of the view matrix
+    mat4  mVP;           // mP * mV
+    vec3  cameraEye;     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+};
 
 layout (location = 0) in vec3 vert_position;
 
@@ -1,11 +1,15 @@
 #version 330
 
-uniform mat4 mV;     // View matrix from camera view
-uniform mat4 mP;     // Projection matrix from camera view
-uniform vec3  cameraEye;  // camera eye position in world space.
-
-uniform float windowWidth;
-uniform float windowHeight;
+// Camera and window of the pass (see ViewBlock in UniformBlocks.hpp)
+layout (std140) uniform ViewBlock {
+    mat4  mV;            // View matrix
+    mat4  mP;            // Projection matrix
+    mat4  mVinv;         // inverse of the view matrix
+    mat4  mVP;           // mP * mV
+    vec3  cameraEye;     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+};
 
 in vec2 geom_texCoord;
 
@@ -18,6 +22,9 @@ uniform samplerCube skybox;
 
 out vec4 fragColor;
 
+// function from viewray.fs
+vec3 worldPosition(vec2 fragCoord, float depth);
+
 void main()
 {    
     // unpack the normal and depth from the g-buffers 
@@ -28,13 +35,7 @@ void main()
 
     if (tDepth.r < 1.0) {
     	// get world space position
-    	vec4 ndcPos;
-    	vec4 viewport = vec4(0.0, 0.0, windowWidth, windowHeight);
-    	ndcPos.xy = 2.0 * gl_FragCoord.xy / viewport.zw - 1.0;
-    	ndcPos.z = 2.0 * tDepth.r - 1.0;
-    	ndcPos.w = 1.0;
-    	vec4 eyePos = inverse(mP) * ndcPos;    
-    	vec3 vPos = (inverse(mV) * (eyePos/eyePos.w)).xyz; // world space  
+    	vec3 vPos = worldPosition(gl_FragCoord.xy, tDepth.r);
 
   		// skybox mirror reflection 
       	vec3 I = normalize(vPos - cameraEye);
@@ -0,0 +1,31 @@
+#version 330
+
+// This is a shader code fragment (not a complete shader) that contains 
+// the functions to decode the vertex attributes of the compact vertex
+// formats (see VertexFormats.hpp). With full precision vertices the
+// dequantization is the identity and octNormals is 0.
+
+// per instance: model space position = packed position * posScale + posOffset
+layout (location = 8) in vec3 posScale;
+layout (location = 9) in vec3 posOffset;
+
+uniform int  octNormals; // 1 if normals are octahedral-encoded in xy
+
+// Position in model space
+//   p -- position attribute, in [0,1] if quantized
+vec3 decodePosition(vec3 p) {
+    return p * posScale + posOffset;
+}
+
+// Unit normal in model space
+//   n -- normal attribute, octahedral-encoded in n.xy if octNormals is 1
+vec3 decodeNormal(vec3 n) {
+    if (octNormals == 1) {
+        vec3 o = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));
+        if (o.z < 0.0) {
+            o.xy = (1.0 - abs(o.yx)) * vec2(o.x >= 0.0 ? 1.0 : -1.0, o.y >= 0.0 ? 1.0 : -1.0);
+        }
+        return normalize(o);
+    }
+    return n;
+}
@@ -0,0 +1,48 @@
+#version 330
+
+// This is a shader code fragment (not a complete shader) that contains
+// the functions shared by the full-screen passes to get the position of a
+// pixel back from the depth buffer. It follows the ray from the eye through
+// the pixel instead of multiplying by inverse matrices: the projection is
+// perspective (see RTUtil::PerspectiveCamera), so the eye space position is
+// the ray scaled by the distance of the depth, and the world space position
+// comes from the inverse view matrix computed once per frame.
+
+// Camera and window of the pass (see ViewBlock in UniformBlocks.hpp)
+layout (std140) uniform ViewBlock {
+    mat4  mV;            // View matrix
+    mat4  mP;            // Projection matrix
+    mat4  mVinv;         // inverse of the view matrix
+    mat4  mVP;           // mP * mV
+    vec3  cameraEye;     // camera eye position in world space
+    float windowWidth;
+    float windowHeight;
+};
+
+// Ray from the eye through a pixel in eye space, scaled so that z is -1
+//   fragCoord -- window coordinates of the pixel (gl_FragCoord.xy)
+vec3 viewRay(vec2 fragCoord) {
+    vec2 ndc = 2.0 * fragCoord / vec2(windowWidth, windowHeight) - 1.0;
+    return vec3((ndc + mP[2].xy) / vec2(mP[0][0], mP[1][1]), -1.0);
+}
+
+// Distance in front of the eye (-z in eye space) of a depth buffer value
+//   depth -- window space depth, in [0,1]
+float eyeDepth(float depth) {
+    return mP[3][2] / (2.0 * depth - 1.0 + mP[2][2]);
+}
+
+// Position of a pixel in eye space
+vec3 eyePosition(vec2 fragCoord, float depth) {
+    return viewRay(fragCoord) * eyeDepth(depth);
+}
+
+// Position of a pixel in world space
+vec3 worldPosition(vec2 fragCoord, float depth) {
+    return (mVinv * vec4(eyePosition(fragCoord, depth), 1.0)).xyz;
+}
+
+// Unit direction in world space from the eye through a pixel
+vec3 worldViewDir(vec2 fragCoord) {
+    return normalize(mat3(mVinv) * viewRay(fragCoord));
+}